@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+    Heap allocation counters, for measuring how much the hot paths allocate. The counting
+    itself is done by the global operator new in src/alloc_hook, which is only linked into the
+    matemancpp_alloc_stats executable and the tests, so the regular build pays nothing for it.
+    Without the hook the counters stay at zero and allocation_counting_enabled is false.
+
+    Only allocations are counted, not frees: the numbers say how often the allocator is
+    entered, not how much memory is live.
+*/
+struct AllocationCounts
+{
+    uint64_t m_allocations = 0;
+    uint64_t m_bytes = 0;
+
+    AllocationCounts operator-(const AllocationCounts &other) const
+    {
+        return AllocationCounts{m_allocations - other.m_allocations, m_bytes - other.m_bytes};
+    }
+};
+
+bool allocation_counting_enabled();
+
+// allocations of all threads since the program started
+AllocationCounts allocation_counts();
+
+// allocations of the calling thread since it started
+AllocationCounts thread_allocation_counts();
+
+// called by the hook
+void record_allocation(size_t bytes);
+void enable_allocation_counting();
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*
+    Bump allocator for the scratch memory of a search, like move lists and eval records.
+    Allocating moves a pointer forward and nothing is freed on its own. A Scope gives back
+    everything that was allocated while it existed, so the memory is reused node by node,
+    and once the chunks are big enough for a search, searching doesn't touch the heap.
+
+    Every thread has its own arena, see thread_search_arena. An arena must not be shared.
+*/
+class SearchArena
+{
+    struct Chunk
+    {
+        std::unique_ptr<uint8_t[]> m_data;
+        size_t m_size;
+    };
+
+    std::vector<Chunk> m_chunks;
+    // the chunk that is allocated from, and the offset of its first free byte
+    size_t m_chunk = 0;
+    size_t m_offset = 0;
+
+public:
+    static constexpr size_t CHUNK_SIZE = 1 << 20;
+
+    struct Mark
+    {
+        size_t m_chunk;
+        size_t m_offset;
+    };
+
+    SearchArena() = default;
+    SearchArena(const SearchArena &) = delete;
+    SearchArena &operator=(const SearchArena &) = delete;
+
+    // alignment must be a power of two, no larger than alignof(std::max_align_t)
+    void *allocate(size_t bytes, size_t alignment);
+
+    Mark mark()
+    {
+        return Mark{m_chunk, m_offset};
+    }
+
+    // Frees everything allocated since mark was taken. The chunks are kept for reuse.
+    void rewind(Mark mark)
+    {
+        m_chunk = mark.m_chunk;
+        m_offset = mark.m_offset;
+    }
+
+    void reset()
+    {
+        rewind(Mark{0, 0});
+    }
+
+    // the number of chunks taken from the heap so far
+    size_t chunks()
+    {
+        return m_chunks.size();
+    }
+
+    class Scope
+    {
+        SearchArena &m_arena;
+        Mark m_mark;
+
+    public:
+        Scope(SearchArena &arena) : m_arena(arena), m_mark(arena.mark()) {}
+        ~Scope()
+        {
+            m_arena.rewind(m_mark);
+        }
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+    };
+};
+
+// The calling thread's arena.
+SearchArena &thread_search_arena();
+
+/*
+    Standard allocator on top of an arena, for containers of search scratch memory. Deallocating
+    does nothing, so a vector should reserve what it needs instead of growing in steps.
+*/
+template <typename T>
+struct ArenaAllocator
+{
+    using value_type = T;
+
+    SearchArena *m_arena;
+
+    ArenaAllocator(SearchArena &arena) : m_arena(&arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : m_arena(other.m_arena) {}
+
+    T *allocate(size_t n)
+    {
+        return static_cast<T *>(m_arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &other) const
+    {
+        return m_arena == other.m_arena;
+    }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const
+    {
+        return m_arena != other.m_arena;
+    }
+};
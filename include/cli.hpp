@@ -26,11 +26,16 @@ enum Command
   ponderhit,
   quit,
   create_tablebases,
+  update_tablebases,
+  replay_archive,
   read_tablebases,
+  prune_tablebase,
   test_tablebases,
   list_tablebase_moves,
   list_engine_moves,
-  print_current_position
+  print_current_position,
+  _perft,
+  search_speedup
 };
 
 class CLI
@@ -65,6 +70,7 @@ public:
   void process_command_uci(std::vector<std::string> args);
   void process_command_debug(std::vector<std::string> args);
   void process_command_isready(std::vector<std::string> args);
+  void process_command_setoption(std::vector<std::string> args);
   void process_command_register(std::vector<std::string> args);
   void process_command_ucinewgame(std::vector<std::string> args);
   void process_command_position(std::vector<std::string> args);
@@ -73,11 +79,16 @@ public:
   void process_command_ponderhit(std::vector<std::string> args);
   void process_command_quit(std::vector<std::string> args);
   void process_command_create_tablebases(std::vector<std::string> args);
+  void process_command_update_tablebases(std::vector<std::string> args);
+  void process_command_replay_archive(std::vector<std::string> args);
   void process_command_read_tablebases(std::vector<std::string> args);
+  void process_command_prune_tablebase(std::vector<std::string> args);
   void process_command_test_tablebases(std::vector<std::string> args);
   void process_command_list_tablebase_moves(std::vector<std::string> args);
   void process_command_list_engine_moves(std::vector<std::string> args);
   void process_command_print_current_position(std::vector<std::string> args);
+  void process_command_perft(std::vector<std::string> args);
+  void process_command_search_speedup(std::vector<std::string> args);
 
   void init_command_map();
   void process_command(std::string command);
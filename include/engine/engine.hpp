@@ -14,6 +14,9 @@
 #include <cstdlib>
 #include <limits>
 
+// Book moves played in less than this share of the games from a position are never picked.
+const double BOOK_MIN_MOVE_SHARE = 0.05;
+
 class Engine
 {
 public:
@@ -29,9 +32,14 @@ public:
         m_g = std::mt19937(rd());
     }
 
+    // Analyzes the tablebase once, so that book moves can be picked by score.
     void set_tablebase(std::shared_ptr<Tablebase> tablebase)
     {
         m_master_tablebase = tablebase;
+        if (m_master_tablebase != NULL)
+        {
+            m_master_tablebase->analyze();
+        }
     }
 
     void set_position(std::shared_ptr<Position> position)
@@ -381,7 +389,8 @@ public:
         if (m_master_tablebase != NULL)
         {
             z_hash_t position_hash = zobrist_hash(m_current_position.get());
-            tablebase_move = m_master_tablebase->pick_move_from_sample(position_hash);
+            tablebase_move = m_master_tablebase->pick_move_by_score(
+                position_hash, m_current_position->m_whites_turn, BOOK_MIN_MOVE_SHARE);
         }
         return tablebase_move;
     }
@@ -395,6 +404,7 @@ public:
             return tablebase_move;
         }
 
-        return minmax_search(m_current_position, 4);
+        // the same move as minmax_search, whatever the number of threads
+        return root_parallel_search(m_current_position, 4, shared_thread_pool());
     }
 };
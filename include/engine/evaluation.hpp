@@ -7,9 +7,12 @@ struct PositionEval
     int black_material = 0;
 };
 
+struct PositionEval count_material(const Position &position);
 struct PositionEval count_material(std::shared_ptr<Position> position);
 
 int basic_material_for_piece(piece_t piece);
 
-// negative is good for black, positive is good for white
+// negative is good for black, positive is good for white. Checking for mate generates the
+// moves, which plays them on position and takes them back.
+int evaluate(Position &position);
 int evaluate(std::shared_ptr<Position> position);
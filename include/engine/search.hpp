@@ -4,6 +4,8 @@
 #include "representation/position.hpp"
 #include "move_generation.hpp"
 #include "tablebase/zobrist.hpp"
+#include "threadpool/threadpool.hpp"
+#include <chrono>
 #include <set>
 
 using depth = size_t;
@@ -13,15 +15,20 @@ struct Eval
     int m_score;
     MoveKey m_movekey;
     depth m_resultant_position_depth;
-    std::string lan_move;
 
     Eval(int score, MoveKey movekey, depth position_depth)
-        : m_score(score), m_movekey(movekey), m_resultant_position_depth(position_depth)
+        : m_score(score), m_movekey(movekey), m_resultant_position_depth(position_depth) {}
+
+    // not stored, evals are made for every leaf of a search
+    std::string lan_move() const
     {
-        lan_move = movekey_to_lan(m_movekey);
+        return movekey_to_lan(m_movekey);
     }
 };
 
+// Evals of a running search, in the search thread's arena.
+using EvalStack = std::vector<Eval, ArenaAllocator<Eval>>;
+
 /*
     eval_stack - pointer to the stack that is being used in the minmax method
     current_position_depth - used to determine when to stop popping off the eval stack
@@ -30,9 +37,52 @@ struct Eval
         is then pushed back onto the eval stack, because the result of minmaxing the moves
         is then used for this node (i.e. e2e4 is evaluated by the minmax of the possible moves after e2e4)
 */
-void consolidate_eval_stack(std::vector<std::shared_ptr<Eval>> *eval_stack,
+void consolidate_eval_stack(EvalStack *eval_stack,
                             depth current_position_depth, bool whites_turn,
                             MoveKey origin_movekey);
 
 MoveKey
 minmax_search(std::shared_ptr<Position> position, depth max_depth);
+
+/*
+    Scores every root move to max_depth on the thread pool, one task per root move. Each task
+    searches its own copy of the position. The evals are in move generation order, whatever the
+    number of threads, and their scores are those minmax_search finds for the root moves. Root
+    moves whose lines all end before max_depth (in mate or stalemate) are left out, like in
+    minmax_search.
+*/
+std::vector<Eval> evaluate_root_moves(std::shared_ptr<Position> position, depth max_depth, ThreadPool &thread_pool);
+
+/*
+    Root parallel minmax_search: the same move, independent of the number of threads and the
+    order the tasks finish in. Of equally scored moves, the first in move generation order wins.
+*/
+MoveKey
+root_parallel_search(std::shared_ptr<Position> position, depth max_depth, ThreadPool &thread_pool);
+
+// Nodes with fewer plies left than this are searched by one thread.
+const depth YBWC_MIN_SPLIT_DEPTH = 2;
+
+struct SearchStats
+{
+    uint64_t m_nodes = 0;
+    uint64_t m_split_points = 0;
+    int m_threads = 1;
+    std::chrono::nanoseconds m_time = std::chrono::nanoseconds(0);
+
+    double nodes_per_second()
+    {
+        return m_time.count() ? m_nodes * 1e9 / m_time.count() : 0;
+    }
+};
+
+/*
+    Alpha-beta search, parallel by the young brothers wait concept: at every node the first move
+    is searched before the others, which are then searched by the pool's threads at once, each on
+    its own copy of the node's position. A cutoff found by one of them stops the others.
+
+    The score is the minmax score of the position, so the same as minmax_search's. Of equally
+    scored moves the one returned may depend on the timing of the threads, use root_parallel_search
+    for reproducible moves. stats is optional.
+*/
+Eval ybwc_search(std::shared_ptr<Position> position, depth max_depth, ThreadPool &thread_pool, SearchStats *stats);
@@ -2,6 +2,7 @@
 
 #include "representation/position.hpp"
 #include "representation/move.hpp"
+#include "arena.hpp"
 #include <cstdint>
 #include <vector>
 
@@ -19,53 +20,64 @@ bool is_b_bishop(piece_t piece);
 bool is_b_rook(piece_t piece);
 bool is_b_queen(piece_t piece);
 
-template <Color C>
-std::vector<MoveKey>
-generate_pseudolegal_pawn_moves(std::shared_ptr<Position> position,
-                                square_t square);
+/*
+    The generators append to moves, which can be a std::vector<MoveKey> or a MoveList.
+    They take the position by reference: they run thousands of times per searched node, and
+    copying a shared_ptr in and out of every call costs two atomic reference count updates.
+    The position is only changed while checking legality, and is restored before they return.
+*/
+template <Color C, typename Moves>
+void generate_pseudolegal_pawn_moves(Position &position, square_t square, Moves *moves);
 
-template <Color C>
-std::vector<MoveKey>
-generate_pseudolegal_king_moves(std::shared_ptr<Position> position,
-                                square_t square);
+template <Color C, typename Moves>
+void generate_pseudolegal_king_moves(Position &position, square_t square, Moves *moves);
 
-template <Color C>
-std::vector<MoveKey>
-generate_pseudolegal_castling_king_moves(std::shared_ptr<Position> position,
-                                         square_t square);
+template <Color C, typename Moves>
+void generate_pseudolegal_castling_king_moves(Position &position, square_t square, Moves *moves);
 
-template <Color C>
-std::vector<MoveKey>
-generate_pseudolegal_knight_moves(std::shared_ptr<Position> position,
-                                  square_t square);
+template <Color C, typename Moves>
+void generate_pseudolegal_knight_moves(Position &position, square_t square, Moves *moves);
 
-template <Color C>
-std::vector<MoveKey>
-generate_pseudolegal_rook_moves(std::shared_ptr<Position> position,
-                                square_t square);
+template <Color C, typename Moves>
+void generate_pseudolegal_rook_moves(Position &position, square_t square, Moves *moves);
 
-template <Color C>
-std::vector<MoveKey>
-generate_pseudolegal_bishop_moves(std::shared_ptr<Position> position,
-                                  square_t square);
+template <Color C, typename Moves>
+void generate_pseudolegal_bishop_moves(Position &position, square_t square, Moves *moves);
 
-template <Color C>
-std::vector<MoveKey>
-generate_pseudolegal_queen_moves(std::shared_ptr<Position> position,
-                                 square_t square);
+template <Color C, typename Moves>
+void generate_pseudolegal_queen_moves(Position &position, square_t square, Moves *moves);
 
-template <Color C>
-std::vector<MoveKey>
-generate_pseudolegal_piece_moves(std::shared_ptr<Position> position,
-                                 square_t square);
+template <Color C, typename Moves>
+void generate_pseudolegal_piece_moves(Position &position, square_t square, Moves *moves);
 
+// The shared_ptr overloads are for callers that hold one, search and perft use the references.
+std::vector<MoveKey> generate_pseudolegal_piece_moves(Position &position, square_t square);
 std::vector<MoveKey>
 generate_pseudolegal_piece_moves(std::shared_ptr<Position> position,
                                  square_t square);
 
+std::vector<MoveKey> generate_legal_moves(Position &position, square_t square);
 std::vector<MoveKey>
 generate_legal_moves(std::shared_ptr<Position> position,
                      square_t square);
 
+std::vector<MoveKey> get_all_moves(Position &position);
 std::vector<MoveKey> get_all_moves(std::shared_ptr<Position> position);
+
+// Upper bound of the number of legal moves in a position (218 is the most known).
+const size_t MAX_MOVES = 256;
+
+// Move list in a search arena, for move generation that doesn't allocate from the heap.
+using MoveList = std::vector<MoveKey, ArenaAllocator<MoveKey>>;
+
+// An empty list with room for MAX_MOVES moves, which stays valid until the arena is rewound.
+MoveList make_move_list(SearchArena &arena);
+
+// Appends the legal moves to moves, no heap allocations if it has room for them.
+void get_all_moves(Position &position, MoveList *moves);
+void get_all_moves(std::shared_ptr<Position> position, MoveList *moves);
+
+std::vector<MoveKey> generate_legal_moves_to_square(std::shared_ptr<Position> position,
+                                                    piece_t piece_type, square_t dst_square);
 std::string string_list_all_moves(std::shared_ptr<Position> position);
+std::string movekey_to_san(std::shared_ptr<Position> position, MoveKey movekey);
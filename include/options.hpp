@@ -1,3 +1,8 @@
 #pragma once
 
+#include <string>
+
+const int MAX_THREADS = 1024;
+
 void announce_options();
+bool set_option(std::string name, std::string value);
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "representation/position.hpp"
+#include "representation/move.hpp"
+#include "tablebase/zobrist.hpp"
+#include "threadpool/threadpool.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*
+    Transposition table for perft: the number of leaf nodes below a position at a given depth,
+    keyed by the position's zobrist hash and the depth. Shared by all threads without locks.
+    An entry stores its key xor its node count next to the count, so an entry that two threads
+    wrote at the same time doesn't verify, and is a miss rather than a wrong count.
+*/
+class PerftTable
+{
+    struct Entry
+    {
+        std::atomic<uint64_t> m_check;
+        std::atomic<uint64_t> m_nodes;
+    };
+
+    std::unique_ptr<Entry[]> m_entries;
+    uint64_t m_mask;
+
+    static uint64_t key(z_hash_t hash, int depth)
+    {
+        return hash ^ (depth * 0x9e3779b97f4a7c15ULL);
+    }
+
+public:
+    // rounded down to a power of two entries
+    PerftTable(size_t size_mb);
+
+    bool probe(z_hash_t hash, int depth, uint64_t *nodes);
+    void store(z_hash_t hash, int depth, uint64_t nodes);
+
+    size_t size()
+    {
+        return m_mask + 1;
+    }
+};
+
+struct PerftResult
+{
+    uint64_t m_nodes = 0;
+    uint64_t m_table_hits = 0;
+    int m_threads = 1;
+    std::chrono::nanoseconds m_time = std::chrono::nanoseconds(0);
+
+    // leaf nodes below every root move, in move generation order
+    std::vector<std::pair<MoveKey, uint64_t>> m_divide;
+
+    double nodes_per_second()
+    {
+        return m_time.count() ? m_nodes * 1e9 / m_time.count() : 0;
+    }
+};
+
+// Leaf nodes of the legal move tree of the given depth. The table is optional.
+uint64_t perft(std::shared_ptr<Position> position, int depth, PerftTable *table);
+
+PerftResult parallel_perft(std::shared_ptr<Position> position, int depth, ThreadPool &thread_pool, PerftTable *table);
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "util.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+/*
+    Bookkeeping for the PGN files that have already been ingested into a tablebase.
+    The record for a file holds the number of bytes that were processed, the mtime of
+    the file at that point, and a checksum of those bytes. This lets an update pass
+    tell apart files that are unchanged, files that have only been appended to (only
+    the new tail needs processing), and files that were rewritten.
+*/
+struct PgnFileRecord
+{
+    uintmax_t m_size;
+    int64_t m_mtime;
+    uint64_t m_checksum;
+};
+
+enum class PgnFileStatus
+{
+    NEW,
+    UNCHANGED,
+    APPENDED,
+    REWRITTEN
+};
+
+class CompletedFiles
+{
+    std::unordered_map<std::string, PgnFileRecord> m_records;
+    std::mutex m_mutex;
+
+public:
+    void read_from_file(fs::path file_path);
+    void serialize(fs::path file_path);
+
+    PgnFileStatus get_status(fs::path pgn_file_path);
+    uintmax_t get_completed_size(fs::path pgn_file_path);
+    void mark_completed(fs::path pgn_file_path, uintmax_t size);
+
+    size_t size()
+    {
+        return m_records.size();
+    }
+};
+
+PgnFileRecord make_pgn_file_record(fs::path pgn_file_path, uintmax_t size);
+uint64_t checksum_file_prefix(fs::path file_path, uintmax_t size);
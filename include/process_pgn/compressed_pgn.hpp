@@ -0,0 +1,81 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+/*
+    Streaming decoder for a compressed pgn file. read fills the buffer with the next
+    decompressed bytes and returns how many there were, 0 at the end of the file.
+    Throws std::runtime_error if the data is corrupt.
+*/
+class PgnDecompressor
+{
+public:
+    virtual ~PgnDecompressor(){};
+    virtual size_t read(char *buffer, size_t size) = 0;
+};
+
+// .pgn.gz, .pgn.bz2 and .pgn.zst files, whether or not this build can decode them.
+bool is_compressed_pgn(fs::path file_path);
+
+// NULL if the file can't be opened, or this build has no decoder for its format.
+std::unique_ptr<PgnDecompressor> open_pgn_decompressor(fs::path file_path);
+
+/*
+    Decompresses a pgn file on its own thread and splits the output into chunks of whole
+    games, about chunk_size bytes each, like split_pgn_into_chunks does for plain files.
+    The decoder stays at most max_queued_chunks ahead of the consumer, so a large archive
+    never has to fit in memory (or on disk) uncompressed.
+*/
+class CompressedPgnReader
+{
+    std::unique_ptr<PgnDecompressor> m_decompressor;
+    fs::path m_file_path;
+    size_t m_chunk_size;
+    size_t m_max_queued_chunks;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::queue<std::string> m_chunks;
+    bool m_finished = false;
+    bool m_stopped = false;
+    bool m_failed = false;
+    uintmax_t m_decompressed_size = 0;
+    std::chrono::nanoseconds m_decompression_time = std::chrono::nanoseconds(0);
+    std::thread m_thread;
+
+    void decode();
+    bool push_chunk(std::string chunk);
+
+public:
+    CompressedPgnReader(fs::path file_path, size_t chunk_size, size_t max_queued_chunks);
+    ~CompressedPgnReader();
+
+    CompressedPgnReader(const CompressedPgnReader &) = delete;
+    CompressedPgnReader &operator=(const CompressedPgnReader &) = delete;
+
+    bool is_open() const
+    {
+        return m_decompressor != NULL;
+    }
+
+    // blocks until the next chunk is decoded, false once the file is done
+    bool next_chunk(std::string *chunk);
+
+    uintmax_t decompressed_size();
+
+    // true if the file is corrupt or truncated, and the games after the bad data weren't read
+    bool failed();
+
+    // time spent in the decompressor so far
+    std::chrono::nanoseconds decompression_time();
+};
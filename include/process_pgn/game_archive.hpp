@@ -0,0 +1,84 @@
+#pragma once
+
+#include "process_pgn/game_filter.hpp"
+#include "process_pgn/pgn_game.hpp"
+#include "tablebase/tablebase.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/*
+    Game archive layout (.mga), the games of pgn files with their moves already decoded, so
+    that tablebases can be rebuilt without parsing SAN again.
+
+    header
+        4 bytes  -> magic "MTGA"
+        1 byte   -> format version
+
+    games, until the end of the file
+        1 byte   -> GameResult
+        varint   -> white elo
+        varint   -> black elo
+        strings, each a varint length and its bytes:
+                    event, date, time control, white player, black player
+        varint   -> number of plies
+        per ply
+            2 bytes  -> packed move key (see pack_move_key_16)
+
+    Games are only ever appended, so archives can be concatenated after dropping the header
+    of the second one.
+*/
+
+const char GAME_ARCHIVE_MAGIC[4] = {'M', 'T', 'G', 'A'};
+const uint8_t GAME_ARCHIVE_VERSION = 1;
+const std::string game_archive_extension = ".mga";
+
+void write_archived_game(std::vector<uint8_t> *buffer, const PgnGame &game);
+
+/*
+    Appends encoded games to an archive file. Parser threads encode their games into a
+    buffer of their own, and only take the lock to append the whole buffer.
+*/
+class GameArchiveWriter
+{
+    std::ofstream m_stream;
+    std::mutex m_mutex;
+    int m_games = 0;
+
+public:
+    // keeps the games already in the file if append is set
+    GameArchiveWriter(fs::path file_path, bool append);
+
+    bool is_open() const
+    {
+        return m_stream.is_open();
+    }
+
+    void append(const std::vector<uint8_t> &buffer, int games);
+
+    int get_games()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_games;
+    }
+};
+
+struct ArchiveReplayStats
+{
+    int m_games = 0;
+    int m_filtered_games = 0;
+    long m_plies = 0;
+};
+
+/*
+    Adds the games of an archive to the tablebase, up to max_plies like PgnGame::read_move,
+    skipping the games the filter (if any) rejects. Pgn strings of new move edges are left
+    empty, call Tablebase::restore_move_edges once all archives are replayed.
+*/
+ArchiveReplayStats replay_game_archive(fs::path file_path, Tablebase *tablebase, int max_plies,
+                                       const PgnGameFilter *filter);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "process_pgn/pgn_game.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+const int GAME_DEDUPLICATOR_SHARD_COUNT = 64;
+
+/*
+    Identity of a game across pgn collections: the White, Black, Date and Round tags,
+    the result, and all of the game's moves. The game has to be read with its moves past
+    max plies decoded (see PgnGame::read_move), so that the identity doesn't depend on
+    max plies and the hashes of earlier runs still match. The Event tag isn't part of it,
+    collections disagree on how to name the same event.
+*/
+uint64_t game_identity_hash(const PgnGame &game, const std::string &result);
+
+/*
+    Set of the games seen so far, shared by all parser threads. Sharded by hash like
+    the tablebase, so that threads rarely wait on each other.
+*/
+class GameDeduplicator
+{
+    std::unordered_set<uint64_t> m_shards[GAME_DEDUPLICATOR_SHARD_COUNT];
+    std::mutex m_mutexes[GAME_DEDUPLICATOR_SHARD_COUNT];
+
+public:
+    // false if the game was already seen
+    bool insert(uint64_t game_hash);
+
+    size_t size();
+
+    // one little endian uint64_t per game, so an update run knows the games of earlier runs
+    void read_from_file(fs::path file_path);
+    void serialize(fs::path file_path);
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "process_pgn/pgn_game.hpp"
+#include <regex>
+#include <set>
+#include <string>
+
+/*
+    Criteria on the tag section of a game, checked before any of its moves are decoded,
+    so that unwanted games cost no more than reading their tags. A criterion that is
+    left at its default accepts every game.
+        min elo           both players must be rated at least this much
+        min time control  estimated game duration in seconds (base + 40 * increment),
+                          games without a TimeControl tag are kept
+        date range        inclusive, YYYY.MM.DD, unknown parts of a date ("2019.??.??")
+                          match if any date they could stand for is in range
+        results           the Result tag must be one of these
+        event pattern     regular expression that must match somewhere in the Event tag
+*/
+struct PgnGameFilter
+{
+    int m_min_elo = 0;
+    int m_min_time_control = 0;
+    std::string m_min_date;
+    std::string m_max_date;
+    std::set<std::string> m_results;
+    std::string m_event_pattern;
+    std::regex m_event_regex;
+
+    void set_event_pattern(std::string pattern);
+
+    // key=value form used on the command line, returns false for an unknown key
+    bool set_option(std::string key, std::string value);
+
+    bool is_active() const;
+    bool accepts(const PgnGame &game) const;
+};
+
+int parse_time_control(std::string time_control);
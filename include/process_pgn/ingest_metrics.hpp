@@ -0,0 +1,45 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/*
+    Counters and stage timings of a pgn ingestion run. Every parser fills in its own
+    and they are merged once its chunk is done, so no shared state is touched per move.
+
+    Stage times are summed over all threads, so with several threads they add up to more
+    than the wall time. They split up as:
+        read    mapping plain files, and decompressing compressed ones (on the decoder
+                threads). Page faults while parsing mapped files count as parse time.
+        parse   tokenizing the pgn and decoding SAN moves, i.e. everything else in a chunk
+        hash    zobrist hashes of the positions before and after every move
+        insert  Tablebase::update, including waiting for the shard locks
+
+    The heap allocations of the whole run, on all threads, are only known when the allocation
+    hook is linked in (see alloc_stats.hpp), and are left out of the JSON otherwise.
+*/
+struct PgnIngestMetrics
+{
+    uintmax_t m_bytes = 0;
+    uintmax_t m_compressed_bytes = 0;
+    long m_games = 0;
+    long m_rejected_games = 0;
+    long m_filtered_games = 0;
+    long m_duplicate_games = 0;
+    long m_plies = 0;
+
+    std::chrono::nanoseconds m_read_time = std::chrono::nanoseconds(0);
+    std::chrono::nanoseconds m_parse_time = std::chrono::nanoseconds(0);
+    std::chrono::nanoseconds m_hash_time = std::chrono::nanoseconds(0);
+    std::chrono::nanoseconds m_insert_time = std::chrono::nanoseconds(0);
+
+    bool m_allocations_counted = false;
+    uint64_t m_allocations = 0;
+    uint64_t m_allocated_bytes = 0;
+
+    void merge(const PgnIngestMetrics &other);
+
+    // one line JSON object, with throughput over the given wall time
+    std::string to_json(std::chrono::nanoseconds wall_time, unsigned threads) const;
+};
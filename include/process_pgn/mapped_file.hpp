@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/*
+    Read-only memory mapping of a whole file. The pgn parser works on string_views into
+    the mapping, so the file contents are never copied into std::strings.
+*/
+class MappedFile
+{
+    int m_fd = -1;
+    const char *m_data = NULL;
+    size_t m_size = 0;
+
+public:
+    MappedFile(fs::path file_path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool is_open() const
+    {
+        return m_fd >= 0;
+    }
+
+    std::string_view view() const
+    {
+        return std::string_view(m_data, m_size);
+    }
+};
+
+size_t find_pgn_game_boundary(std::string_view data, size_t from);
+std::vector<std::string_view> split_pgn_into_chunks(std::string_view data, size_t target_chunk_size);
@@ -2,6 +2,8 @@
 
 #include <iostream>
 #include <fstream>
+#include <string_view>
+#include "process_pgn/ingest_metrics.hpp"
 #include "representation/position.hpp"
 #include "tablebase/tablebase.hpp"
 
@@ -11,6 +13,15 @@ struct metadata_entry
     std::string value;
 };
 
+// A move that has been parsed, but not yet added to the tablebase.
+struct PendingTablebaseUpdate
+{
+    z_hash_t m_insert_hash;
+    z_hash_t m_dest_hash;
+    MoveKey m_move_key;
+    std::string m_pgn_move;
+};
+
 struct PgnGame
 {
 
@@ -22,14 +33,26 @@ struct PgnGame
     bool m_finishedReading;
     std::string m_result;
     std::string m_event;
+    std::string m_date;
+    std::string m_time_control;
     std::string m_white_player_name;
     std::string m_black_player_name;
     std::vector<uint32_t> m_move_list;
+    // a move after max_plies didn't decode, m_move_list ends before it
+    bool m_move_list_cut_off = false;
+    // Moves are only added to the tablebase once the result of the game is known,
+    // so that every move edge can be credited with the game's score.
+    std::vector<PendingTablebaseUpdate> m_pending_updates;
+    // hash and insert timings go here, if set
+    PgnIngestMetrics *m_metrics = NULL;
 
-    bool read_metadata_line(std::string &line);
-    void process_player_move(std::string player_move, bool whites_turn, Tablebase *masterTablebase);
-    void process_result(std::string resultstr);
-    bool read_game_move_line(std::string &line, Tablebase *masterTablebase, int max_plies);
+    bool read_metadata_line(std::string_view line);
+    void process_player_move(std::string_view player_move);
+    MoveKey play_move(std::string_view player_move);
+    void process_result(std::string resultstr, Tablebase *tablebase);
+    void commit_pending_updates(Tablebase *tablebase);
+    void read_move(std::string_view player_move, int max_plies);
+    void read_move(std::string_view player_move, int max_plies, bool decode_remaining_moves);
     void populateMetadata();
     void printGameSummary();
 
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "process_pgn/game_archive.hpp"
+#include "process_pgn/game_deduplicator.hpp"
+#include "process_pgn/game_filter.hpp"
+#include "process_pgn/pgn_game.hpp"
+#include "tablebase/tablebase.hpp"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct PgnParseStats
+{
+    int m_games = 0;
+    int m_rejected_games = 0;
+    int m_filtered_games = 0;
+    int m_duplicate_games = 0;
+};
+
+/*
+    Streaming reader for pgn data, independent of line breaks inside the movetext.
+    Besides tag pairs, moves and results, it understands the parts of the pgn standard
+    that carry no moves of the game itself, and skips them:
+        {brace comments} and ; rest of line comments
+        (recursive (variations)), which can hold comments of their own
+        $n numeric annotation glyphs, and !/? suffixes on moves
+        move numbers, including 12... before a black move
+        % escape lines
+    A game that can't be read (a move that isn't SAN or isn't legal) is dropped as a
+    whole and counted as rejected, and reading continues with the next game.
+    A game whose tags don't pass the filter is skipped the same way, before any of its
+    moves are decoded, and counted as filtered.
+    With an archive set, every game that is read is also written to it with all of its
+    moves, not just the ones within max_plies.
+    With a deduplicator set, a game that was already seen (in this or any other chunk) is
+    dropped when it ends, before any of its moves reach the tablebase. Its moves past
+    max_plies are decoded as well, they are part of the game's identity.
+*/
+class PgnParser
+{
+    enum State
+    {
+        TAGS,
+        MOVETEXT,
+        SKIPPING_GAME
+    };
+
+    Tablebase *m_tablebase;
+    int m_max_plies;
+    std::string m_file_path;
+    const PgnGameFilter *m_filter;
+    GameArchiveWriter *m_archive = NULL;
+    GameDeduplicator *m_deduplicator = NULL;
+    std::vector<uint8_t> m_archive_buffer;
+    int m_archive_buffer_games = 0;
+    PgnIngestMetrics m_metrics;
+
+    State m_state;
+    std::unique_ptr<PgnGame> m_game;
+    PgnParseStats m_stats;
+
+    void start_game();
+    void finish_game(std::string result);
+    void end_game_without_result();
+    void archive_game();
+    bool is_duplicate_game(const std::string &result);
+    void reject_game(const std::exception &e);
+    void read_tags();
+    void read_movetext_token(std::string_view token);
+
+public:
+    PgnParser(Tablebase *tablebase, int max_plies, std::string file_path);
+    PgnParser(Tablebase *tablebase, int max_plies, std::string file_path, const PgnGameFilter *filter);
+
+    void set_archive(GameArchiveWriter *archive)
+    {
+        m_archive = archive;
+    }
+
+    void set_deduplicator(GameDeduplicator *deduplicator)
+    {
+        m_deduplicator = deduplicator;
+    }
+
+    PgnParseStats parse(std::string_view data);
+
+    // bytes, games, plies and parse/hash/insert times of everything parsed so far
+    const PgnIngestMetrics &get_metrics() const
+    {
+        return m_metrics;
+    }
+};
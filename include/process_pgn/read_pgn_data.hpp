@@ -1,19 +1,48 @@
 #pragma once
 
+#include "alloc_stats.hpp"
 #include "move_generation.hpp"
 #include "representation/position.hpp"
 #include "threadpool/threadpool.hpp"
 #include "util.hpp"
 #include "pgn_game.hpp"
+#include "process_pgn/completed_files.hpp"
+#include "process_pgn/compressed_pgn.hpp"
+#include "process_pgn/game_archive.hpp"
+#include "process_pgn/game_deduplicator.hpp"
+#include "process_pgn/game_filter.hpp"
+#include "process_pgn/ingest_metrics.hpp"
+#include "process_pgn/mapped_file.hpp"
+#include "process_pgn/pgn_parser.hpp"
 #include "tablebase/tablebase.hpp"
 #include <filesystem>
 #include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
 #include <set>
+#include <string_view>
 #include <thread>
 #include <boost/algorithm/string.hpp>
 
 #define ELO_THRESHOLD 2200
 
+// pgn files are parsed in chunks of about this many bytes, so that a single large file
+// is spread over all the threads
+const size_t PGN_CHUNK_SIZE = 8 << 20;
+
+// Chunks get smaller when there is little data per thread, so that every thread gets about
+// this many tasks and the threads finish at about the same time, but not smaller than
+// PGN_MIN_CHUNK_SIZE, below which the per task overhead starts to show.
+const size_t PGN_TASKS_PER_THREAD = 4;
+const size_t PGN_MIN_CHUNK_SIZE = 256 << 10;
+
+// decompressed chunks that may be waiting to be parsed, per thread, bounding the memory
+// a compressed pgn file takes while it is processed
+const size_t PGN_DECOMPRESSED_CHUNKS_PER_THREAD = 2;
+
 const bool debug_disabled = true;
 #define debugStream     \
     if (debug_disabled) \
@@ -24,34 +53,79 @@ const bool debug_disabled = true;
 
 namespace fs = std::filesystem;
 
-const std::string result_regex_str =
-    R"((((?:1\/2|1|0)\s*\-\s*(?:1\/2|1|0)\s*$)|\*)?)";
-const std::regex game_line_regex(
-    R"(\d+\.\s*([\w\-\+\#\=]+)\s([\w\-\+\#\=]+)?\s*)" + result_regex_str);
-const std::string metadata_line_regex =
-    "^\\s*\\[(\\w+)\\s\"(.*?)\"\\]\\s*$";
-const std::string non_castling_move_regex =
-    "([RNBKQ])?([a-h])?([1-8])?(x)?([a-h])"
-    "([1-8])(=[RNBKQ])?([\\+\\#])?";
-const std::string castling_move_regex = "((O-O-O)|(O-O))([\\+\\#])?";
 
 std::shared_ptr<Tablebase> create_tablebases_from_pgn_data(std::string tablebase_name);
+std::shared_ptr<Tablebase> create_tablebases_from_pgn_data(std::string tablebase_name, bool compressed);
+std::shared_ptr<Tablebase> create_tablebases_from_pgn_data(
+    std::string tablebase_name, bool compressed, const PgnGameFilter &filter, std::string archive_name,
+    bool deduplicate);
+std::shared_ptr<Tablebase> update_tablebases_from_pgn_data(std::string tablebase_name);
+std::shared_ptr<Tablebase> update_tablebases_from_pgn_data(
+    std::string tablebase_name, const PgnGameFilter &filter, std::string archive_name, bool deduplicate);
+std::shared_ptr<Tablebase> create_tablebases_from_game_archive(
+    std::string tablebase_name, std::string archive_name, bool compressed, int max_plies, const PgnGameFilter &filter);
 
 void print_pgn_processing_performance_summary(
-    std::__1::chrono::steady_clock::time_point clock_start,
-    std::__1::chrono::steady_clock::time_point clock_end,
+    std::chrono::steady_clock::time_point clock_start,
+    std::chrono::steady_clock::time_point clock_end,
     std::thread::id thread_id,
     int games_list_size,
     int tablebase_size,
     std::string file_path);
 void print_pgn_processing_header();
 
+size_t balanced_pgn_chunk_size(uintmax_t total_size, size_t max_chunk_size, unsigned threads);
+
+// What one thread of the pool did during process_pgn_files.
+struct PgnWorkerStats
+{
+    std::thread::id m_thread_id;
+    int m_chunks = 0;
+    int m_games = 0;
+    uintmax_t m_bytes = 0;
+    std::chrono::nanoseconds m_busy_time = std::chrono::nanoseconds(0);
+};
+
+void print_pgn_worker_utilization(const std::vector<PgnWorkerStats> &worker_stats,
+                                  std::chrono::nanoseconds processing_time, unsigned threads);
+
+struct PgnUpdateSummary
+{
+    int new_files = 0;
+    int appended_files = 0;
+    int unchanged_files = 0;
+    int rewritten_files = 0;
+};
+
 class PgnProcessor
 {
     std::shared_ptr<Tablebase> m_tablebase;
     fs::path m_tablebase_destination_file_path;
     fs::path m_pgn_database_path;
     int m_max_plies;
+    bool m_compressed;
+    size_t m_chunk_size;
+    std::atomic<int> m_rejected_games;
+    std::atomic<int> m_filtered_games;
+    std::atomic<int> m_duplicate_games;
+    PgnGameFilter m_filter;
+    std::unique_ptr<GameArchiveWriter> m_archive;
+    std::unique_ptr<GameDeduplicator> m_deduplicator;
+    CompletedFiles m_completed_files;
+
+    std::mutex m_worker_stats_mutex;
+    std::map<std::thread::id, PgnWorkerStats> m_worker_stats;
+    std::chrono::nanoseconds m_processing_time;
+    unsigned m_threads;
+
+    std::mutex m_metrics_mutex;
+    PgnIngestMetrics m_metrics;
+
+    void add_metrics(const PgnIngestMetrics &metrics)
+    {
+        std::unique_lock<std::mutex> lock(m_metrics_mutex);
+        m_metrics.merge(metrics);
+    }
 
 public:
     PgnProcessor(std::string tablebase_destination_file_path, std::string pgn_database_path)
@@ -59,6 +133,13 @@ public:
     {
         m_tablebase = std::make_shared<Tablebase>();
         m_max_plies = 15;
+        m_compressed = false;
+        m_chunk_size = PGN_CHUNK_SIZE;
+        m_rejected_games = 0;
+        m_filtered_games = 0;
+        m_duplicate_games = 0;
+        m_processing_time = std::chrono::nanoseconds(0);
+        m_threads = shared_thread_pool().size();
     }
 
     std::shared_ptr<Tablebase> get_tablebase()
@@ -66,17 +147,138 @@ public:
         return m_tablebase;
     }
 
+    // games that were skipped because they couldn't be read
+    int get_rejected_games()
+    {
+        return m_rejected_games;
+    }
+
+    // per thread statistics of the last call to process_pgn_files, busiest thread first
+    std::vector<PgnWorkerStats> get_worker_stats()
+    {
+        std::unique_lock<std::mutex> lock(m_worker_stats_mutex);
+        std::vector<PgnWorkerStats> worker_stats;
+        for (auto it = m_worker_stats.begin(); it != m_worker_stats.end(); it++)
+        {
+            worker_stats.push_back(it->second);
+        }
+        std::sort(worker_stats.begin(), worker_stats.end(),
+                  [](const PgnWorkerStats &a, const PgnWorkerStats &b)
+                  { return a.m_busy_time > b.m_busy_time; });
+        return worker_stats;
+    }
+
+    // wall time of the last call to process_pgn_files
+    std::chrono::nanoseconds get_processing_time()
+    {
+        return m_processing_time;
+    }
+
+    unsigned get_threads()
+    {
+        return m_threads;
+    }
+
+    // totals since the start of the last process_pgn_files
+    PgnIngestMetrics get_metrics()
+    {
+        std::unique_lock<std::mutex> lock(m_metrics_mutex);
+        return m_metrics;
+    }
+
+    // games that were skipped because their tags didn't pass the filter
+    int get_filtered_games()
+    {
+        return m_filtered_games;
+    }
+
+    // games that were skipped because an identical game had already been read
+    int get_duplicate_games()
+    {
+        return m_duplicate_games;
+    }
+
+    // drop games that were already read, from this or an earlier run, see GameDeduplicator
+    void set_deduplicate(bool deduplicate)
+    {
+        if (!deduplicate)
+        {
+            m_deduplicator = NULL;
+        }
+        else if (!m_deduplicator)
+        {
+            m_deduplicator = std::make_unique<GameDeduplicator>();
+        }
+    }
+
+    void set_filter(const PgnGameFilter &filter)
+    {
+        m_filter = filter;
+    }
+
+    // also write every game that is read to a game archive, see game_archive.hpp
+    void set_archive(fs::path archive_file_path, bool append)
+    {
+        m_archive = std::make_unique<GameArchiveWriter>(archive_file_path, append);
+        if (!m_archive->is_open())
+        {
+            m_archive = NULL;
+        }
+    }
+
+    int get_archived_games()
+    {
+        return m_archive ? m_archive->get_games() : 0;
+    }
+
+    /*
+        Adds the games of a game archive to the tablebase, with the processor's max plies and
+        filter. No SAN is parsed, the pgn strings of the move edges are restored from the
+        moves afterwards.
+    */
+    ArchiveReplayStats process_game_archive(fs::path archive_file_path)
+    {
+        ArchiveReplayStats stats = replay_game_archive(
+            archive_file_path, m_tablebase.get(), m_max_plies, m_filter.is_active() ? &m_filter : NULL);
+        m_filtered_games += stats.m_filtered_games;
+        m_tablebase->restore_move_edges();
+        return stats;
+    }
+
     void set_max_plies(int plies)
     {
         m_max_plies = plies;
     }
 
+    // Threads used by process_pgn_files. The shared thread pool is used if it has that many threads.
+    void set_threads(unsigned threads)
+    {
+        m_threads = std::max(1u, threads);
+    }
+
+    void set_chunk_size(size_t chunk_size)
+    {
+        m_chunk_size = chunk_size;
+    }
+
+    // write the tablebase as compressed (.tbc) shards instead of .tb shards
+    void set_compressed(bool compressed)
+    {
+        m_compressed = compressed;
+    }
+
     std::shared_ptr<Tablebase> serialize_all()
     {
         auto clock_start = std::chrono::high_resolution_clock::now();
         debugStream << ColorCode::yellow << "Serializing tablebases..." << ColorCode::end << std::endl;
 
-        m_tablebase->serialize_all(m_tablebase_destination_file_path);
+        m_tablebase->serialize_all(m_tablebase_destination_file_path, m_compressed);
+        m_completed_files.serialize(m_tablebase_destination_file_path / completed_files_filename);
+        serialize_metrics(m_tablebase_destination_file_path / ingest_metrics_filename);
+        if (m_deduplicator)
+        {
+            m_deduplicator->serialize(m_tablebase_destination_file_path / game_hashes_filename);
+        }
 
         auto clock_end = std::chrono::high_resolution_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(clock_end - clock_start);
@@ -86,31 +288,249 @@ public:
         return m_tablebase;
     }
 
+    // the JSON summary of the last process_pgn_files, if any pgn data was read
+    void serialize_metrics(fs::path file_path)
+    {
+        PgnIngestMetrics metrics = get_metrics();
+        if (metrics.m_bytes == 0)
+        {
+            return;
+        }
+        std::ofstream stream(file_path, std::ios::out | std::ios::trunc);
+        stream << metrics.to_json(m_processing_time, m_threads) << std::endl;
+    }
+
     void process_pgn_files()
+    {
+        std::vector<std::pair<fs::path, uintmax_t>> files;
+        for (const auto &entry : std::filesystem::directory_iterator(m_pgn_database_path))
+        {
+            files.push_back(std::make_pair(entry.path(), 0));
+        }
+        process_pgn_files(files);
+    }
+
+    /*
+        Loads the tablebase and the list of completed files from the destination directory (if
+        present), and only processes pgn files that are new or have been appended to since they
+        were last processed. The counts from those files are merged into the existing shards.
+        A file whose already-processed contents changed cannot be merged without double counting,
+        so it is skipped and reported; rebuild the tablebase from scratch to pick it up.
+        Throws std::runtime_error if a shard of the existing tablebase can't be read.
+    */
+    PgnUpdateSummary process_new_pgn_files()
+    {
+        PgnUpdateSummary summary;
+
+        if (fs::is_directory(m_tablebase_destination_file_path))
+        {
+            m_tablebase->read_from_directory(m_tablebase_destination_file_path);
+            m_completed_files.read_from_file(m_tablebase_destination_file_path / completed_files_filename);
+
+            // keep writing the tablebase in the format it was read in
+            for (const auto &entry : std::filesystem::directory_iterator(m_tablebase_destination_file_path))
+            {
+                m_compressed |= entry.path().extension() == ".tbc";
+            }
+
+            // and keep dropping duplicates, including those of games read in earlier runs
+            if (fs::exists(m_tablebase_destination_file_path / game_hashes_filename))
+            {
+                set_deduplicate(true);
+            }
+            if (m_deduplicator)
+            {
+                m_deduplicator->read_from_file(m_tablebase_destination_file_path / game_hashes_filename);
+            }
+        }
+
+        std::vector<std::pair<fs::path, uintmax_t>> files;
+        for (const auto &entry : std::filesystem::directory_iterator(m_pgn_database_path))
+        {
+            switch (m_completed_files.get_status(entry.path()))
+            {
+            case PgnFileStatus::NEW:
+                summary.new_files++;
+                files.push_back(std::make_pair(entry.path(), 0));
+                break;
+            case PgnFileStatus::APPENDED:
+                // the offset into the decompressed data of an appended archive isn't known
+                if (is_compressed_pgn(entry.path()))
+                {
+                    summary.rewritten_files++;
+                    std::cerr << ColorCode::red << "Compressed pgn file " << entry.path()
+                              << " has changed, skipping it. Rebuild the tablebase to include it." << ColorCode::end << std::endl;
+                    break;
+                }
+                summary.appended_files++;
+                files.push_back(std::make_pair(entry.path(), m_completed_files.get_completed_size(entry.path())));
+                break;
+            case PgnFileStatus::UNCHANGED:
+                summary.unchanged_files++;
+                break;
+            case PgnFileStatus::REWRITTEN:
+                summary.rewritten_files++;
+                std::cerr << ColorCode::red << "Previously processed contents of " << entry.path()
+                          << " have changed, skipping it. Rebuild the tablebase to include it." << ColorCode::end << std::endl;
+                break;
+            }
+        }
+        process_pgn_files(files);
+
+        return summary;
+    }
+
+    /*
+        Each element is a pgn file path and the byte offset to start processing it from.
+        Plain files are memory mapped and split into chunks of whole games, and every chunk
+        is parsed as its own task, so large files are processed by several threads. The
+        largest chunks are queued first, so that the last tasks to start are short ones and
+        no thread is left with a big file while the others are idle.
+        Compressed files (see is_compressed_pgn) are decompressed one after the other, each on
+        a thread of its own that stays ahead of the parsing tasks for its chunks.
+    */
+    void process_pgn_files(std::vector<std::pair<fs::path, uintmax_t>> files)
     {
         auto clock_start = std::chrono::high_resolution_clock::now();
+        AllocationCounts allocations_start = allocation_counts();
         debugStream << std::endl
                     << ColorCode::yellow << "Starting PGN processing..." << ColorCode::end << std::endl;
 
-        ThreadPool thread_pool = ThreadPool();
         print_pgn_processing_header();
+        {
+            std::unique_lock<std::mutex> lock(m_worker_stats_mutex);
+            m_worker_stats.clear();
+        }
+        {
+            std::unique_lock<std::mutex> lock(m_metrics_mutex);
+            m_metrics = PgnIngestMetrics();
+        }
 
-        std::function<void(std::string &)> process_pgn_file_bound_fn =
-            std::bind(&PgnProcessor::process_pgn_file, this, std::placeholders::_1);
+        // the chunks point into the mappings, so they stay mapped until every task is done
+        std::vector<std::unique_ptr<MappedFile>> mapped_files(files.size());
+        std::vector<std::string_view> file_data(files.size());
+        uintmax_t total_size = 0;
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            if (is_compressed_pgn(files[i].first))
+            {
+                continue;
+            }
 
-        for (const auto &entry : std::filesystem::directory_iterator(m_pgn_database_path))
+            PgnIngestMetrics read_metrics;
+            auto read_start = std::chrono::steady_clock::now();
+            mapped_files[i] = std::make_unique<MappedFile>(files[i].first);
+            read_metrics.m_read_time = std::chrono::steady_clock::now() - read_start;
+            add_metrics(read_metrics);
+            if (!mapped_files[i]->is_open())
+            {
+                debugStream << "Could not open " << files[i].first << std::endl;
+                continue;
+            }
+
+            file_data[i] = mapped_files[i]->view();
+            file_data[i].remove_prefix(std::min<uintmax_t>(files[i].second, file_data[i].size()));
+            total_size += file_data[i].size();
+        }
+
+        size_t chunk_size = balanced_pgn_chunk_size(total_size, m_chunk_size, m_threads);
+        std::vector<std::pair<std::string_view, fs::path>> chunks;
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            for (std::string_view chunk : split_pgn_into_chunks(file_data[i], chunk_size))
+            {
+                chunks.push_back(std::make_pair(chunk, files[i].first));
+            }
+        }
+        std::stable_sort(chunks.begin(), chunks.end(),
+                         [](const std::pair<std::string_view, fs::path> &a, const std::pair<std::string_view, fs::path> &b)
+                         { return a.first.size() > b.first.size(); });
+
+        std::unique_ptr<ThreadPool> own_thread_pool;
+        if (shared_thread_pool().size() != (int)m_threads)
         {
-            std::string filepath = entry.path().generic_string();
-            size_t path_end = filepath.rfind('/');
-            size_t extension_start = filepath.rfind(".pgn");
-            std::string filename = filepath.substr(path_end + 1, extension_start - path_end - 1);
+            own_thread_pool = std::make_unique<ThreadPool>(m_threads);
+        }
+        WaitGroup pgn_tasks(own_thread_pool ? *own_thread_pool : shared_thread_pool());
 
-            Task task = Task(&process_pgn_file_bound_fn, entry.path());
-            thread_pool.add_task(task);
+        std::vector<std::function<void()>> chunk_tasks;
+        chunk_tasks.reserve(chunks.size());
+        for (size_t i = 0; i < chunks.size(); i++)
+        {
+            std::string_view chunk = chunks[i].first;
+            std::string path = chunks[i].second;
+            chunk_tasks.push_back([this, chunk, path]()
+                                  { process_pgn_chunk(chunk, path); });
+        }
+        pgn_tasks.submit_batch(std::move(chunk_tasks));
+
+        // Decompressed chunks are owned by their task and freed once parsed. No more of them
+        // are handed to the pool than it can work on soon, so that decompression waits for
+        // parsing instead of filling up memory.
+        std::mutex in_flight_mutex;
+        std::condition_variable in_flight_cv;
+        size_t in_flight = 0;
+        size_t max_in_flight = PGN_DECOMPRESSED_CHUNKS_PER_THREAD * m_threads;
+        std::vector<bool> compressed_file_read(files.size(), false);
+
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            if (!is_compressed_pgn(files[i].first))
+            {
+                continue;
+            }
+
+            CompressedPgnReader reader(files[i].first, m_chunk_size, PGN_DECOMPRESSED_CHUNKS_PER_THREAD);
+            std::string chunk;
+            while (reader.next_chunk(&chunk))
+            {
+                {
+                    std::unique_lock<std::mutex> lock(in_flight_mutex);
+                    in_flight_cv.wait(lock, [&]
+                                      { return in_flight < max_in_flight; });
+                    in_flight++;
+                }
+
+                pgn_tasks.submit(
+                    [this, owned_chunk = std::move(chunk), path = files[i].first.string(),
+                     &in_flight_mutex, &in_flight_cv, &in_flight]() mutable
+                    {
+                        process_pgn_chunk(owned_chunk, path);
+                        std::string().swap(owned_chunk);
+
+                        std::unique_lock<std::mutex> lock(in_flight_mutex);
+                        in_flight--;
+                        in_flight_cv.notify_one();
+                    });
+            }
+            // a file that couldn't be read to the end is tried again by the next update
+            compressed_file_read[i] = reader.is_open() && !reader.failed();
+            add_compressed_read_metrics(files[i].first, reader);
+        }
+        pgn_tasks.wait();
+
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            if (compressed_file_read[i])
+            {
+                m_completed_files.mark_completed(files[i].first, fs::file_size(files[i].first));
+            }
+            else if (mapped_files[i] && mapped_files[i]->is_open())
+            {
+                m_completed_files.mark_completed(files[i].first, mapped_files[i]->view().size());
+            }
         }
-        thread_pool.join_pool();
 
         auto clock_end = std::chrono::high_resolution_clock::now();
+        m_processing_time = clock_end - clock_start;
+        if (allocation_counting_enabled())
+        {
+            AllocationCounts allocations = allocation_counts() - allocations_start;
+            std::unique_lock<std::mutex> lock(m_metrics_mutex);
+            m_metrics.m_allocations_counted = true;
+            m_metrics.m_allocations = allocations.m_allocations;
+            m_metrics.m_allocated_bytes = allocations.m_bytes;
+        }
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(clock_end - clock_start);
         debugStream << ColorCode::green << "ThreadPool has completed pgn processing tasks. " << ColorCode::end
                     << "Elapsed time: " << duration.count() << " milliseconds." << std::endl;
@@ -118,57 +538,78 @@ public:
 
     void process_pgn_file(std::string file_path)
     {
-        auto clock_start = std::chrono::high_resolution_clock::now();
-        std::ifstream infile(file_path);
-        std::shared_ptr<std::vector<std::shared_ptr<PgnGame>>> games =
-            std::make_shared<std::vector<std::shared_ptr<PgnGame>>>();
+        process_pgn_file(file_path, 0);
+    }
 
-        games->emplace_back(std::make_shared<PgnGame>());
-        populate_starting_position(&(games->back()->m_position));
-        bool reading_game_moves = false;
-        int linecount = 0;
+    // Processes a single file on the calling thread. The offset is ignored for compressed files.
+    void process_pgn_file(std::string file_path, uintmax_t offset)
+    {
+        if (is_compressed_pgn(file_path))
+        {
+            CompressedPgnReader reader(file_path, m_chunk_size, PGN_DECOMPRESSED_CHUNKS_PER_THREAD);
+            std::string chunk;
+            while (reader.next_chunk(&chunk))
+            {
+                process_pgn_chunk(chunk, file_path);
+            }
+            add_compressed_read_metrics(file_path, reader);
+            return;
+        }
 
-        // TODO (put the pgn file reading code into its own function, read_pgn_file or something)
-        if (!infile.is_open())
+        PgnIngestMetrics read_metrics;
+        auto read_start = std::chrono::steady_clock::now();
+        MappedFile mapped_file(file_path);
+        read_metrics.m_read_time = std::chrono::steady_clock::now() - read_start;
+        add_metrics(read_metrics);
+        if (!mapped_file.is_open())
         {
             debugStream << "Could not open " << file_path << std::endl;
             return;
         }
-        for (std::string line; getline(infile, line);)
-        {
-            linecount++;
-            if (line.length() < 2)
-            {
-                continue;
-            }
 
-            // read the metadata until there are no more metadata lines left
-            if (!reading_game_moves && !games->back()->read_metadata_line(line))
-            {
-                reading_game_moves = true;
-            }
-
-            if (reading_game_moves)
-            {
-                bool is_game_line = games->back()->read_game_move_line(line, m_tablebase.get(), m_max_plies);
-                if (games->back()->m_finishedReading)
-                {
+        std::string_view data = mapped_file.view();
+        data.remove_prefix(std::min<uintmax_t>(offset, data.size()));
+        process_pgn_chunk(data, file_path);
+    }
 
-                    games->back()->populateMetadata();
-                    // push a new game to the back of the games vector
-                    games->emplace_back(std::make_shared<PgnGame>());
-                    populate_starting_position(&(games->back()->m_position));
-                    reading_game_moves = false;
-                }
-            }
+    void add_compressed_read_metrics(fs::path file_path, CompressedPgnReader &reader)
+    {
+        if (reader.is_open())
+        {
+            PgnIngestMetrics read_metrics;
+            read_metrics.m_compressed_bytes = fs::file_size(file_path);
+            read_metrics.m_read_time = reader.decompression_time();
+            add_metrics(read_metrics);
         }
-        // Remove the very last game, which is empty
-        games->pop_back();
+    }
+
+    // Parses whole games from a piece of a pgn file, see PgnParser.
+    void process_pgn_chunk(std::string_view chunk, std::string file_path)
+    {
+        auto clock_start = std::chrono::steady_clock::now();
+
+        PgnParser parser(m_tablebase.get(), m_max_plies, file_path, m_filter.is_active() ? &m_filter : NULL);
+        parser.set_archive(m_archive.get());
+        parser.set_deduplicator(m_deduplicator.get());
+        PgnParseStats stats = parser.parse(chunk);
+        m_rejected_games += stats.m_rejected_games;
+        m_filtered_games += stats.m_filtered_games;
+        m_duplicate_games += stats.m_duplicate_games;
+        add_metrics(parser.get_metrics());
 
         // print statistics about pgn processing
-        auto clock_end = std::chrono::high_resolution_clock::now();
+        auto clock_end = std::chrono::steady_clock::now();
+        {
+            std::unique_lock<std::mutex> lock(m_worker_stats_mutex);
+            PgnWorkerStats &worker_stats = m_worker_stats[std::this_thread::get_id()];
+            worker_stats.m_thread_id = std::this_thread::get_id();
+            worker_stats.m_chunks++;
+            worker_stats.m_games += stats.m_games;
+            worker_stats.m_bytes += chunk.size();
+            worker_stats.m_busy_time += clock_end - clock_start;
+        }
         print_pgn_processing_performance_summary(
             clock_start, clock_end, std::this_thread::get_id(),
-            games->size(), m_tablebase->total_size(), file_path);
+            stats.m_games, m_tablebase->total_size(), file_path);
     }
 };
\ No newline at end of file
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string_view>
+
+/*
+    The parts of a move in standard algebraic notation, as written in pgn files.
+    Characters that aren't present are 0, e.g. for "Nbd7":
+    m_piece = 'N', m_src_file = 'b', m_dest_file = 'd', m_dest_rank = '7'.
+*/
+struct SanMove
+{
+    bool m_castle = false;
+    bool m_long_castle = false;
+    char m_piece = 0;
+    char m_src_file = 0;
+    char m_src_rank = 0;
+    char m_capture = 0;
+    char m_dest_file = 0;
+    char m_dest_rank = 0;
+    char m_promotion = 0; // uppercase piece char, e.g. 'Q' for "e8=Q"
+    char m_check_or_mate = 0;
+};
+
+bool parse_san_move(std::string_view san, SanMove *move);
+bool parse_metadata_line(std::string_view line, std::string_view *key, std::string_view *value);
@@ -67,7 +67,7 @@ public:
   int m_plies;
   int m_moves;
   square_t m_en_passant_square = INVALID_SQUARE;
-  uint32_t castling_move(std::smatch &matches, bool white);
+  uint32_t castling_move(bool long_castle, bool white);
   uint32_t non_castling_move(
       char piece_char, char src_file, char src_rank, char capture,
       char dest_file, char dest_rank, char promotion_piece,
@@ -79,11 +79,6 @@ public:
   std::string pretty_string();
 
   square_t find_king(bool king_color);
-  uint16_t get_src_square_pawn_move(char capture, char src_file, square_t dest_square, uint8_t dest_rank);
-  square_t get_src_square_minmaj_piece_move(
-      char piece_char, uint8_t src_file, uint8_t src_rank,
-      square_t dest_square, square_t en_passant_square);
-  void assert_correct_player_turn(square_t src_square, square_t dest_square);
   bool is_king_in_check(bool white_king);
 
   PositionAdjustment advance_position(Move move);
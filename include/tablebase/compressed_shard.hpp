@@ -0,0 +1,139 @@
+#pragma once
+
+#include "tablebase/zobrist.hpp"
+#include "representation/move.hpp"
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+    Compressed shard layout (NNN.tbc). Integers are little endian, like the .tb format.
+
+    header
+        4 bytes  -> magic "MTBC"
+        1 byte   -> format version
+        1 byte   -> CompressedShardCodec used for the blocks
+        8 bytes  -> z_hash_t: hash of starting position
+        4 bytes  -> uint32_t: number of positions
+        4 bytes  -> uint32_t: number of blocks
+
+    block index, one entry per block, so that a single position can be looked up
+    by decoding only the block it lives in
+        8 bytes  -> z_hash_t: hash of the first position in the block
+        8 bytes  -> uint64_t: offset of the block, relative to the end of the index
+        4 bytes  -> uint32_t: stored (possibly compressed) size of the block
+        4 bytes  -> uint32_t: raw size of the block
+
+    blocks, positions sorted by hash
+        varint   -> difference to the previous hash in the block (the first hash is in the index)
+        varint   -> number of moves
+        per move
+            2 bytes  -> packed move key (see pack_move_key_16)
+            varint   -> times played
+            varint   -> times scored (games with a known result)
+            varint   -> half points white scored in those games
+
+    Destination hashes and pgn strings are not stored, they are recomputed from the
+    moves when the whole tablebase is loaded (see Tablebase::restore_move_edges).
+*/
+
+const char COMPRESSED_SHARD_MAGIC[4] = {'M', 'T', 'B', 'C'};
+const uint8_t COMPRESSED_SHARD_VERSION = 2;
+const uint32_t COMPRESSED_SHARD_BLOCK_POSITIONS = 512;
+
+enum CompressedShardCodec : uint8_t
+{
+    CODEC_NONE = 0,
+    CODEC_ZLIB = 1
+};
+
+struct CompressedShardHeader
+{
+    char m_magic[4];
+    uint8_t m_version;
+    uint8_t m_codec;
+    z_hash_t m_root_hash;
+    uint32_t m_position_count;
+    uint32_t m_block_count;
+} __attribute__((packed));
+
+struct CompressedBlockIndexEntry
+{
+    z_hash_t m_first_hash;
+    uint64_t m_offset;
+    uint32_t m_stored_size;
+    uint32_t m_raw_size;
+} __attribute__((packed));
+
+inline void write_varint(std::vector<uint8_t> *buffer, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        buffer->push_back((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    buffer->push_back(value);
+}
+
+// Reads the varint at index in the size bytes of data. Throws std::runtime_error if it runs
+// past the end, or is longer than a uint64_t, which only happens in a corrupt file.
+inline uint64_t read_varint(const uint8_t *data, size_t size, size_t *index)
+{
+    uint64_t value = 0;
+    int shift = 0;
+    while (true)
+    {
+        if (*index >= size)
+        {
+            throw std::runtime_error("truncated varint");
+        }
+        if (shift > 63)
+        {
+            throw std::runtime_error("varint too long");
+        }
+        uint8_t byte = data[(*index)++];
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return value;
+        }
+        shift += 7;
+    }
+}
+
+// x88 square -> 0..63
+inline uint8_t square_to_64(square_t square)
+{
+    return ((square >> 4) << 3) | (square & 0x7);
+}
+
+// 0..63 -> x88 square
+inline square_t square_from_64(uint8_t index)
+{
+    return ((index >> 3) << 4) | (index & 0x7);
+}
+
+/*
+    16 bit move key:
+    black promotion + promotion piece + dest square + src square
+    1 bit             3 bits            6 bits        6 bits
+*/
+inline uint16_t pack_move_key_16(MoveKey move_key)
+{
+    Move move(move_key);
+    return square_to_64(move.m_src_square) |
+           (square_to_64(move.m_dst_square) << 6) |
+           ((move.m_promotion_piece & PIECE_MASK) << 12) |
+           ((move.m_promotion_piece & BLACK_PIECE_MASK) ? (1 << 15) : 0);
+}
+
+inline MoveKey unpack_move_key_16(uint16_t packed)
+{
+    piece_t promotion_piece = (packed >> 12) & PIECE_MASK;
+    if (packed & (1 << 15))
+    {
+        promotion_piece |= BLACK_PIECE_MASK;
+    }
+    return pack_move_key(square_from_64(packed & 0x3f), square_from_64((packed >> 6) & 0x3f), promotion_piece);
+}
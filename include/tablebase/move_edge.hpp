@@ -3,10 +3,24 @@
 #include "tablebase/zobrist.hpp"
 #include <cstring>
 
+enum GameResult
+{
+    UNKNOWN_RESULT,
+    WHITE_WIN,
+    DRAW,
+    BLACK_WIN
+};
+
+GameResult parse_game_result(std::string result);
+
 struct MoveEdge
 {
     z_hash_t m_dest_hash;
     uint32_t m_times_played;
+    // Out of the games this move was played in, the ones with a known result and the
+    // half points white scored in them (2 for a win, 1 for a draw).
+    uint32_t m_times_scored;
+    uint32_t m_white_half_points;
 
     char m_pgn_move[8];
 
@@ -19,6 +33,8 @@ struct MoveEdge
         strncpy(m_pgn_move, pgn_move.c_str(), 8);
 
         m_times_played = 1;
+        m_times_scored = 0;
+        m_white_half_points = 0;
     };
 
     MoveEdge(z_hash_t dest_hash, std::string pgn_move, uint32_t times_played)
@@ -28,6 +44,16 @@ struct MoveEdge
         strncpy(m_pgn_move, pgn_move.c_str(), 8);
 
         m_times_played = times_played;
+        m_times_scored = 0;
+        m_white_half_points = 0;
+    };
+
+    MoveEdge(z_hash_t dest_hash, std::string pgn_move, uint32_t times_played,
+             uint32_t times_scored, uint32_t white_half_points)
+        : MoveEdge(dest_hash, pgn_move, times_played)
+    {
+        m_times_scored = times_scored;
+        m_white_half_points = white_half_points;
     };
 
     MoveEdge() {}
@@ -36,6 +62,8 @@ struct MoveEdge
     {
         m_dest_hash = other.m_dest_hash;
         m_times_played = other.m_times_played;
+        m_times_scored = other.m_times_scored;
+        m_white_half_points = other.m_white_half_points;
         strncpy(m_pgn_move, other.m_pgn_move, 8);
     }
 
@@ -43,6 +71,8 @@ struct MoveEdge
     {
         m_dest_hash = other.m_dest_hash;
         m_times_played = other.m_times_played;
+        m_times_scored = other.m_times_scored;
+        m_white_half_points = other.m_white_half_points;
         strncpy(m_pgn_move, other.m_pgn_move, 8);
     }
 
@@ -50,8 +80,20 @@ struct MoveEdge
     {
         return m_dest_hash == rhs.m_dest_hash &&
                m_times_played == rhs.m_times_played &&
+               m_times_scored == rhs.m_times_scored &&
+               m_white_half_points == rhs.m_white_half_points &&
                strcmp(m_pgn_move, rhs.m_pgn_move) == 0;
     }
+    void record_result(GameResult result)
+    {
+        if (result == UNKNOWN_RESULT)
+        {
+            return;
+        }
+        m_times_scored++;
+        m_white_half_points += result == WHITE_WIN ? 2 : (result == DRAW ? 1 : 0);
+    }
+
     bool operator!=(const MoveEdge &rhs) const
     {
         return !((*this) == rhs);
@@ -7,6 +7,7 @@
 #include <fstream>
 #include <filesystem>
 #include <set>
+#include <chrono>
 #include "tablebase/zobrist.hpp"
 #include "util.hpp"
 #include "representation/move.hpp"
@@ -14,22 +15,96 @@
 
 class Tablebase;
 
-using TablebaseIter = std::__1::unordered_map<z_hash_t, std::__1::shared_ptr<std::__1::unordered_map<MoveKey, MoveEdge>>>::iterator;
+using TablebaseIter = std::unordered_map<z_hash_t, std::shared_ptr<std::unordered_map<MoveKey, MoveEdge>>>::iterator;
 using MovesPlayed = std::unordered_map<MoveKey, MoveEdge>;
 using PositionToMovesPlayedMap = std::unordered_map<z_hash_t, std::shared_ptr<MovesPlayed>>;
 
+/*
+    Shard layout (NNN.tb). Integers are little endian, see compressed_shard.hpp for NNN.tbc.
+
+    header
+        4 bytes  -> magic "MTBS"
+        1 byte   -> format version
+        8 bytes  -> z_hash_t: hash of starting position
+        4 bytes  -> uint32_t: number of positions
+
+    per position
+        8 bytes  -> z_hash_t: hash of the position
+        4 bytes  -> uint32_t: number of moves
+        per move
+            4 bytes  -> MoveKey
+            8 bytes  -> z_hash_t: hash of the position after the move
+            8 bytes  -> pgn move
+            4 bytes  -> uint32_t: times played
+            4 bytes  -> uint32_t: times scored (games with a known result)
+            4 bytes  -> uint32_t: half points white scored in those games
+
+    Version 1 shards were written before there was a header, they start with the hash of the
+    starting position, and their moves end after times played. They are read without scores.
+*/
+const char TABLEBASE_SHARD_MAGIC[4] = {'M', 'T', 'B', 'S'};
+const uint8_t TABLEBASE_SHARD_VERSION = 2;
+
+struct ShardLoadTiming
+{
+    uint16_t m_shard = 0;
+    size_t m_positions = 0;
+    uintmax_t m_file_size = 0;
+    std::chrono::microseconds m_duration = std::chrono::microseconds(0);
+};
+
+struct PruneSummary
+{
+    int positions_before = 0;
+    int positions_after = 0;
+    int edges_before = 0;
+    int edges_after = 0;
+};
+
+/*
+    Statistics of a position aggregated over every move order that reaches it
+    (see Tablebase::analyze).
+*/
+struct PositionStats
+{
+    // games that reached the position, through any of its parents
+    uint32_t m_games = 0;
+    uint32_t m_times_scored = 0;
+    uint32_t m_white_half_points = 0;
+    // chance of reaching the position when every book move is sampled by times played
+    double m_reach_probability = 0;
+    // fewest plies from the root to the position
+    uint16_t m_min_ply = 0;
+
+    // expected score for the given side, pulled towards a draw when there are few games
+    double expected_score(bool for_white) const
+    {
+        uint32_t half_points = for_white ? m_white_half_points : 2 * m_times_scored - m_white_half_points;
+        return (half_points + 1.0) / (2.0 * m_times_scored + 2.0);
+    }
+};
+
 class Tablebase
 {
     static const uint16_t TABLEBASE_SHARD_COUNT = 64;
     PositionToMovesPlayedMap shards[TABLEBASE_SHARD_COUNT];
     std::mutex mutexes[TABLEBASE_SHARD_COUNT];
     z_hash_t m_root_hash;
+    std::vector<ShardLoadTiming> m_load_timings;
+    std::unordered_map<z_hash_t, PositionStats> m_position_stats;
 
 public:
+    // The readers throw std::runtime_error if a file can't be read, or isn't a valid shard.
     void read_from_file(std::string file_path, int shard);
+    // Reads the files named NNN.tb or NNN.tbc for shard NNN, and throws if a shard has both.
     void read_from_directory(fs::path source_directory_path);
     void serialize_tablebase(std::string file_path, int shard);
     void serialize_all(fs::path destination_directory_path);
+    void serialize_all(fs::path destination_directory_path, bool compressed);
+    void read_from_compressed_file(std::string file_path, int shard);
+    void serialize_compressed_tablebase(std::string file_path, int shard);
+    void restore_move_edges();
+    static std::shared_ptr<MovesPlayed> probe_compressed_file(std::string file_path, z_hash_t position_hash);
     void test_fn(std::string file_path, int shard);
 
     Tablebase()
@@ -53,6 +128,12 @@ public:
         return TABLEBASE_SHARD_COUNT;
     }
 
+    // how long reading each shard took during the last read_from_directory, ordered by shard
+    const std::vector<ShardLoadTiming> &get_load_timings()
+    {
+        return m_load_timings;
+    }
+
     bool operator==(const Tablebase &rhs) const
     {
         if (m_root_hash != rhs.m_root_hash)
@@ -92,11 +173,24 @@ public:
 
     bool position_exists(z_hash_t position_hash);
     void update(z_hash_t insert_hash, z_hash_t dest_hash, MoveKey move_key, std::string pgn_move);
+    void update(z_hash_t insert_hash, z_hash_t dest_hash, MoveKey move_key, std::string pgn_move, GameResult result);
     void insert_new_move_map(z_hash_t insert_hash, MoveKey moveKey, MoveEdge moveEdge);
     void increment_times_played_or_insert_move(TablebaseIter node, MoveKey moveKey, MoveEdge moveEdge);
     MoveKey pick_move_from_sample(z_hash_t position_hash);
+    MoveKey pick_move_by_score(z_hash_t position_hash, bool whites_turn, double min_share);
     void walk_down_most_popular_path();
     void list_all_moves_for_position(z_hash_t position_hash);
 
+    PruneSummary prune(uint32_t min_times_played, int max_ply);
+
+    void analyze();
+    const PositionStats *get_position_stats(z_hash_t position_hash);
+
+    bool is_analyzed()
+    {
+        return !m_position_stats.empty();
+    }
+
     int total_size();
+    int total_edges();
 };
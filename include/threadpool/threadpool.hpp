@@ -1,75 +1,300 @@
 #pragma once
 
+#include "threadpool/work_stealing_deque.hpp"
+#include <cassert>
+#include <atomic>
 #include <iostream>
 #include <vector>
 #include <mutex>
 #include <queue>
 #include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
 #include <random>
 #include <ctime>
 #include <thread>
+#include <tuple>
+#include <type_traits>
 
 #ifndef THREAD_POOL_DEBUG
 // uncomment line below to enable debug messages
 // #define THREAD_POOL_DEBUG
 #endif
 
-struct Task
+/*
+    A unit of work for the thread pool: any callable that takes no arguments. The callable
+    is owned by the task, so move-only ones (like a std::packaged_task, or a lambda that
+    owns a buffer) can be queued, and nothing has to outlive the pool.
+*/
+class Task
 {
-    void (*m_fn)(std::string arg) = NULL;
-    std::function<void(std::string &)> *m_function = NULL;
-    std::string m_arg;
+    struct Callable
+    {
+        virtual ~Callable() = default;
+        virtual void call() = 0;
+    };
+
+    template <typename F>
+    struct CallableImpl : Callable
+    {
+        F m_fn;
+
+        template <typename G>
+        CallableImpl(G &&fn) : m_fn(std::forward<G>(fn)) {}
+
+        void call() override
+        {
+            m_fn();
+        }
+    };
+
+    std::unique_ptr<Callable> m_callable;
 
+public:
     Task(){};
-    Task(void (*fn)(std::string arg), std::string arg) : m_fn(fn), m_arg(arg) {}
 
-    Task(std::function<void(std::string &)> *fn, std::string arg)
-    {
-        m_function = fn;
-        m_arg = arg;
-    }
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>>>
+    Task(F &&fn) : m_callable(std::make_unique<CallableImpl<std::decay_t<F>>>(std::forward<F>(fn))) {}
+
+    Task(void (*fn)(std::string arg), std::string arg) : Task([fn, arg]()
+                                                              { fn(arg); }) {}
 
     void execute()
     {
-        if (m_fn != NULL)
-        {
-            m_fn(m_arg);
-        }
-        else if (m_function != NULL)
-        {
-            (*(m_function))(m_arg);
-        }
-        else
-        {
-            assert(false);
-        }
+        assert(m_callable);
+        m_callable->call();
     }
 };
 
+/*
+    Fixed number of threads working off queues of tasks. Tasks can be added while
+    the threads are working. submit returns a future for the task's result, exceptions
+    thrown by the task are rethrown by the future's get.
+
+    Every thread has its own work stealing deque. Tasks added by a task running on the pool
+    go to the deque of its thread, which works them off newest first without locking. Tasks
+    added from outside the pool go to a shared queue. A thread without work of its own takes
+    from the shared queue, then steals the oldest task of another thread. Threads that find
+    nothing sleep, and adding a task only takes the sleep lock if a thread is asleep.
+
+    Threads can be pinned to one CPU each, in the order of the CPUs the process may run on, so
+    that the scheduler doesn't move them between cores or NUMA nodes. Either way, a thread
+    allocates its own deque after it is pinned, so the memory is first touched on its node.
+
+    wait_idle waits for the queued tasks without stopping the threads, so the pool can be
+    reused. join_pool stops the threads, after which the pool can't run tasks anymore.
+    The destructor joins the pool if that hasn't been done, finishing the queued tasks.
+
+    Most work should go to the long lived shared_thread_pool, through a WaitGroup, rather
+    than to a pool of its own, so that the threads aren't created again for every operation.
+*/
 class ThreadPool
 {
 private:
     int m_num_threads;
+    bool m_pin_threads = false;
     std::vector<std::thread> pool;
+    std::vector<std::unique_ptr<WorkStealingDeque<Task>>> m_deques;
+
+    // tasks added from outside the pool
     std::mutex queue_mutex;
-    std::queue<Task> task_queue;
+    std::queue<Task *> task_queue;
+    std::atomic<size_t> m_task_queue_size = 0;
+
+    // tasks waiting in the queue or a deque, and those plus the running ones
+    std::atomic<int64_t> m_queued_tasks = 0;
+    std::atomic<int64_t> m_unfinished_tasks = 0;
+
+    std::mutex sleep_mutex;
     std::condition_variable cv;
-    bool should_wait_for_more_tasks = true;
+    std::atomic<int> m_sleeping_threads = 0;
+    std::atomic<bool> m_stopping = false;
+    std::atomic<bool> m_abandon_unfinished_tasks = false;
+
+    std::mutex idle_mutex;
+    std::condition_variable idle_cv;
+
+    // no thread looks for tasks before every thread has created its deque
+    std::mutex start_mutex;
+    std::condition_variable start_cv;
+    int m_started_threads = 0;
+
     static const bool THREAD_POOL_DEBUG = false;
 
     std::mutex stdout_mutex;
 
     void initialize_threads();
-    void spin();
-    bool should_thread_wait();
+    void spin(int thread_index);
+    Task *find_task(int thread_index);
+    void run_task(Task *task);
+    void push_task(Task *task);
+    void wake_threads(int64_t tasks);
+    void discard_queued_tasks();
 
 public:
     ThreadPool();
     ThreadPool(int num_threads);
+    ThreadPool(int num_threads, bool pin_threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int size()
+    {
+        return m_num_threads;
+    }
+
+    bool pins_threads()
+    {
+        return m_pin_threads;
+    }
 
     void add_task(Task task);
+
+    // Runs fn(args...) on the pool. The arguments are copied or moved into the task.
+    template <typename F, typename... Args>
+    auto submit(F &&fn, Args &&...args) -> std::future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>>
+    {
+        using Result = std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>;
+
+        std::packaged_task<Result()> task(
+            [fn = std::forward<F>(fn), args = std::make_tuple(std::forward<Args>(args)...)]() mutable
+            { return std::apply(fn, std::move(args)); });
+        std::future<Result> future = task.get_future();
+        add_task(Task(std::move(task)));
+        return future;
+    }
+
+    // Queues all the callables at once, waking the threads only once. The futures are in the order of fns.
+    template <typename F>
+    auto submit_batch(std::vector<F> fns) -> std::vector<std::future<std::invoke_result_t<F &>>>
+    {
+        using Result = std::invoke_result_t<F &>;
+
+        std::vector<std::future<Result>> futures;
+        std::vector<Task> tasks;
+        futures.reserve(fns.size());
+        tasks.reserve(fns.size());
+        for (auto it = fns.begin(); it != fns.end(); it++)
+        {
+            std::packaged_task<Result()> task(std::move(*it));
+            futures.push_back(task.get_future());
+            tasks.push_back(Task(std::move(task)));
+        }
+        add_tasks(std::move(tasks));
+        return futures;
+    }
+
+    void add_tasks(std::vector<Task> tasks);
+
+    /*
+        Waits until no task is queued or running. Needs at least one thread, and must not be called
+        from a task, which would wait for itself.
+    */
+    void wait_idle();
+
+    bool is_pool_thread();
+
+    // Runs one queued task on the calling thread, if it is one of the pool's. False if there was none.
+    bool run_pending_task();
+
     void join_pool(bool abandon_unfinished_tasks);
     void join_pool();
 };
 
-void test();
\ No newline at end of file
+/*
+    The tasks of one operation on a pool that is shared with other operations. wait only
+    waits for the tasks submitted through the group, unlike ThreadPool::wait_idle. When
+    a task waits for a group of its own subtasks, its thread runs queued tasks meanwhile,
+    so nested groups can't run out of threads.
+*/
+class WaitGroup
+{
+    ThreadPool &m_pool;
+    std::atomic<int64_t> m_pending = 0;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+
+    struct DoneOnExit
+    {
+        WaitGroup *m_group;
+
+        ~DoneOnExit()
+        {
+            m_group->done();
+        }
+    };
+
+    void done();
+
+public:
+    WaitGroup(ThreadPool &pool) : m_pool(pool) {}
+    ~WaitGroup()
+    {
+        wait();
+    }
+
+    WaitGroup(const WaitGroup &) = delete;
+    WaitGroup &operator=(const WaitGroup &) = delete;
+
+    template <typename F, typename... Args>
+    auto submit(F &&fn, Args &&...args) -> std::future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>>
+    {
+        m_pending++;
+        return m_pool.submit(
+            [this, fn = std::forward<F>(fn), args = std::make_tuple(std::forward<Args>(args)...)]() mutable
+            {
+                DoneOnExit done_on_exit{this};
+                return std::apply(fn, std::move(args));
+            });
+    }
+
+    template <typename F>
+    auto submit_batch(std::vector<F> fns) -> std::vector<std::future<std::invoke_result_t<F &>>>
+    {
+        auto in_group = [this](F &&fn)
+        {
+            return [this, fn = std::move(fn)]() mutable
+            {
+                DoneOnExit done_on_exit{this};
+                return fn();
+            };
+        };
+
+        std::vector<decltype(in_group(std::declval<F>()))> grouped;
+        grouped.reserve(fns.size());
+        for (auto it = fns.begin(); it != fns.end(); it++)
+        {
+            grouped.push_back(in_group(std::move(*it)));
+        }
+        m_pending += fns.size();
+        return m_pool.submit_batch(std::move(grouped));
+    }
+
+    void wait();
+};
+
+/*
+    The pool for the engine's parallel work, created on first use with the Threads option's
+    number of threads (see set_shared_thread_pool_size), pinned if the ThreadAffinity option is set.
+*/
+ThreadPool &shared_thread_pool();
+
+/*
+    Replaces the shared pool with one of the given size, after its queued tasks are done.
+    Must not be called while another thread uses the shared pool.
+*/
+void set_shared_thread_pool_size(int num_threads);
+
+// Replaces the shared pool with one that does or doesn't pin its threads, like set_shared_thread_pool_size.
+void set_shared_thread_pool_affinity(bool pin_threads);
+
+/*
+    Pins the calling thread to the CPU at cpu_index among the CPUs the process may run on, wrapping
+    around if there are fewer. False if that isn't supported on this platform, or failed.
+*/
+bool pin_current_thread(int cpu_index);
+
+void test();
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*
+    Chase-Lev work stealing deque of pointers (Chase and Lev 2005, with the memory orderings of
+    Le et al. 2013). Only the owning thread may push and pop, at the bottom, so it works off its
+    own tasks newest first. Any other thread may steal from the top, taking the oldest task.
+    Neither side locks, the owner and a thief only race with a compare and swap over the last item.
+
+    The buffer grows when it is full. Old buffers are kept until the deque is destroyed, because
+    a thief may still be reading from one.
+*/
+template <typename T>
+class WorkStealingDeque
+{
+    struct Buffer
+    {
+        int64_t m_capacity;
+        std::unique_ptr<std::atomic<T *>[]> m_slots;
+
+        Buffer(int64_t capacity) : m_capacity(capacity), m_slots(new std::atomic<T *>[capacity]) {}
+
+        T *get(int64_t index)
+        {
+            return m_slots[index & (m_capacity - 1)].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t index, T *item)
+        {
+            m_slots[index & (m_capacity - 1)].store(item, std::memory_order_relaxed);
+        }
+    };
+
+    // top and bottom are written by different threads, keep them on different cache lines
+    alignas(64) std::atomic<int64_t> m_top;
+    alignas(64) std::atomic<int64_t> m_bottom;
+    alignas(64) std::atomic<Buffer *> m_buffer;
+    std::vector<std::unique_ptr<Buffer>> m_buffers;
+
+    Buffer *grow(Buffer *buffer, int64_t top, int64_t bottom)
+    {
+        m_buffers.push_back(std::make_unique<Buffer>(buffer->m_capacity * 2));
+        Buffer *grown = m_buffers.back().get();
+        for (int64_t i = top; i < bottom; i++)
+        {
+            grown->put(i, buffer->get(i));
+        }
+        m_buffer.store(grown, std::memory_order_release);
+        return grown;
+    }
+
+public:
+    // capacity must be a power of two
+    WorkStealingDeque(int64_t capacity = 256) : m_top(0), m_bottom(0)
+    {
+        m_buffers.push_back(std::make_unique<Buffer>(capacity));
+        m_buffer.store(m_buffers.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+    WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+    // owner only
+    void push(T *item)
+    {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        int64_t top = m_top.load(std::memory_order_acquire);
+        Buffer *buffer = m_buffer.load(std::memory_order_relaxed);
+        if (bottom - top > buffer->m_capacity - 1)
+        {
+            buffer = grow(buffer, top, bottom);
+        }
+        buffer->put(bottom, item);
+        // a release store rather than the paper's release fence, same ordering but visible to tsan
+        m_bottom.store(bottom + 1, std::memory_order_release);
+    }
+
+    // owner only, NULL if empty
+    T *pop()
+    {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        Buffer *buffer = m_buffer.load(std::memory_order_relaxed);
+        m_bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = m_top.load(std::memory_order_relaxed);
+
+        if (top > bottom)
+        {
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return NULL;
+        }
+
+        T *item = buffer->get(bottom);
+        if (top == bottom)
+        {
+            // the last item, a thief may be taking it at the same time
+            if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                item = NULL;
+            }
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // any thread, NULL if empty or if another thread took the item first
+    T *steal()
+    {
+        int64_t top = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = m_bottom.load(std::memory_order_acquire);
+        if (top >= bottom)
+        {
+            return NULL;
+        }
+
+        Buffer *buffer = m_buffer.load(std::memory_order_acquire);
+        T *item = buffer->get(top);
+        if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return NULL;
+        }
+        return item;
+    }
+
+    // only a hint while other threads are using the deque
+    bool empty()
+    {
+        return m_top.load(std::memory_order_relaxed) >= m_bottom.load(std::memory_order_relaxed);
+    }
+};
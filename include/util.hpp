@@ -13,7 +13,10 @@ const std::string program_start_timestamp = std::to_string(std::chrono::seconds(
 
 const fs::path pgn_database_path = fs::path(PROJECT_ROOT_DIR) / "database" / "pgn";
 const fs::path tablebase_data_dir = dev_data_dir / "tablebase";
-const fs::path completed_files_filepath = dev_data_dir / "completed_files.txt";
+const fs::path game_archive_dir = dev_data_dir / "archive";
+const std::string completed_files_filename = "completed_files.txt";
+const std::string ingest_metrics_filename = "ingest_metrics.json";
+const std::string game_hashes_filename = "game_hashes.bin";
 
 namespace ColorCode
 {
@@ -0,0 +1,75 @@
+#include "alloc_stats.hpp"
+#include <cstdlib>
+#include <new>
+
+/*
+  Replaces the global operator new and delete to count every heap allocation, see
+  alloc_stats.hpp. Only the plain and the aligned forms are replaced: the standard array and
+  nothrow forms call these. Everything is freed with free, both forms get their memory from
+  the C allocator.
+*/
+
+static const bool hook_installed = (enable_allocation_counting(), true);
+
+static void *allocate(size_t size, size_t alignment)
+{
+  if (size == 0)
+  {
+    size = 1;
+  }
+  void *memory;
+  while (true)
+  {
+    if (alignment <= alignof(std::max_align_t))
+    {
+      memory = std::malloc(size);
+    }
+    else
+    {
+      // aligned_alloc wants a multiple of the alignment
+      memory = std::aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+    }
+    if (memory != NULL)
+    {
+      break;
+    }
+    std::new_handler handler = std::get_new_handler();
+    if (handler == NULL)
+    {
+      throw std::bad_alloc();
+    }
+    handler();
+  }
+  record_allocation(size);
+  return memory;
+}
+
+void *operator new(size_t size)
+{
+  return allocate(size, alignof(std::max_align_t));
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+  return allocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void *memory) noexcept
+{
+  std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+  std::free(memory);
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept
+{
+  std::free(memory);
+}
+
+void operator delete(void *memory, size_t, std::align_val_t) noexcept
+{
+  std::free(memory);
+}
@@ -0,0 +1,41 @@
+#include "alloc_stats.hpp"
+#include <atomic>
+
+/*
+  Plain integers so that reading and writing them never allocates, operator new calls into
+  here. The thread local ones are constant initialized, they need no guard either.
+*/
+static std::atomic<bool> counting_enabled(false);
+static std::atomic<uint64_t> total_allocations(0);
+static std::atomic<uint64_t> total_bytes(0);
+static thread_local uint64_t thread_allocations = 0;
+static thread_local uint64_t thread_bytes = 0;
+
+bool allocation_counting_enabled()
+{
+  return counting_enabled.load(std::memory_order_relaxed);
+}
+
+AllocationCounts allocation_counts()
+{
+  return AllocationCounts{total_allocations.load(std::memory_order_relaxed),
+                          total_bytes.load(std::memory_order_relaxed)};
+}
+
+AllocationCounts thread_allocation_counts()
+{
+  return AllocationCounts{thread_allocations, thread_bytes};
+}
+
+void record_allocation(size_t bytes)
+{
+  total_allocations.fetch_add(1, std::memory_order_relaxed);
+  total_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  thread_allocations++;
+  thread_bytes += bytes;
+}
+
+void enable_allocation_counting()
+{
+  counting_enabled.store(true, std::memory_order_relaxed);
+}
@@ -0,0 +1,32 @@
+#include "arena.hpp"
+#include <algorithm>
+
+void *SearchArena::allocate(size_t bytes, size_t alignment)
+{
+  while (true)
+  {
+    if (m_chunk < m_chunks.size())
+    {
+      Chunk &chunk = m_chunks[m_chunk];
+      size_t start = (m_offset + alignment - 1) & ~(alignment - 1);
+      if (start + bytes <= chunk.m_size)
+      {
+        m_offset = start + bytes;
+        return chunk.m_data.get() + start;
+      }
+      // the rest of this chunk is wasted until the arena is rewound to before it
+      m_chunk++;
+      m_offset = 0;
+      continue;
+    }
+
+    size_t size = std::max(CHUNK_SIZE, bytes);
+    m_chunks.push_back(Chunk{std::unique_ptr<uint8_t[]>(new uint8_t[size]), size});
+  }
+}
+
+SearchArena &thread_search_arena()
+{
+  static thread_local SearchArena arena;
+  return arena;
+}
@@ -1,9 +1,12 @@
 #include "cli.hpp"
+#include "alloc_stats.hpp"
 #include "options.hpp"
+#include "perft.hpp"
 #include "process_pgn/read_pgn_data.hpp"
 #include "representation/fen.hpp"
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/split.hpp>
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <thread>
@@ -65,6 +68,29 @@ void CLI::process_command_isready(std::vector<std::string> args)
   // options)
   announce_readyok();
 };
+// setoption name <id> [value <x>], the name and the value may contain spaces.
+void CLI::process_command_setoption(std::vector<std::string> args)
+{
+  auto name_it = std::find(args.begin(), args.end(), "name");
+  auto value_it = std::find(args.begin(), args.end(), "value");
+  if (name_it == args.end() || name_it + 1 >= value_it)
+  {
+    m_logger.warn("setoption needs a name");
+    return;
+  }
+
+  std::string name = boost::algorithm::join(std::vector<std::string>(name_it + 1, value_it), " ");
+  std::string value = value_it == args.end()
+                          ? ""
+                          : boost::algorithm::join(std::vector<std::string>(value_it + 1, args.end()), " ");
+  if (!set_option(name, value))
+  {
+    m_logger.warn("Unsupported option or value: {} = {}", name, value);
+    return;
+  }
+  m_logger.info("Set option {} to {}", name, value);
+}
+
 void CLI::process_command_register(std::vector<std::string> args){};
 void CLI::process_command_ucinewgame(std::vector<std::string> args){};
 
@@ -159,7 +185,14 @@ void CLI::process_command_go(std::vector<std::string> args)
   // write function that creates vector of pairs for keys/values
 
   auto time = std::chrono::milliseconds(5000);
+  AllocationCounts allocations_start = allocation_counts();
   best_move = m_engine.find_best_move(time);
+  if (allocation_counting_enabled())
+  {
+    AllocationCounts allocations = allocation_counts() - allocations_start;
+    log_and_respond("info string allocations " + std::to_string(allocations.m_allocations) +
+                    " bytes " + std::to_string(allocations.m_bytes));
+  }
   log_and_respond("bestmove " + movekey_to_lan(best_move));
 };
 void CLI::process_command_stop(std::vector<std::string> args)
@@ -181,6 +214,33 @@ void CLI::process_command_quit(std::vector<std::string> args)
   exit(0);
 }
 
+// Reads key=value filter arguments (see PgnGameFilter::set_option), returns false if one is invalid.
+static bool parse_game_filter_arg(std::string arg, PgnGameFilter *filter)
+{
+  std::vector<std::string> key_value;
+  boost::split(key_value, arg, boost::is_any_of("="));
+  if (key_value.size() != 2)
+  {
+    std::cout << "Invalid argument: " << arg << std::endl;
+    return false;
+  }
+
+  try
+  {
+    if (!filter->set_option(key_value[0], key_value[1]))
+    {
+      std::cout << "Unknown argument: " << key_value[0] << std::endl;
+      return false;
+    }
+  }
+  catch (const std::exception &e)
+  {
+    std::cout << "Invalid value for " << key_value[0] << ": " << key_value[1] << std::endl;
+    return false;
+  }
+  return true;
+}
+
 void CLI::process_command_create_tablebases(std::vector<std::string> args)
 {
 
@@ -199,8 +259,112 @@ void CLI::process_command_create_tablebases(std::vector<std::string> args)
   {
     // check tablebase name to make sure there are no illegal characters.
   }
+  // create_tablebases <name> [compressed] [dedup] [archive=<name>] [min_elo=N] [min_time_control=S]
+  //                   [from=YYYY.MM.DD] [to=YYYY.MM.DD] [result=1-0,0-1,...] [event=<regex>]
+  bool compressed = false;
+  bool deduplicate = false;
+  std::string archive_name;
+  PgnGameFilter filter;
+  for (size_t i = 2; i < args.size(); i++)
+  {
+    if (args.at(i).compare("compressed") == 0)
+    {
+      compressed = true;
+    }
+    else if (args.at(i).compare("dedup") == 0)
+    {
+      deduplicate = true;
+    }
+    else if (boost::starts_with(args.at(i), "archive="))
+    {
+      archive_name = args.at(i).substr(std::string("archive=").size());
+    }
+    else if (!parse_game_filter_arg(args.at(i), &filter))
+    {
+      return;
+    }
+  }
+
+  m_logger.debug("tablebase name: {}", tablebase_name);
+  m_engine.set_tablebase(create_tablebases_from_pgn_data(tablebase_name, compressed, filter, archive_name, deduplicate));
+}
+
+// Only processes pgn files that were added or appended to since the tablebase was last written.
+// update_tablebases <name> [dedup] [archive=<name>] [filter arguments, as for create_tablebases]
+void CLI::process_command_update_tablebases(std::vector<std::string> args)
+{
+  if (args.size() < 2)
+  {
+    m_logger.info("You must provide a tablebase name");
+    return;
+  }
+  std::string tablebase_name = args.at(1);
+
+  bool deduplicate = false;
+  std::string archive_name;
+  PgnGameFilter filter;
+  for (size_t i = 2; i < args.size(); i++)
+  {
+    if (args.at(i).compare("dedup") == 0)
+    {
+      deduplicate = true;
+    }
+    else if (boost::starts_with(args.at(i), "archive="))
+    {
+      archive_name = args.at(i).substr(std::string("archive=").size());
+    }
+    else if (!parse_game_filter_arg(args.at(i), &filter))
+    {
+      return;
+    }
+  }
+
   m_logger.debug("tablebase name: {}", tablebase_name);
-  m_engine.set_tablebase(create_tablebases_from_pgn_data(tablebase_name));
+  try
+  {
+    m_engine.set_tablebase(update_tablebases_from_pgn_data(tablebase_name, filter, archive_name, deduplicate));
+  }
+  catch (const std::exception &e)
+  {
+    // the existing tablebase couldn't be read, it is left as it is
+    std::cerr << ColorCode::red << e.what() << ColorCode::end << std::endl;
+  }
+}
+
+// Creates a tablebase from a game archive written by create_tablebases, without parsing pgn.
+// replay_archive <tablebase name> <archive name> [compressed] [max_plies=N] [filter arguments]
+void CLI::process_command_replay_archive(std::vector<std::string> args)
+{
+  if (args.size() < 3)
+  {
+    m_logger.info("You must provide a tablebase name and an archive name");
+    return;
+  }
+  std::string tablebase_name = args.at(1);
+  std::string archive_name = args.at(2);
+
+  bool compressed = false;
+  int max_plies = 15;
+  PgnGameFilter filter;
+  for (size_t i = 3; i < args.size(); i++)
+  {
+    if (args.at(i).compare("compressed") == 0)
+    {
+      compressed = true;
+    }
+    else if (boost::starts_with(args.at(i), "max_plies="))
+    {
+      max_plies = std::stoi(args.at(i).substr(std::string("max_plies=").size()));
+    }
+    else if (!parse_game_filter_arg(args.at(i), &filter))
+    {
+      return;
+    }
+  }
+
+  m_logger.debug("tablebase name: {}, archive name: {}", tablebase_name, archive_name);
+  m_engine.set_tablebase(
+      create_tablebases_from_game_archive(tablebase_name, archive_name, compressed, max_plies, filter));
 }
 
 void CLI::process_command_read_tablebases(std::vector<std::string> args)
@@ -216,8 +380,29 @@ void CLI::process_command_read_tablebases(std::vector<std::string> args)
 
   if (std::filesystem::is_directory(tablebase_data_dir / tablebase_name))
   {
+    auto clock_start = std::chrono::high_resolution_clock::now();
+    std::shared_ptr<Tablebase> tablebase;
+    try
+    {
+      tablebase = std::make_shared<Tablebase>(tablebase_data_dir / tablebase_name);
+    }
+    catch (const std::exception &e)
+    {
+      std::cerr << ColorCode::red << e.what() << ColorCode::end << std::endl;
+      return;
+    }
+    auto clock_end = std::chrono::high_resolution_clock::now();
 
-    m_engine.set_tablebase(std::make_shared<Tablebase>(tablebase_data_dir / tablebase_name));
+    for (const ShardLoadTiming &timing : tablebase->get_load_timings())
+    {
+      m_logger.debug("shard {:03d}: {} positions, {} bytes, {} us",
+                     timing.m_shard, timing.m_positions, timing.m_file_size, timing.m_duration.count());
+    }
+    m_logger.info("Read {} tablebase shards in {} ms",
+                  tablebase->get_load_timings().size(),
+                  std::chrono::duration_cast<std::chrono::milliseconds>(clock_end - clock_start).count());
+
+    m_engine.set_tablebase(tablebase);
   }
   else
   {
@@ -226,6 +411,59 @@ void CLI::process_command_read_tablebases(std::vector<std::string> args)
   }
 }
 
+// prune_tablebase [min_games=N] [max_ply=P] [save=<name>]
+void CLI::process_command_prune_tablebase(std::vector<std::string> args)
+{
+  if (!m_engine.m_master_tablebase)
+  {
+    std::cout << "No tablebase loaded" << std::endl;
+    return;
+  }
+
+  uint32_t min_games = 1;
+  int max_ply = 0;
+  std::string save_name;
+  for (size_t i = 1; i < args.size(); i++)
+  {
+    std::vector<std::string> key_value;
+    boost::split(key_value, args.at(i), boost::is_any_of("="));
+    if (key_value.size() != 2)
+    {
+      std::cout << "Invalid argument: " << args.at(i) << std::endl;
+      return;
+    }
+
+    if (key_value[0] == "min_games")
+    {
+      min_games = std::stoul(key_value[1]);
+    }
+    else if (key_value[0] == "max_ply")
+    {
+      max_ply = std::stoi(key_value[1]);
+    }
+    else if (key_value[0] == "save")
+    {
+      save_name = key_value[1];
+    }
+    else
+    {
+      std::cout << "Unknown argument: " << key_value[0] << std::endl;
+      return;
+    }
+  }
+
+  PruneSummary summary = m_engine.m_master_tablebase->prune(min_games, max_ply);
+  std::cout << "Pruned tablebase (min_games=" << min_games << ", max_ply=" << max_ply << ")" << std::endl
+            << "positions: " << summary.positions_before << " -> " << summary.positions_after << std::endl
+            << "moves: " << summary.edges_before << " -> " << summary.edges_after << std::endl;
+
+  if (save_name.size())
+  {
+    m_engine.m_master_tablebase->serialize_all(tablebase_data_dir / save_name);
+    m_logger.info("Saved pruned tablebase to {}", (tablebase_data_dir / save_name).string());
+  }
+}
+
 void CLI::process_command_test_tablebases(std::vector<std::string> args)
 {
   m_engine.m_master_tablebase->walk_down_most_popular_path();
@@ -236,6 +474,7 @@ void CLI::init_command_map()
   command_map["uci"] = Command::uci;
   command_map["debug"] = Command::debug;
   command_map["isready"] = Command::isready;
+  command_map["setoption"] = Command::setoption;
   command_map["register"] = Command::_register;
   command_map["ucinewgame"] = Command::ucinewgame;
   command_map["position"] = Command::position;
@@ -244,16 +483,22 @@ void CLI::init_command_map()
   command_map["ponderhit"] = Command::ponderhit;
   command_map["quit"] = Command::quit;
   command_map["create_tablebases"] = Command::create_tablebases;
+  command_map["update_tablebases"] = Command::update_tablebases;
+  command_map["replay_archive"] = Command::replay_archive;
   command_map["read_tablebases"] = Command::read_tablebases;
+  command_map["prune_tablebase"] = Command::prune_tablebase;
   command_map["test_tablebases"] = Command::test_tablebases;
   command_map["list_tablebase_moves"] = Command::list_tablebase_moves;
   command_map["list_engine_moves"] = Command::list_engine_moves;
   command_map["print_current_position"] = Command::print_current_position;
   command_map["pcp"] = Command::print_current_position;
+  command_map["perft"] = Command::_perft;
+  command_map["search_speedup"] = Command::search_speedup;
 
   command_processor_map[Command::uci] = &CLI::process_command_uci;
   command_processor_map[Command::debug] = &CLI::process_command_debug;
   command_processor_map[Command::isready] = &CLI::process_command_isready;
+  command_processor_map[Command::setoption] = &CLI::process_command_setoption;
   command_processor_map[Command::_register] = &CLI::process_command_register;
   command_processor_map[Command::ucinewgame] = &CLI::process_command_ucinewgame;
   command_processor_map[Command::position] = &CLI::process_command_position;
@@ -262,11 +507,16 @@ void CLI::init_command_map()
   command_processor_map[Command::ponderhit] = &CLI::process_command_ponderhit;
   command_processor_map[Command::quit] = &CLI::process_command_quit;
   command_processor_map[Command::create_tablebases] = &CLI::process_command_create_tablebases;
+  command_processor_map[Command::update_tablebases] = &CLI::process_command_update_tablebases;
+  command_processor_map[Command::replay_archive] = &CLI::process_command_replay_archive;
   command_processor_map[Command::read_tablebases] = &CLI::process_command_read_tablebases;
+  command_processor_map[Command::prune_tablebase] = &CLI::process_command_prune_tablebase;
   command_processor_map[Command::test_tablebases] = &CLI::process_command_test_tablebases;
   command_processor_map[Command::list_tablebase_moves] = &CLI::process_command_list_tablebase_moves;
   command_processor_map[Command::list_engine_moves] = &CLI::process_command_list_engine_moves;
   command_processor_map[Command::print_current_position] = &CLI::process_command_print_current_position;
+  command_processor_map[Command::_perft] = &CLI::process_command_perft;
+  command_processor_map[Command::search_speedup] = &CLI::process_command_search_speedup;
 }
 
 void CLI::process_command_print_current_position(std::vector<std::string> args)
@@ -274,6 +524,137 @@ void CLI::process_command_print_current_position(std::vector<std::string> args)
   m_engine.m_current_position->print_with_borders_highlight_squares(0, 0);
 }
 
+// perft <depth> [tt=<MB>], counts the leaf nodes below the current position on the shared thread pool.
+void CLI::process_command_perft(std::vector<std::string> args)
+{
+  if (args.size() < 2)
+  {
+    std::cout << "Usage: perft <depth> [tt=<MB>]" << std::endl;
+    return;
+  }
+  // a negative depth would recurse without end
+  int depth = -1;
+  try
+  {
+    depth = std::stoi(args.at(1));
+  }
+  catch (const std::exception &e)
+  {
+  }
+  if (depth < 0)
+  {
+    std::cout << "Invalid depth: " << args.at(1) << std::endl
+              << "Usage: perft <depth> [tt=<MB>]" << std::endl;
+    return;
+  }
+
+  // std::stoul would wrap a negative size around to a huge one
+  long long table_mb = 0;
+  for (size_t i = 2; i < args.size(); i++)
+  {
+    std::vector<std::string> key_value;
+    boost::split(key_value, args.at(i), boost::is_any_of("="));
+    if (key_value.size() != 2 || key_value[0] != "tt")
+    {
+      std::cout << "Invalid argument: " << args.at(i) << std::endl;
+      return;
+    }
+    table_mb = -1;
+    try
+    {
+      table_mb = std::stoll(key_value[1]);
+    }
+    catch (const std::exception &e)
+    {
+    }
+    if (table_mb < 0)
+    {
+      std::cout << "Invalid value for tt: " << key_value[1] << std::endl
+                << "Usage: perft <depth> [tt=<MB>]" << std::endl;
+      return;
+    }
+  }
+
+  std::unique_ptr<PerftTable> table;
+  if (table_mb > 0)
+  {
+    table = std::make_unique<PerftTable>(table_mb);
+  }
+  AllocationCounts allocations_start = allocation_counts();
+  PerftResult result = parallel_perft(m_engine.m_current_position, depth, shared_thread_pool(), table.get());
+  AllocationCounts allocations = allocation_counts() - allocations_start;
+  for (auto it = result.m_divide.begin(); it != result.m_divide.end(); it++)
+  {
+    std::cout << movekey_to_lan(it->first) << ": " << it->second << std::endl;
+  }
+  std::cout << std::endl
+            << "nodes: " << result.m_nodes << std::endl
+            << "time: " << std::chrono::duration_cast<std::chrono::milliseconds>(result.m_time).count() << " ms" << std::endl
+            << "nps: " << (uint64_t)result.nodes_per_second() << std::endl
+            << "threads: " << result.m_threads << std::endl;
+  if (table)
+  {
+    std::cout << "table hits: " << result.m_table_hits << std::endl;
+  }
+  if (allocation_counting_enabled())
+  {
+    std::cout << "allocations: " << allocations.m_allocations << std::endl
+              << "allocated bytes: " << allocations.m_bytes << std::endl;
+  }
+}
+
+/*
+  search_speedup <depth>, searches the current position with ybwc_search on one thread and on the
+  shared thread pool, and reports how much faster the pool is.
+*/
+void CLI::process_command_search_speedup(std::vector<std::string> args)
+{
+  if (args.size() != 2)
+  {
+    std::cout << "Usage: search_speedup <depth>" << std::endl;
+    return;
+  }
+  // std::stoul would wrap a negative depth around to a huge one
+  long long requested_depth = 0;
+  try
+  {
+    requested_depth = std::stoll(args.at(1));
+  }
+  catch (const std::exception &e)
+  {
+    std::cout << "Invalid depth: " << args.at(1) << std::endl
+              << "Usage: search_speedup <depth>" << std::endl;
+    return;
+  }
+  if (requested_depth < 1)
+  {
+    std::cout << "Depth must be at least 1" << std::endl;
+    return;
+  }
+  depth max_depth = requested_depth;
+
+  SearchStats single_stats;
+  SearchStats pool_stats;
+  Eval single_eval = [&]()
+  {
+    ThreadPool single_thread(1);
+    return ybwc_search(m_engine.m_current_position, max_depth, single_thread, &single_stats);
+  }();
+  Eval pool_eval = ybwc_search(m_engine.m_current_position, max_depth, shared_thread_pool(), &pool_stats);
+
+  for (auto stats : {std::make_pair(&single_eval, &single_stats), std::make_pair(&pool_eval, &pool_stats)})
+  {
+    std::cout << "threads: " << stats.second->m_threads
+              << " move: " << stats.first->lan_move()
+              << " score: " << stats.first->m_score
+              << " nodes: " << stats.second->m_nodes
+              << " split points: " << stats.second->m_split_points
+              << " time: " << std::chrono::duration_cast<std::chrono::milliseconds>(stats.second->m_time).count() << " ms"
+              << " nps: " << (uint64_t)stats.second->nodes_per_second() << std::endl;
+  }
+  std::cout << "speedup: " << (double)single_stats.m_time.count() / std::max<int64_t>(1, pool_stats.m_time.count()) << std::endl;
+}
+
 void CLI::process_command(std::string command)
 {
   std::vector<std::string> args;
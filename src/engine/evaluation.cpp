@@ -24,7 +24,7 @@ int basic_material_for_piece(piece_t piece)
 }
 
 struct PositionEval
-count_material(std::shared_ptr<Position> position)
+count_material(const Position &position)
 {
     PositionEval eval;
     square_t square = 0;
@@ -35,7 +35,7 @@ count_material(std::shared_ptr<Position> position)
             square += 8;
             continue;
         }
-        piece_t piece = position->m_mailbox[square];
+        piece_t piece = position.m_mailbox[square];
         if (piece == VOID_PIECE)
         {
             square++;
@@ -58,23 +58,42 @@ count_material(std::shared_ptr<Position> position)
     return eval;
 }
 
+struct PositionEval
+count_material(std::shared_ptr<Position> position)
+{
+    return count_material(*position);
+}
+
 // LASTLEFTOFF
 // need to encode checkmate, king safety, number of squares being controlled, into evaluation
 
 // returns true if the player whose turn it is just got mated
-bool is_checkmate(std::shared_ptr<Position> position)
+static bool is_checkmate(Position &position)
 {
-    return position->is_king_in_check(position->m_whites_turn) &&
-           get_all_moves(position).size() == 0;
+    if (!position.is_king_in_check(position.m_whites_turn))
+    {
+        return false;
+    }
+    // evaluated at every leaf of a search, so the moves go to the arena
+    SearchArena &arena = thread_search_arena();
+    SearchArena::Scope arena_scope(arena);
+    MoveList moves = make_move_list(arena);
+    get_all_moves(position, &moves);
+    return moves.empty();
 }
 
 // negative is good for black, positive is good for white
-int evaluate(std::shared_ptr<Position> position)
+int evaluate(Position &position)
 {
     if (is_checkmate(position))
     {
-        return position->m_whites_turn ? std::numeric_limits<int>::min() : std::numeric_limits<int>::max();
+        return position.m_whites_turn ? std::numeric_limits<int>::min() : std::numeric_limits<int>::max();
     }
     auto material_eval = count_material(position);
     return material_eval.white_material - material_eval.black_material;
 }
+
+int evaluate(std::shared_ptr<Position> position)
+{
+    return evaluate(*position);
+}
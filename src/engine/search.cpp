@@ -4,6 +4,9 @@
 #include "representation/position.hpp"
 #include "move_generation.hpp"
 #include "tablebase/zobrist.hpp"
+#include <atomic>
+#include <climits>
+#include <mutex>
 #include <set>
 
 /*
@@ -14,38 +17,40 @@
         is then pushed back onto the eval stack, because the result of minmaxing the moves
         is then used for this node (i.e. e2e4 is evaluated by the minmax of the possible moves after e2e4)
 */
-void consolidate_eval_stack(std::vector<std::shared_ptr<Eval>> *eval_stack,
+void consolidate_eval_stack(EvalStack *eval_stack,
                             depth current_position_depth, bool whites_turn,
                             MoveKey origin_movekey)
 {
-    std::shared_ptr<Eval> min_eval;
-    std::shared_ptr<Eval> max_eval;
+    bool found = false;
+    Eval min_eval(0, 0, 0);
+    Eval max_eval(0, 0, 0);
     while (!eval_stack->empty()
-               ? (current_position_depth == eval_stack->back()->m_resultant_position_depth - 1)
+               ? (current_position_depth == eval_stack->back().m_resultant_position_depth - 1)
                : false)
     {
-        auto eval = eval_stack->back();
+        Eval eval = eval_stack->back();
         eval_stack->pop_back();
 
-        if (min_eval == NULL && max_eval == NULL)
+        if (!found)
         {
             min_eval = eval;
             max_eval = eval;
+            found = true;
         }
-        else if (eval->m_score < min_eval->m_score)
+        else if (eval.m_score < min_eval.m_score)
         {
             min_eval = eval;
         }
-        else if (eval->m_score > max_eval->m_score)
+        else if (eval.m_score > max_eval.m_score)
         {
             max_eval = eval;
         }
     }
-    if (min_eval != NULL && max_eval != NULL)
+    if (found)
     {
-        Eval *eval = whites_turn ? max_eval.get() : min_eval.get();
-        eval_stack->push_back(std::make_shared<Eval>(
-            Eval(eval->m_score, origin_movekey != 0 ? origin_movekey : eval->m_movekey, eval->m_resultant_position_depth - 1)));
+        Eval &eval = whites_turn ? max_eval : min_eval;
+        eval_stack->push_back(
+            Eval(eval.m_score, origin_movekey != 0 ? origin_movekey : eval.m_movekey, eval.m_resultant_position_depth - 1));
     }
 }
 
@@ -55,24 +60,34 @@ minmax_search(std::shared_ptr<Position> position, depth max_depth)
 {
     // depth of the position we start search from is 0.
     // depth of a move = depth of position in which it was made.
-    std::set<z_hash_t> unique_positions;
     z_hash_t starting_hash = zobrist_hash(position.get());
 
     size_t current_position_depth = 0;
 
     long nodes_visited = 0;
 
+    // The stacks live in the arena, and are reserved for the most they can hold, so
+    // that the search doesn't allocate from the heap. Every depth adds at most the moves
+    // of one position to the move stack, and the evals of one position's moves to the
+    // eval stack.
+    SearchArena &arena = thread_search_arena();
+    SearchArena::Scope arena_scope(arena);
+
     // the move_stack consists of <depth, movekey>.
-    std::vector<std::pair<depth, MoveKey>> move_stack;
-    std::vector<PositionAdjustment> adjustment_stack;
-    std::vector<std::shared_ptr<Eval>> eval_stack;
+    std::vector<std::pair<depth, MoveKey>, ArenaAllocator<std::pair<depth, MoveKey>>> move_stack{
+        ArenaAllocator<std::pair<depth, MoveKey>>(arena)};
+    std::vector<PositionAdjustment, ArenaAllocator<PositionAdjustment>> adjustment_stack{
+        ArenaAllocator<PositionAdjustment>(arena)};
+    EvalStack eval_stack{ArenaAllocator<Eval>(arena)};
+    MoveList node_moves = make_move_list(arena);
 
-    move_stack.reserve(max_depth * 50);
-    adjustment_stack.reserve(max_depth);
+    move_stack.reserve((max_depth + 1) * MAX_MOVES);
+    adjustment_stack.reserve(max_depth + 1);
+    eval_stack.reserve((max_depth + 1) * MAX_MOVES);
 
     // initialize stack of moves
-    auto starting_moves = get_all_moves(position);
-    for (auto it = starting_moves.begin(); it != starting_moves.end(); it++)
+    get_all_moves(*position, &node_moves);
+    for (auto it = node_moves.begin(); it != node_moves.end(); it++)
     {
         move_stack.push_back(std::make_pair(current_position_depth, *it));
     }
@@ -82,10 +97,8 @@ minmax_search(std::shared_ptr<Position> position, depth max_depth)
         auto pair = move_stack.back();
         depth move_depth = pair.first;
         MoveKey movekey = pair.second;
-        std::string lanmove = movekey_to_lan(movekey);
         move_stack.pop_back();
 
-        unique_positions.insert(zobrist_hash(position.get()));
         nodes_visited++;
 
         // if the move we popped off isnt at the same depth as us
@@ -109,7 +122,8 @@ minmax_search(std::shared_ptr<Position> position, depth max_depth)
         // if not at the leaf yet, go deeper
         if (current_position_depth < max_depth)
         {
-            std::vector<MoveKey> node_moves = get_all_moves(position);
+            node_moves.clear();
+            get_all_moves(*position, &node_moves);
             for (auto it = node_moves.begin(); it != node_moves.end(); it++)
                 move_stack.push_back(std::make_pair(current_position_depth, *it));
         }
@@ -117,8 +131,8 @@ minmax_search(std::shared_ptr<Position> position, depth max_depth)
         // if at the leaf, evaluate the position and store the result. parent nodes will minmax
         else
         {
-            int score = evaluate(position);
-            eval_stack.push_back(std::make_shared<Eval>(Eval(score, movekey, current_position_depth)));
+            int score = evaluate(*position);
+            eval_stack.push_back(Eval(score, movekey, current_position_depth));
         }
     }
 
@@ -141,7 +155,279 @@ minmax_search(std::shared_ptr<Position> position, depth max_depth)
 
     consolidate_eval_stack(&eval_stack, current_position_depth, position->m_whites_turn, 0);
     assert(eval_stack.size() == 1);
-    auto eval = eval_stack.back();
+    return eval_stack.back().m_movekey;
+}
 
-    return eval->m_movekey;
-}
\ No newline at end of file
+/*
+    Minmax score of position with remaining plies left to search, false if no line reaches
+    that deep. Moves are made on position and undone again, it is only used by one thread.
+*/
+static bool minmax_score(Position &position, depth remaining, int *score)
+{
+    if (remaining == 0)
+    {
+        *score = evaluate(position);
+        return true;
+    }
+
+    bool score_set = false;
+    SearchArena &arena = thread_search_arena();
+    SearchArena::Scope arena_scope(arena);
+    MoveList moves = make_move_list(arena);
+    get_all_moves(position, &moves);
+    for (auto it = moves.begin(); it != moves.end(); it++)
+    {
+        PositionAdjustment adjustment = position.advance_position(*it);
+        int move_score;
+        bool reached = minmax_score(position, remaining - 1, &move_score);
+        position.undo_adjustment(adjustment);
+
+        // strict comparisons, so the first of equally scored moves wins, like in minmax_search
+        if (reached && (!score_set || (position.m_whites_turn ? move_score > *score : move_score < *score)))
+        {
+            *score = move_score;
+            score_set = true;
+        }
+    }
+    return score_set;
+}
+
+std::vector<Eval> evaluate_root_moves(std::shared_ptr<Position> position, depth max_depth, ThreadPool &thread_pool)
+{
+    struct RootMove
+    {
+        MoveKey m_movekey;
+        bool m_reached;
+        int m_score;
+    };
+
+    std::vector<MoveKey> root_moves = get_all_moves(position);
+    std::vector<RootMove> results(root_moves.size());
+    {
+        WaitGroup search_tasks(thread_pool);
+        for (size_t i = 0; i < root_moves.size(); i++)
+        {
+            RootMove *result = &results[i];
+            result->m_movekey = root_moves[i];
+            std::shared_ptr<Position> root_position = std::make_shared<Position>(*position);
+            search_tasks.submit([result, root_position, max_depth]()
+                                {
+                                    root_position->advance_position(result->m_movekey);
+                                    result->m_reached = minmax_score(*root_position, max_depth - 1, &result->m_score);
+                                });
+        }
+        search_tasks.wait();
+    }
+
+    std::vector<Eval> evals;
+    for (auto it = results.begin(); it != results.end(); it++)
+    {
+        if (it->m_reached)
+        {
+            evals.push_back(Eval(it->m_score, it->m_movekey, 1));
+        }
+    }
+    return evals;
+}
+
+MoveKey
+root_parallel_search(std::shared_ptr<Position> position, depth max_depth, ThreadPool &thread_pool)
+{
+    assert(max_depth > 0);
+    std::vector<Eval> evals = evaluate_root_moves(position, max_depth, thread_pool);
+
+    MoveKey best_move = 0;
+    int best_score = 0;
+    for (auto it = evals.begin(); it != evals.end(); it++)
+    {
+        if (!best_move || (position->m_whites_turn ? it->m_score > best_score : it->m_score < best_score))
+        {
+            best_score = it->m_score;
+            best_move = it->m_movekey;
+        }
+    }
+    return best_move;
+}
+
+/*
+    The best move so far and the window of a node being searched by alpha-beta. Scores are from
+    white's point of view, white raises alpha and black lowers beta. For a split point, the state
+    is shared by the threads searching its moves.
+*/
+struct AlphaBetaNode
+{
+    bool m_maximize;
+    int m_alpha;
+    int m_beta;
+    bool m_reached = false;
+    int m_score = 0;
+    MoveKey m_best_move = 0;
+
+    AlphaBetaNode(bool maximize, int alpha, int beta) : m_maximize(maximize), m_alpha(alpha), m_beta(beta) {}
+
+    // true if the rest of the moves can be skipped
+    bool update(int score, MoveKey movekey)
+    {
+        if (!m_reached || (m_maximize ? score > m_score : score < m_score))
+        {
+            m_reached = true;
+            m_score = score;
+            m_best_move = movekey;
+        }
+        if (m_maximize)
+        {
+            m_alpha = std::max(m_alpha, m_score);
+        }
+        else
+        {
+            m_beta = std::min(m_beta, m_score);
+        }
+        return m_alpha >= m_beta;
+    }
+};
+
+struct SplitPoint
+{
+    SplitPoint *m_parent;
+    std::mutex m_mutex;
+    AlphaBetaNode m_node;
+    std::atomic<bool> m_cutoff = false;
+
+    SplitPoint(SplitPoint *parent, AlphaBetaNode node) : m_parent(parent), m_node(node) {}
+
+    // a cutoff here or at a split point above makes the search below useless
+    bool aborted()
+    {
+        for (SplitPoint *split_point = this; split_point != NULL; split_point = split_point->m_parent)
+        {
+            if (split_point->m_cutoff.load(std::memory_order_relaxed))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+struct YbwcContext
+{
+    ThreadPool &m_thread_pool;
+    std::atomic<uint64_t> m_nodes = 0;
+    std::atomic<uint64_t> m_split_points = 0;
+
+    YbwcContext(ThreadPool &thread_pool) : m_thread_pool(thread_pool) {}
+};
+
+/*
+    Fills node with the result of searching position with remaining plies left. False if no line
+    reaches that deep, or if the split point the search belongs to was aborted, in which case
+    the result is incomplete and is thrown away. Moves are made on position and undone again.
+*/
+static bool ybwc_alpha_beta(YbwcContext *context, SplitPoint *split_point, Position &position,
+                            depth remaining, AlphaBetaNode *node, uint64_t *nodes)
+{
+    (*nodes)++;
+    if (remaining == 0)
+    {
+        node->m_reached = true;
+        node->m_score = evaluate(position);
+        return true;
+    }
+
+    // stays valid while the brothers are searched, the tasks this thread runs meanwhile rewind
+    // the arena only as far as they allocated
+    SearchArena &arena = thread_search_arena();
+    SearchArena::Scope arena_scope(arena);
+    MoveList moves = make_move_list(arena);
+    get_all_moves(position, &moves);
+    auto it = moves.begin();
+    for (; it != moves.end(); it++)
+    {
+        if (split_point != NULL && split_point->aborted())
+        {
+            return false;
+        }
+
+        AlphaBetaNode child(!node->m_maximize, node->m_alpha, node->m_beta);
+        PositionAdjustment adjustment = position.advance_position(*it);
+        bool reached = ybwc_alpha_beta(context, split_point, position, remaining - 1, &child, nodes);
+        position.undo_adjustment(adjustment);
+
+        if (reached && node->update(child.m_score, *it))
+        {
+            return !(split_point != NULL && split_point->aborted());
+        }
+        // the young brothers wait for the eldest, the first move that reached the depth
+        if (node->m_reached && remaining >= YBWC_MIN_SPLIT_DEPTH)
+        {
+            it++;
+            break;
+        }
+    }
+    if (it == moves.end())
+    {
+        return node->m_reached && !(split_point != NULL && split_point->aborted());
+    }
+
+    // The owner waits here until all the brothers are done, so position stays as it is
+    // while the tasks copy it.
+    context->m_split_points++;
+    SplitPoint split(split_point, *node);
+    {
+        WaitGroup brothers(context->m_thread_pool);
+        for (; it != moves.end(); it++)
+        {
+            MoveKey movekey = *it;
+            brothers.submit([context, &split, &position, movekey, remaining]()
+                            {
+                                if (split.aborted())
+                                {
+                                    return;
+                                }
+                                AlphaBetaNode child(false, 0, 0);
+                                {
+                                    std::unique_lock<std::mutex> lock(split.m_mutex);
+                                    child = AlphaBetaNode(!split.m_node.m_maximize, split.m_node.m_alpha, split.m_node.m_beta);
+                                }
+                                Position brother_position = position;
+                                brother_position.advance_position(movekey);
+                                uint64_t brother_nodes = 0;
+                                bool reached = ybwc_alpha_beta(context, &split, brother_position, remaining - 1, &child, &brother_nodes);
+                                context->m_nodes += brother_nodes;
+
+                                std::unique_lock<std::mutex> lock(split.m_mutex);
+                                if (reached && split.m_node.update(child.m_score, movekey))
+                                {
+                                    split.m_cutoff = true;
+                                }
+                            });
+        }
+        brothers.wait();
+    }
+
+    *node = split.m_node;
+    return node->m_reached && !(split_point != NULL && split_point->aborted());
+}
+
+Eval ybwc_search(std::shared_ptr<Position> position, depth max_depth, ThreadPool &thread_pool, SearchStats *stats)
+{
+    assert(max_depth > 0);
+    auto clock_start = std::chrono::steady_clock::now();
+
+    // the tasks copy positions from the search, which mustn't be the caller's
+    Position root_position = *position;
+    YbwcContext context(thread_pool);
+    AlphaBetaNode root(root_position.m_whites_turn, INT_MIN, INT_MAX);
+    uint64_t nodes = 0;
+    ybwc_alpha_beta(&context, NULL, root_position, max_depth, &root, &nodes);
+    context.m_nodes += nodes;
+
+    if (stats != NULL)
+    {
+        stats->m_nodes = context.m_nodes;
+        stats->m_split_points = context.m_split_points;
+        stats->m_threads = thread_pool.size();
+        stats->m_time = std::chrono::steady_clock::now() - clock_start;
+    }
+    return Eval(root.m_score, root.m_best_move, 1);
+}
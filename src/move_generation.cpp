@@ -7,8 +7,6 @@
 
 /** Pseudolegal moves don't take check into account. */
 
-// TODO ensure that king cannot castle in check, and cannot pass through check
-
 bool Position::is_move_legal(square_t src_square, square_t dst_square)
 {
   auto adjustment = advance_position(src_square, dst_square);
@@ -17,95 +15,88 @@ bool Position::is_move_legal(square_t src_square, square_t dst_square)
   return legal;
 }
 
-template <Color C>
-std::vector<MoveKey>
-generate_pseudolegal_pawn_moves(std::shared_ptr<Position> position,
-                                square_t src_square)
+template <Color C, typename Moves>
+void generate_pseudolegal_pawn_moves(Position &position, square_t src_square, Moves *moves)
 {
 
   assert(is_valid_square(src_square));
-  assert(position->m_mailbox[src_square] == PAWN_C(C));
+  assert(position.m_mailbox[src_square] == PAWN_C(C));
 
   square_t candidate_square;
-  std::vector<MoveKey> moves;
 
   // check square in front
   candidate_square = FORWARD_RANK(C, src_square);
-  if (is_valid_square(candidate_square) && is_empty(position->m_mailbox[candidate_square]))
+  if (is_valid_square(candidate_square) && is_empty(position.m_mailbox[candidate_square]))
   {
 
     // if this square is the last rank, then we must promote
     if (IN_LAST_PAWN_RANK_C(C, candidate_square))
     {
-      moves.push_back(pack_move_key(src_square, candidate_square, QUEEN_C(C)));
-      moves.push_back(pack_move_key(src_square, candidate_square, BISHOP_C(C)));
-      moves.push_back(pack_move_key(src_square, candidate_square, KNIGHT_C(C)));
-      moves.push_back(pack_move_key(src_square, candidate_square, ROOK_C(C)));
+      moves->push_back(pack_move_key(src_square, candidate_square, QUEEN_C(C)));
+      moves->push_back(pack_move_key(src_square, candidate_square, BISHOP_C(C)));
+      moves->push_back(pack_move_key(src_square, candidate_square, KNIGHT_C(C)));
+      moves->push_back(pack_move_key(src_square, candidate_square, ROOK_C(C)));
     }
     // otherwise just move to that rank
     else
     {
-      moves.push_back(pack_move_key(src_square, candidate_square));
+      moves->push_back(pack_move_key(src_square, candidate_square));
     }
 
     // if square in front is empty, and we're on second rank, we can move two
     // squares
     candidate_square = FORWARD_RANK(C, candidate_square);
     if (IN_START_PAWN_RANK(C, src_square) && is_valid_square(candidate_square) &&
-        position->m_mailbox[candidate_square] == VOID_PIECE)
+        position.m_mailbox[candidate_square] == VOID_PIECE)
     {
-      moves.push_back(pack_move_key(src_square, candidate_square));
+      moves->push_back(pack_move_key(src_square, candidate_square));
     }
   }
 
   // check diagonals for capture
   candidate_square = PREV_FILE(FORWARD_RANK(C, src_square));
   if (is_valid_square(candidate_square) &&
-      (IS_OPPONENT_PIECE(C, position->m_mailbox[candidate_square]) || position->m_en_passant_square == candidate_square))
+      (IS_OPPONENT_PIECE(C, position.m_mailbox[candidate_square]) || position.m_en_passant_square == candidate_square))
   {
     // if this square is the last rank, then we must promote
     if (IN_LAST_PAWN_RANK_C(C, candidate_square))
     {
-      moves.push_back(pack_move_key(src_square, candidate_square, QUEEN_C(C)));
-      moves.push_back(pack_move_key(src_square, candidate_square, BISHOP_C(C)));
-      moves.push_back(pack_move_key(src_square, candidate_square, KNIGHT_C(C)));
-      moves.push_back(pack_move_key(src_square, candidate_square, ROOK_C(C)));
+      moves->push_back(pack_move_key(src_square, candidate_square, QUEEN_C(C)));
+      moves->push_back(pack_move_key(src_square, candidate_square, BISHOP_C(C)));
+      moves->push_back(pack_move_key(src_square, candidate_square, KNIGHT_C(C)));
+      moves->push_back(pack_move_key(src_square, candidate_square, ROOK_C(C)));
     }
     else
     {
-      moves.push_back(pack_move_key(src_square, candidate_square));
+      moves->push_back(pack_move_key(src_square, candidate_square));
     }
   }
 
   candidate_square = NEXT_FILE(FORWARD_RANK(C, src_square));
   if (is_valid_square(candidate_square) &&
-      (IS_OPPONENT_PIECE(C, position->m_mailbox[candidate_square]) || position->m_en_passant_square == candidate_square))
+      (IS_OPPONENT_PIECE(C, position.m_mailbox[candidate_square]) || position.m_en_passant_square == candidate_square))
   {
     // if this square is the last rank, then we must promote
     if (IN_LAST_PAWN_RANK_C(C, candidate_square))
     {
-      moves.push_back(pack_move_key(src_square, candidate_square, QUEEN_C(C)));
-      moves.push_back(pack_move_key(src_square, candidate_square, BISHOP_C(C)));
-      moves.push_back(pack_move_key(src_square, candidate_square, KNIGHT_C(C)));
-      moves.push_back(pack_move_key(src_square, candidate_square, ROOK_C(C)));
+      moves->push_back(pack_move_key(src_square, candidate_square, QUEEN_C(C)));
+      moves->push_back(pack_move_key(src_square, candidate_square, BISHOP_C(C)));
+      moves->push_back(pack_move_key(src_square, candidate_square, KNIGHT_C(C)));
+      moves->push_back(pack_move_key(src_square, candidate_square, ROOK_C(C)));
     }
     else
     {
-      moves.push_back(pack_move_key(src_square, candidate_square));
+      moves->push_back(pack_move_key(src_square, candidate_square));
     }
   }
-
-  return moves;
 }
 
-template <Color C>
-std::vector<MoveKey>
-generate_pseudolegal_king_moves(std::shared_ptr<Position> position,
-                                square_t src_square)
+template <Color C, typename Moves>
+void generate_pseudolegal_king_moves(Position &position, square_t src_square, Moves *moves)
 {
 
   assert(is_valid_square(src_square));
-  assert(position->m_mailbox[src_square] == KING_C(C));
+  assert(position.m_mailbox[src_square] == KING_C(C));
 
   square_t candidates[8] = {
       NEXT_RANK(PREV_FILE(src_square)),
@@ -119,65 +110,61 @@ generate_pseudolegal_king_moves(std::shared_ptr<Position> position,
       PREV_RANK(src_square),
       PREV_RANK(NEXT_FILE(src_square)),
   };
-  std::vector<MoveKey> moves;
 
   for (int i = 0; i < 8; i++)
   {
     square_t candidate_square = candidates[i];
-    piece_t piece = position->m_mailbox[candidate_square];
-    if (is_valid_square(candidate_square) && (!IS_YOUR_PIECE(C, piece)))
+    // off the board squares can be past the end of the mailbox
+    if (is_valid_square(candidate_square) && !IS_YOUR_PIECE(C, position.m_mailbox[candidate_square]))
     {
-      moves.push_back(pack_move_key(src_square, candidate_square));
+      moves->push_back(pack_move_key(src_square, candidate_square));
     }
   }
-  auto castling_moves =
-      generate_pseudolegal_castling_king_moves<C>(position, src_square);
-  moves.insert(moves.end(), castling_moves.begin(), castling_moves.end());
-  return moves;
+  generate_pseudolegal_castling_king_moves<C>(position, src_square, moves);
 }
 
-#define KINGSIDE_CASTLE_C(C, position)             \
-  (is_white(C) ? position->m_white_kingside_castle \
-               : position->m_black_kingside_castle)
-#define QUEENSIDE_CASTLE_C(C, position)             \
-  (is_white(C) ? position->m_white_queenside_castle \
-               : position->m_black_queenside_castle)
+#define KINGSIDE_CASTLE_C(C, position)            \
+  (is_white(C) ? position.m_white_kingside_castle \
+               : position.m_black_kingside_castle)
+#define QUEENSIDE_CASTLE_C(C, position)            \
+  (is_white(C) ? position.m_white_queenside_castle \
+               : position.m_black_queenside_castle)
 
-template <Color C>
-std::vector<MoveKey>
-generate_pseudolegal_castling_king_moves(std::shared_ptr<Position> position,
-                                         square_t src_square)
+template <Color C, typename Moves>
+void generate_pseudolegal_castling_king_moves(Position &position, square_t src_square, Moves *moves)
 {
   /** Assumes that position's castling booleans are correct. That is, king moves
-   * and rook moves should immediately unset the respective castling boolean. */
-  std::vector<MoveKey> moves;
-  if (KINGSIDE_CASTLE_C(C, position) &&
-      is_empty(position->m_mailbox[KING_KNIGHT_SQUARE_C(C)]) &&
-      is_empty(position->m_mailbox[KING_BISHOP_SQUARE_C(C)]))
+   * and rook moves should immediately unset the respective castling boolean.
+   * Unlike the other pseudolegal moves, the king can't castle out of or through
+   * check. Whether it lands in check is left to the legality check of all moves. */
+  bool castling_allowed = (KINGSIDE_CASTLE_C(C, position) || QUEENSIDE_CASTLE_C(C, position)) &&
+                          !position.is_king_in_check(is_white(C));
+  if (castling_allowed && KINGSIDE_CASTLE_C(C, position) &&
+      is_empty(position.m_mailbox[KING_KNIGHT_SQUARE_C(C)]) &&
+      is_empty(position.m_mailbox[KING_BISHOP_SQUARE_C(C)]) &&
+      position.is_move_legal(src_square, KING_BISHOP_SQUARE_C(C)))
   {
-    assert(position->m_mailbox[KING_SQUARE_C(C)] == KING_C(C));
-    assert(position->m_mailbox[KING_ROOK_SQUARE_C(C)] == ROOK_C(C));
-    moves.push_back(pack_move_key(src_square, KING_SHORT_CASTLE_SQUARE_C(C)));
+    assert(position.m_mailbox[KING_SQUARE_C(C)] == KING_C(C));
+    assert(position.m_mailbox[KING_ROOK_SQUARE_C(C)] == ROOK_C(C));
+    moves->push_back(pack_move_key(src_square, KING_SHORT_CASTLE_SQUARE_C(C)));
   }
-  if (QUEENSIDE_CASTLE_C(C, position) &&
-      is_empty(position->m_mailbox[QUEEN_KNIGHT_SQUARE_C(C)]) &&
-      is_empty(position->m_mailbox[QUEEN_SQUARE_C(C)]) &&
-      is_empty(position->m_mailbox[QUEEN_BISHOP_SQUARE_C(C)]))
+  if (castling_allowed && QUEENSIDE_CASTLE_C(C, position) &&
+      is_empty(position.m_mailbox[QUEEN_KNIGHT_SQUARE_C(C)]) &&
+      is_empty(position.m_mailbox[QUEEN_SQUARE_C(C)]) &&
+      is_empty(position.m_mailbox[QUEEN_BISHOP_SQUARE_C(C)]) &&
+      position.is_move_legal(src_square, QUEEN_SQUARE_C(C)))
   {
-    assert(position->m_mailbox[KING_SQUARE_C(C)] == KING_C(C));
-    assert(position->m_mailbox[QUEEN_ROOK_SQUARE_C(C)] == ROOK_C(C));
-    moves.push_back(pack_move_key(src_square, KING_LONG_CASTLE_SQUARE_C(C)));
+    assert(position.m_mailbox[KING_SQUARE_C(C)] == KING_C(C));
+    assert(position.m_mailbox[QUEEN_ROOK_SQUARE_C(C)] == ROOK_C(C));
+    moves->push_back(pack_move_key(src_square, KING_LONG_CASTLE_SQUARE_C(C)));
   }
-  return moves;
 }
 
-template <Color C>
-std::vector<MoveKey>
-generate_pseudolegal_knight_moves(std::shared_ptr<Position> position,
-                                  square_t src_square)
+template <Color C, typename Moves>
+void generate_pseudolegal_knight_moves(Position &position, square_t src_square, Moves *moves)
 {
   assert(is_valid_square(src_square));
-  assert(position->m_mailbox[src_square] == KNIGHT_C(C));
+  assert(position.m_mailbox[src_square] == KNIGHT_C(C));
 
   square_t candidates[8] = {
       NEXT_RANK(PREV_FILE(PREV_FILE(src_square))),
@@ -192,29 +179,26 @@ generate_pseudolegal_knight_moves(std::shared_ptr<Position> position,
       PREV_RANK(NEXT_FILE(NEXT_FILE(src_square))),
       PREV_RANK(PREV_RANK(NEXT_FILE(src_square))),
   };
-  std::vector<MoveKey> moves;
 
   for (int i = 0; i < 8; i++)
   {
     square_t candidate_square = candidates[i];
-    piece_t piece = position->m_mailbox[candidate_square];
-    if (is_valid_square(candidate_square) && !IS_YOUR_PIECE(C, piece))
+    if (is_valid_square(candidate_square) && !IS_YOUR_PIECE(C, position.m_mailbox[candidate_square]))
     {
-      moves.push_back(pack_move_key(src_square, candidate_square));
+      moves->push_back(pack_move_key(src_square, candidate_square));
     }
   }
-  return moves;
 }
 
-template <Direction D, Color C>
-inline void sliding_piece_walk(std::vector<MoveKey> *moves, square_t src_square,
-                               std::shared_ptr<Position> position)
+template <Direction D, Color C, typename Moves>
+inline void sliding_piece_walk(Moves *moves, square_t src_square,
+                               Position &position)
 {
 
   square_t candidate_square = STEP_DIRECTION(D, src_square);
   while (is_valid_square(candidate_square))
   {
-    piece_t piece = position->m_mailbox[candidate_square];
+    piece_t piece = position.m_mailbox[candidate_square];
     if (IS_OPPONENT_PIECE(C, piece))
     {
       moves->push_back(pack_move_key(src_square, candidate_square));
@@ -229,141 +213,204 @@ inline void sliding_piece_walk(std::vector<MoveKey> *moves, square_t src_square,
   }
 }
 
-template <Color C>
-std::vector<MoveKey>
-generate_pseudolegal_rook_moves(std::shared_ptr<Position> position,
-                                square_t square)
+template <Color C, typename Moves>
+void generate_pseudolegal_rook_moves(Position &position, square_t square, Moves *moves)
 {
 
   assert(is_valid_square(square));
-  std::vector<MoveKey> moves;
 
-  sliding_piece_walk<Direction::UP, C>(&moves, square, position);
-  sliding_piece_walk<Direction::DOWN, C>(&moves, square, position);
-  sliding_piece_walk<Direction::RIGHT, C>(&moves, square, position);
-  sliding_piece_walk<Direction::LEFT, C>(&moves, square, position);
-
-  return moves;
+  sliding_piece_walk<Direction::UP, C>(moves, square, position);
+  sliding_piece_walk<Direction::DOWN, C>(moves, square, position);
+  sliding_piece_walk<Direction::RIGHT, C>(moves, square, position);
+  sliding_piece_walk<Direction::LEFT, C>(moves, square, position);
 }
 
-template <Color C>
-std::vector<MoveKey>
-generate_pseudolegal_bishop_moves(std::shared_ptr<Position> position,
-                                  square_t src_square)
+template <Color C, typename Moves>
+void generate_pseudolegal_bishop_moves(Position &position, square_t src_square, Moves *moves)
 {
   assert(is_valid_square(src_square));
-  std::vector<MoveKey> moves;
-
-  sliding_piece_walk<Direction::UPLEFT, C>(&moves, src_square, position);
-  sliding_piece_walk<Direction::DOWNLEFT, C>(&moves, src_square, position);
-  sliding_piece_walk<Direction::UPRIGHT, C>(&moves, src_square, position);
-  sliding_piece_walk<Direction::DOWNRIGHT, C>(&moves, src_square, position);
 
-  return moves;
+  sliding_piece_walk<Direction::UPLEFT, C>(moves, src_square, position);
+  sliding_piece_walk<Direction::DOWNLEFT, C>(moves, src_square, position);
+  sliding_piece_walk<Direction::UPRIGHT, C>(moves, src_square, position);
+  sliding_piece_walk<Direction::DOWNRIGHT, C>(moves, src_square, position);
 }
 
-template <Color C>
-std::vector<MoveKey>
-generate_pseudolegal_queen_moves(std::shared_ptr<Position> position,
-                                 square_t src_square)
+template <Color C, typename Moves>
+void generate_pseudolegal_queen_moves(Position &position, square_t src_square, Moves *moves)
 {
   assert(is_valid_square(src_square));
-  assert(position->m_mailbox[src_square] == QUEEN_C(C));
-  std::vector<MoveKey> rook_moves;
-  std::vector<MoveKey> bishop_moves;
-
-  rook_moves = generate_pseudolegal_rook_moves<C>(position, src_square);
-  bishop_moves = generate_pseudolegal_bishop_moves<C>(position, src_square);
-  rook_moves.insert(rook_moves.end(), bishop_moves.begin(), bishop_moves.end());
+  assert(position.m_mailbox[src_square] == QUEEN_C(C));
 
-  return rook_moves;
+  generate_pseudolegal_rook_moves<C>(position, src_square, moves);
+  generate_pseudolegal_bishop_moves<C>(position, src_square, moves);
 }
 
-std::vector<MoveKey>
-generate_legal_moves(std::shared_ptr<Position> position,
-                     square_t src_square)
+template <Color C, typename Moves>
+void generate_pseudolegal_piece_moves(Position &position, square_t square, Moves *moves)
 {
+  uint8_t piece = position.m_mailbox[square];
+  switch (piece & PIECE_MASK)
+  {
+  case PAWN:
+    return generate_pseudolegal_pawn_moves<C>(position, square, moves);
+  case ROOK:
+    return generate_pseudolegal_rook_moves<C>(position, square, moves);
+  case KNIGHT:
+    return generate_pseudolegal_knight_moves<C>(position, square, moves);
+  case BISHOP:
+    return generate_pseudolegal_bishop_moves<C>(position, square, moves);
+  case QUEEN:
+    return generate_pseudolegal_queen_moves<C>(position, square, moves);
+  case KING:
+    return generate_pseudolegal_king_moves<C>(position, square, moves);
+  default:
+    __builtin_unreachable();
+  }
+}
 
-  // all possible moves (not taking discovered check into account)
-  auto moves = generate_pseudolegal_piece_moves(position, src_square);
-  std::vector<MoveKey> legal_moves;
+template <typename Moves>
+static void append_pseudolegal_piece_moves(Position &position, square_t src_square, Moves *moves)
+{
+  piece_t piece = position.m_mailbox[src_square];
+  return is_white_piece(piece)
+             ? generate_pseudolegal_piece_moves<Color::WHITE>(position, src_square, moves)
+             : generate_pseudolegal_piece_moves<Color::BLACK>(position, src_square, moves);
+}
 
-  // need to filter moves by legality
-  // naive way: for each move,  assume move, and check underlying position for legality
+/*
+  Appends the legal moves of the piece on src_square. The pseudolegal moves are appended first
+  and then filtered in place, so that no other list is needed.
+*/
+template <typename Moves>
+static void append_legal_moves(Position &position, square_t src_square, Moves *moves)
+{
+  size_t first = moves->size();
+  append_pseudolegal_piece_moves(position, src_square, moves);
 
-  // maybe en passant and promotion can be represented in the moves returned by pseudolegal move generation
-  // just returning squares makes it tricky to think about those two.
+  // easier to assume each move and check the resulting position for legality
+  size_t legal_end = first;
+  for (size_t i = first; i < moves->size(); i++)
+  {
+    if (position.is_move_legal(src_square, Move((*moves)[i]).m_dst_square))
+    {
+      (*moves)[legal_end++] = (*moves)[i];
+    }
+  }
+  moves->resize(legal_end);
+}
 
-  for (auto it = moves.begin(); it != moves.end(); it++)
+template <typename Moves>
+static void append_all_moves(Position &position, Moves *moves)
+{
+  Color c = position.m_whites_turn ? Color::WHITE : Color::BLACK;
+  square_t square = 0;
+  while (square <= H8_SQ)
   {
-    auto move = unpack_move_key(*it);
-    auto dst_square = move.m_dst_square;
+    if (is_invalid_square(square))
+    {
+      square += 8;
+    }
 
-    // easier to assume move and check for legality
-    if (position->is_move_legal(src_square, dst_square))
+    if (IS_YOUR_PIECE(c, position.m_mailbox[square]))
     {
-      legal_moves.push_back(*it);
+      append_legal_moves(position, square, moves);
     }
+    square++;
   }
-
-  return legal_moves;
 }
 
-template <Color C>
 std::vector<MoveKey>
-generate_pseudolegal_piece_moves(std::shared_ptr<Position> position,
-                                 square_t square)
+generate_pseudolegal_piece_moves(Position &position, square_t src_square)
 {
-  uint8_t piece = position->m_mailbox[square];
-  switch (piece & PIECE_MASK)
-  {
-  case PAWN:
-    return generate_pseudolegal_pawn_moves<C>(position, square);
-  case ROOK:
-    return generate_pseudolegal_rook_moves<C>(position, square);
-  case KNIGHT:
-    return generate_pseudolegal_knight_moves<C>(position, square);
-  case BISHOP:
-    return generate_pseudolegal_bishop_moves<C>(position, square);
-  case QUEEN:
-    return generate_pseudolegal_queen_moves<C>(position, square);
-  case KING:
-    return generate_pseudolegal_king_moves<C>(position, square);
-  default:
-    __builtin_unreachable();
-  }
+  std::vector<MoveKey> moves;
+  append_pseudolegal_piece_moves(position, src_square, &moves);
+  return moves;
 }
 
 std::vector<MoveKey>
 generate_pseudolegal_piece_moves(std::shared_ptr<Position> position,
                                  square_t src_square)
 {
-  piece_t piece = position->m_mailbox[src_square];
-  return is_white_piece(piece)
-             ? generate_pseudolegal_piece_moves<Color::WHITE>(position, src_square)
-             : generate_pseudolegal_piece_moves<Color::BLACK>(position, src_square);
+  return generate_pseudolegal_piece_moves(*position, src_square);
+}
+
+std::vector<MoveKey>
+generate_legal_moves(Position &position, square_t src_square)
+{
+  std::vector<MoveKey> moves;
+  append_legal_moves(position, src_square, &moves);
+  return moves;
+}
+
+std::vector<MoveKey>
+generate_legal_moves(std::shared_ptr<Position> position,
+                     square_t src_square)
+{
+  return generate_legal_moves(*position, src_square);
+}
+
+std::vector<MoveKey> get_all_moves(Position &position)
+{
+  std::vector<MoveKey> all_moves;
+  append_all_moves(position, &all_moves);
+  return all_moves;
 }
 
 std::vector<MoveKey> get_all_moves(std::shared_ptr<Position> position)
+{
+  return get_all_moves(*position);
+}
+
+void get_all_moves(Position &position, MoveList *moves)
+{
+  append_all_moves(position, moves);
+}
+
+void get_all_moves(std::shared_ptr<Position> position, MoveList *moves)
+{
+  append_all_moves(*position, moves);
+}
+
+MoveList make_move_list(SearchArena &arena)
+{
+  MoveList moves{ArenaAllocator<MoveKey>(arena)};
+  moves.reserve(MAX_MOVES);
+  return moves;
+}
+
+/*
+  Legal moves of the side to move that take a piece of the given type (PAWN, KNIGHT, ...)
+  to dst_square. Castling moves are not included.
+*/
+std::vector<MoveKey> generate_legal_moves_to_square(std::shared_ptr<Position> position,
+                                                    piece_t piece_type, square_t dst_square)
 {
   Color c = position->m_whites_turn ? Color::WHITE : Color::BLACK;
-  square_t square = 0;
-  std::vector<MoveKey> all_moves;
-  while (square <= H8_SQ)
+  std::vector<MoveKey> moves;
+  for (square_t square = 0; square <= H8_SQ; square++)
   {
     if (is_invalid_square(square))
     {
-      square += 8;
+      square += 7;
+      continue;
     }
 
-    if (IS_YOUR_PIECE(c, position->m_mailbox[square]))
+    piece_t piece = position->m_mailbox[square];
+    if (!IS_YOUR_PIECE(c, piece) || (piece & PIECE_MASK) != piece_type)
     {
-      auto moves = generate_legal_moves(position, square);
-      all_moves.insert(all_moves.end(), moves.begin(), moves.end());
+      continue;
+    }
+
+    for (MoveKey move_key : generate_pseudolegal_piece_moves(*position, square))
+    {
+      if (Move(move_key).m_dst_square == dst_square && position->is_move_legal(square, dst_square))
+      {
+        moves.push_back(move_key);
+      }
     }
-    square++;
   }
-  return all_moves;
+  return moves;
 }
 
 std::string string_list_all_moves(std::shared_ptr<Position> position)
@@ -378,49 +425,183 @@ std::string string_list_all_moves(std::shared_ptr<Position> position)
   return ss.str();
 }
 
-template std::vector<MoveKey> generate_pseudolegal_pawn_moves<Color::WHITE>(
-    std::shared_ptr<Position> position, square_t src_square);
+/*
+  Returns the standard algebraic notation (as it appears in PGN files) for a legal move
+  in the given position, including disambiguation and check/mate markers.
+*/
+std::string movekey_to_san(std::shared_ptr<Position> position, MoveKey movekey)
+{
+  Move move = unpack_move_key(movekey);
+  piece_t moving_piece = position->m_mailbox[move.m_src_square];
+  piece_t piece_type = moving_piece & PIECE_MASK;
+  bool whites_turn = position->m_whites_turn;
+  bool capture = is_piece(position->m_mailbox[move.m_dst_square]);
+  std::stringstream ss;
+
+  if (piece_type == KING && (move.m_src_square & 0x7) == 4 && (move.m_dst_square & 0x7) == 6)
+  {
+    ss << "O-O";
+  }
+  else if (piece_type == KING && (move.m_src_square & 0x7) == 4 && (move.m_dst_square & 0x7) == 2)
+  {
+    ss << "O-O-O";
+  }
+  else if (piece_type == PAWN)
+  {
+    capture = capture || move.m_dst_square == position->m_en_passant_square;
+    if (capture)
+    {
+      ss << index_to_an_file(move.m_src_square) << 'x';
+    }
+    ss << index_to_an_square(move.m_dst_square);
+    if (move.m_promotion_piece)
+    {
+      ss << '=' << PIECE_CHAR_MAP[move.m_promotion_piece & PIECE_MASK];
+    }
+  }
+  else
+  {
+    ss << PIECE_CHAR_MAP[piece_type];
+
+    std::vector<square_t> candidates;
+    switch (piece_type)
+    {
+    case KNIGHT:
+      candidates = find_attacking_knights(position.get(), move.m_dst_square, whites_turn);
+      break;
+    case BISHOP:
+      candidates = find_attacking_bishops(position.get(), move.m_dst_square, whites_turn);
+      break;
+    case ROOK:
+      candidates = find_attacking_rooks(position.get(), move.m_dst_square, whites_turn);
+      break;
+    case QUEEN:
+      candidates = find_attacking_queens(position.get(), move.m_dst_square, whites_turn);
+      break;
+    }
+
+    // other pieces of the same type that could legally have made this move
+    bool ambiguous = false;
+    bool same_file = false;
+    bool same_rank = false;
+    for (auto it = candidates.begin(); it != candidates.end(); it++)
+    {
+      if (*it == move.m_src_square || !position->is_move_legal(*it, move.m_dst_square))
+      {
+        continue;
+      }
+      ambiguous = true;
+      same_file |= index_to_an_file(*it) == index_to_an_file(move.m_src_square);
+      same_rank |= index_to_an_rank(*it) == index_to_an_rank(move.m_src_square);
+    }
+    if (ambiguous && (!same_file || same_rank))
+    {
+      ss << index_to_an_file(move.m_src_square);
+    }
+    if (ambiguous && same_file)
+    {
+      ss << index_to_an_rank(move.m_src_square);
+    }
+    if (capture)
+    {
+      ss << 'x';
+    }
+    ss << index_to_an_square(move.m_dst_square);
+  }
+
+  auto adjustment = position->advance_position(movekey);
+  if (position->is_king_in_check(position->m_whites_turn))
+  {
+    ss << (get_all_moves(position).empty() ? '#' : '+');
+  }
+  position->undo_adjustment(adjustment);
+
+  return ss.str();
+}
+
+template void generate_pseudolegal_pawn_moves<Color::WHITE>(
+    Position &position, square_t src_square, std::vector<MoveKey> *moves);
+
+template void generate_pseudolegal_pawn_moves<Color::BLACK>(
+    Position &position, square_t src_square, std::vector<MoveKey> *moves);
+
+template void generate_pseudolegal_pawn_moves<Color::WHITE>(
+    Position &position, square_t src_square, MoveList *moves);
+
+template void generate_pseudolegal_pawn_moves<Color::BLACK>(
+    Position &position, square_t src_square, MoveList *moves);
+
+template void generate_pseudolegal_king_moves<Color::WHITE>(
+    Position &position, square_t src_square, std::vector<MoveKey> *moves);
+
+template void generate_pseudolegal_king_moves<Color::BLACK>(
+    Position &position, square_t src_square, std::vector<MoveKey> *moves);
+
+template void generate_pseudolegal_king_moves<Color::WHITE>(
+    Position &position, square_t src_square, MoveList *moves);
+
+template void generate_pseudolegal_king_moves<Color::BLACK>(
+    Position &position, square_t src_square, MoveList *moves);
+
+template void generate_pseudolegal_castling_king_moves<Color::WHITE>(
+    Position &position, square_t src_square, std::vector<MoveKey> *moves);
+
+template void generate_pseudolegal_castling_king_moves<Color::BLACK>(
+    Position &position, square_t src_square, std::vector<MoveKey> *moves);
+
+template void generate_pseudolegal_castling_king_moves<Color::WHITE>(
+    Position &position, square_t src_square, MoveList *moves);
+
+template void generate_pseudolegal_castling_king_moves<Color::BLACK>(
+    Position &position, square_t src_square, MoveList *moves);
+
+template void generate_pseudolegal_rook_moves<Color::WHITE>(
+    Position &position, square_t src_square, std::vector<MoveKey> *moves);
+
+template void generate_pseudolegal_rook_moves<Color::BLACK>(
+    Position &position, square_t src_square, std::vector<MoveKey> *moves);
+
+template void generate_pseudolegal_rook_moves<Color::WHITE>(
+    Position &position, square_t src_square, MoveList *moves);
 
-template std::vector<MoveKey> generate_pseudolegal_pawn_moves<Color::BLACK>(
-    std::shared_ptr<Position> position, square_t src_square);
+template void generate_pseudolegal_rook_moves<Color::BLACK>(
+    Position &position, square_t src_square, MoveList *moves);
 
-template std::vector<MoveKey> generate_pseudolegal_king_moves<Color::WHITE>(
-    std::shared_ptr<Position> position, square_t src_square);
+template void generate_pseudolegal_bishop_moves<Color::WHITE>(
+    Position &position, square_t src_square, std::vector<MoveKey> *moves);
 
-template std::vector<MoveKey> generate_pseudolegal_king_moves<Color::BLACK>(
-    std::shared_ptr<Position> position, square_t src_square);
+template void generate_pseudolegal_bishop_moves<Color::BLACK>(
+    Position &position, square_t src_square, std::vector<MoveKey> *moves);
 
-template std::vector<MoveKey>
-generate_pseudolegal_castling_king_moves<Color::WHITE>(
-    std::shared_ptr<Position> position, square_t src_square);
+template void generate_pseudolegal_bishop_moves<Color::WHITE>(
+    Position &position, square_t src_square, MoveList *moves);
 
-template std::vector<MoveKey>
-generate_pseudolegal_castling_king_moves<Color::BLACK>(
-    std::shared_ptr<Position> position, square_t src_square);
+template void generate_pseudolegal_bishop_moves<Color::BLACK>(
+    Position &position, square_t src_square, MoveList *moves);
 
-template std::vector<MoveKey> generate_pseudolegal_rook_moves<Color::WHITE>(
-    std::shared_ptr<Position> position, square_t src_square);
+template void generate_pseudolegal_queen_moves<Color::WHITE>(
+    Position &position, square_t src_square, std::vector<MoveKey> *moves);
 
-template std::vector<MoveKey> generate_pseudolegal_rook_moves<Color::BLACK>(
-    std::shared_ptr<Position> position, square_t src_square);
+template void generate_pseudolegal_queen_moves<Color::BLACK>(
+    Position &position, square_t src_square, std::vector<MoveKey> *moves);
 
-template std::vector<MoveKey> generate_pseudolegal_bishop_moves<Color::WHITE>(
-    std::shared_ptr<Position> position, square_t src_square);
+template void generate_pseudolegal_queen_moves<Color::WHITE>(
+    Position &position, square_t src_square, MoveList *moves);
 
-template std::vector<MoveKey> generate_pseudolegal_bishop_moves<Color::BLACK>(
-    std::shared_ptr<Position> position, square_t src_square);
+template void generate_pseudolegal_queen_moves<Color::BLACK>(
+    Position &position, square_t src_square, MoveList *moves);
 
-template std::vector<MoveKey> generate_pseudolegal_queen_moves<Color::WHITE>(
-    std::shared_ptr<Position> position, square_t src_square);
+template void generate_pseudolegal_piece_moves<Color::WHITE>(
+    Position &position, square_t src_square, std::vector<MoveKey> *moves);
 
-template std::vector<MoveKey> generate_pseudolegal_queen_moves<Color::BLACK>(
-    std::shared_ptr<Position> position, square_t src_square);
+template void generate_pseudolegal_piece_moves<Color::BLACK>(
+    Position &position, square_t src_square, std::vector<MoveKey> *moves);
 
-template std::vector<MoveKey> generate_pseudolegal_piece_moves<Color::WHITE>(
-    std::shared_ptr<Position> position, square_t src_square);
+template void generate_pseudolegal_piece_moves<Color::WHITE>(
+    Position &position, square_t src_square, MoveList *moves);
 
-template std::vector<MoveKey> generate_pseudolegal_piece_moves<Color::BLACK>(
-    std::shared_ptr<Position> position, square_t src_square);
+template void generate_pseudolegal_piece_moves<Color::BLACK>(
+    Position &position, square_t src_square, MoveList *moves);
 
 bool white_attacks_diagonally(piece_t piece)
 {
@@ -1,6 +1,9 @@
 #include "options.hpp"
+#include "threadpool/threadpool.hpp"
 #include "boost/format.hpp"
+#include <algorithm>
 #include <iostream>
+#include <thread>
 
 void announce_options()
 {
@@ -8,4 +11,37 @@ void announce_options()
                    "option name %1% type %2% default %3% min %4% max %5%") %
                    "Hash" % "spin" % "1" % "1" % "128"
             << std::endl;
+  std::cout << boost::format(
+                   "option name %1% type %2% default %3% min %4% max %5%") %
+                   "Threads" % "spin" % std::max(1u, std::thread::hardware_concurrency()) % "1" % MAX_THREADS
+            << std::endl;
+  std::cout << boost::format("option name %1% type %2% default %3%") %
+                   "ThreadAffinity" % "check" % "false"
+            << std::endl;
+}
+
+// Returns false if the option is unknown or the value is out of range.
+bool set_option(std::string name, std::string value)
+{
+  if (name.compare("Threads") == 0)
+  {
+    int threads = std::atoi(value.c_str());
+    if (threads < 1 || threads > MAX_THREADS)
+    {
+      return false;
+    }
+    set_shared_thread_pool_size(threads);
+    return true;
+  }
+  if (name.compare("ThreadAffinity") == 0)
+  {
+    // pins the shared pool's threads to one CPU each
+    if (value.compare("true") != 0 && value.compare("false") != 0)
+    {
+      return false;
+    }
+    set_shared_thread_pool_affinity(value.compare("true") == 0);
+    return true;
+  }
+  return false;
 }
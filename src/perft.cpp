@@ -0,0 +1,164 @@
+#include "perft.hpp"
+#include "move_generation.hpp"
+
+PerftTable::PerftTable(size_t size_mb)
+{
+  size_t entries = 1;
+  while (entries * 2 * sizeof(Entry) <= size_mb * 1024 * 1024)
+  {
+    entries *= 2;
+  }
+  m_entries = std::make_unique<Entry[]>(entries);
+  m_mask = entries - 1;
+  for (size_t i = 0; i < entries; i++)
+  {
+    m_entries[i].m_check.store(0, std::memory_order_relaxed);
+    m_entries[i].m_nodes.store(0, std::memory_order_relaxed);
+  }
+}
+
+bool PerftTable::probe(z_hash_t hash, int depth, uint64_t *nodes)
+{
+  uint64_t entry_key = key(hash, depth);
+  Entry &entry = m_entries[entry_key & m_mask];
+  uint64_t stored_nodes = entry.m_nodes.load(std::memory_order_relaxed);
+  if ((entry.m_check.load(std::memory_order_relaxed) ^ stored_nodes) != entry_key || !stored_nodes)
+  {
+    return false;
+  }
+  *nodes = stored_nodes;
+  return true;
+}
+
+void PerftTable::store(z_hash_t hash, int depth, uint64_t nodes)
+{
+  uint64_t entry_key = key(hash, depth);
+  Entry &entry = m_entries[entry_key & m_mask];
+  entry.m_check.store(entry_key ^ nodes, std::memory_order_relaxed);
+  entry.m_nodes.store(nodes, std::memory_order_relaxed);
+}
+
+/*
+  Counts the leaves with bulk counting: at depth 1 the number of legal moves is the number of
+  leaves, so the last ply isn't played. Positions at depth 1 aren't worth a table lookup.
+  Moves are made on position and undone again, the move lists are in the thread's arena.
+*/
+static uint64_t count_nodes(Position &position, int depth, PerftTable *table, uint64_t *table_hits)
+{
+  if (depth == 0)
+  {
+    return 1;
+  }
+
+  z_hash_t hash = 0;
+  if (table != NULL && depth > 1)
+  {
+    uint64_t nodes;
+    hash = zobrist_hash(&position);
+    if (table->probe(hash, depth, &nodes))
+    {
+      (*table_hits)++;
+      return nodes;
+    }
+  }
+
+  SearchArena &arena = thread_search_arena();
+  SearchArena::Scope arena_scope(arena);
+  MoveList moves = make_move_list(arena);
+  get_all_moves(position, &moves);
+  if (depth == 1)
+  {
+    return moves.size();
+  }
+
+  uint64_t nodes = 0;
+  for (auto it = moves.begin(); it != moves.end(); it++)
+  {
+    PositionAdjustment adjustment = position.advance_position(*it);
+    nodes += count_nodes(position, depth - 1, table, table_hits);
+    position.undo_adjustment(adjustment);
+  }
+
+  if (table != NULL)
+  {
+    table->store(hash, depth, nodes);
+  }
+  return nodes;
+}
+
+uint64_t perft(std::shared_ptr<Position> position, int depth, PerftTable *table)
+{
+  uint64_t table_hits = 0;
+  return count_nodes(*position, depth, table, &table_hits);
+}
+
+/*
+  The root has too few moves to keep many threads busy until the end, so from depth 3 on
+  every position after the first two plies is its own task (400 from the starting position).
+  The counts are added up in move generation order, so the result doesn't depend on the
+  order the tasks finish in.
+*/
+PerftResult parallel_perft(std::shared_ptr<Position> position, int depth, ThreadPool &thread_pool, PerftTable *table)
+{
+  auto clock_start = std::chrono::steady_clock::now();
+  PerftResult result;
+  result.m_threads = thread_pool.size();
+
+  if (depth == 0)
+  {
+    result.m_nodes = 1;
+    return result;
+  }
+
+  struct Subtree
+  {
+    size_t m_root_move;
+    Position m_position;
+    uint64_t m_nodes;
+    uint64_t m_table_hits;
+  };
+
+  int split_plies = depth >= 3 ? 2 : 1;
+  std::vector<Subtree> subtrees;
+  std::vector<MoveKey> root_moves = get_all_moves(*position);
+  for (size_t i = 0; i < root_moves.size(); i++)
+  {
+    result.m_divide.push_back(std::make_pair(root_moves[i], 0));
+    Position next_position = *position;
+    next_position.advance_position(root_moves[i]);
+
+    if (split_plies == 1)
+    {
+      subtrees.push_back(Subtree{i, next_position, 0, 0});
+      continue;
+    }
+    std::vector<MoveKey> replies = get_all_moves(next_position);
+    for (auto it = replies.begin(); it != replies.end(); it++)
+    {
+      Position reply_position = next_position;
+      reply_position.advance_position(*it);
+      subtrees.push_back(Subtree{i, reply_position, 0, 0});
+    }
+  }
+
+  {
+    WaitGroup perft_tasks(thread_pool);
+    for (auto it = subtrees.begin(); it != subtrees.end(); it++)
+    {
+      Subtree *subtree = &*it;
+      perft_tasks.submit([subtree, depth, split_plies, table]()
+                         { subtree->m_nodes = count_nodes(subtree->m_position, depth - split_plies,
+                                                          table, &subtree->m_table_hits); });
+    }
+    perft_tasks.wait();
+  }
+
+  for (auto it = subtrees.begin(); it != subtrees.end(); it++)
+  {
+    result.m_divide[it->m_root_move].second += it->m_nodes;
+    result.m_nodes += it->m_nodes;
+    result.m_table_hits += it->m_table_hits;
+  }
+  result.m_time = std::chrono::steady_clock::now() - clock_start;
+  return result;
+}
@@ -0,0 +1,147 @@
+#include "process_pgn/completed_files.hpp"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+static std::string record_key(fs::path pgn_file_path)
+{
+    return fs::absolute(pgn_file_path).lexically_normal().generic_string();
+}
+
+static int64_t file_mtime(fs::path pgn_file_path)
+{
+    return fs::last_write_time(pgn_file_path).time_since_epoch().count();
+}
+
+// FNV-1a over the first `size` bytes of the file.
+uint64_t checksum_file_prefix(fs::path file_path, uintmax_t size)
+{
+    const uint64_t fnv_offset_basis = 14695981039346656037ULL;
+    const uint64_t fnv_prime = 1099511628211ULL;
+
+    std::ifstream infile(file_path, std::ios::binary);
+    uint64_t hash = fnv_offset_basis;
+    char buffer[1 << 16];
+    uintmax_t remaining = size;
+
+    while (remaining > 0 && infile.good())
+    {
+        std::streamsize to_read = std::min<uintmax_t>(remaining, sizeof(buffer));
+        infile.read(buffer, to_read);
+        std::streamsize bytes_read = infile.gcount();
+        for (std::streamsize i = 0; i < bytes_read; i++)
+        {
+            hash ^= (uint8_t)buffer[i];
+            hash *= fnv_prime;
+        }
+        remaining -= bytes_read;
+        if (bytes_read == 0)
+        {
+            break;
+        }
+    }
+    return hash;
+}
+
+PgnFileRecord make_pgn_file_record(fs::path pgn_file_path, uintmax_t size)
+{
+    PgnFileRecord record;
+    record.m_size = size;
+    record.m_mtime = file_mtime(pgn_file_path);
+    record.m_checksum = checksum_file_prefix(pgn_file_path, size);
+    return record;
+}
+
+/*
+    One record per line, tab separated:
+    checksum    size    mtime    path
+    The path goes last so that it may contain whitespace.
+*/
+void CompletedFiles::read_from_file(fs::path file_path)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::ifstream infile(file_path);
+    if (!infile.is_open())
+    {
+        return;
+    }
+
+    for (std::string line; std::getline(infile, line);)
+    {
+        std::istringstream ss(line);
+        PgnFileRecord record;
+        std::string path;
+        if (ss >> record.m_checksum >> record.m_size >> record.m_mtime)
+        {
+            ss.ignore(1, '\t');
+            std::getline(ss, path);
+            m_records[path] = record;
+        }
+    }
+}
+
+void CompletedFiles::serialize(fs::path file_path)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::ofstream stream(file_path, std::ios::out | std::ios::trunc);
+
+    if (!stream.is_open())
+    {
+        std::cerr
+            << ColorCode::red << "Cannot open filestream to path: " << ColorCode::end << std::endl
+            << file_path << std::endl;
+        return;
+    }
+
+    for (auto it = m_records.begin(); it != m_records.end(); it++)
+    {
+        stream << it->second.m_checksum << '\t'
+               << it->second.m_size << '\t'
+               << it->second.m_mtime << '\t'
+               << it->first << std::endl;
+    }
+}
+
+PgnFileStatus CompletedFiles::get_status(fs::path pgn_file_path)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_records.find(record_key(pgn_file_path));
+    if (it == m_records.end())
+    {
+        return PgnFileStatus::NEW;
+    }
+
+    const PgnFileRecord &record = it->second;
+    uintmax_t size = fs::file_size(pgn_file_path);
+
+    if (size < record.m_size)
+    {
+        return PgnFileStatus::REWRITTEN;
+    }
+    if (size == record.m_size && file_mtime(pgn_file_path) == record.m_mtime)
+    {
+        return PgnFileStatus::UNCHANGED;
+    }
+
+    // The file was touched or grew. If the bytes we already ingested are intact,
+    // anything beyond them is new data.
+    if (checksum_file_prefix(pgn_file_path, record.m_size) != record.m_checksum)
+    {
+        return PgnFileStatus::REWRITTEN;
+    }
+    return size == record.m_size ? PgnFileStatus::UNCHANGED : PgnFileStatus::APPENDED;
+}
+
+uintmax_t CompletedFiles::get_completed_size(fs::path pgn_file_path)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_records.find(record_key(pgn_file_path));
+    return it == m_records.end() ? 0 : it->second.m_size;
+}
+
+void CompletedFiles::mark_completed(fs::path pgn_file_path, uintmax_t size)
+{
+    PgnFileRecord record = make_pgn_file_record(pgn_file_path, size);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_records[record_key(pgn_file_path)] = record;
+}
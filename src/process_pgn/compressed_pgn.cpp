@@ -0,0 +1,379 @@
+#include "process_pgn/compressed_pgn.hpp"
+#include "process_pgn/mapped_file.hpp"
+#include "util.hpp"
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+#ifdef MATEMAN_HAS_ZLIB
+#include <zlib.h>
+#endif
+#ifdef MATEMAN_HAS_BZIP2
+#include <bzlib.h>
+#endif
+#ifdef MATEMAN_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+// size of the reads from the decompressor
+const size_t DECOMPRESSION_BLOCK_SIZE = 1 << 16;
+
+#ifdef MATEMAN_HAS_ZLIB
+// gzread also reads files made of several concatenated gzip members.
+class GzipPgnDecompressor : public PgnDecompressor
+{
+    gzFile m_file;
+
+public:
+    GzipPgnDecompressor(gzFile file) : m_file(file)
+    {
+        gzbuffer(m_file, DECOMPRESSION_BLOCK_SIZE);
+    }
+
+    ~GzipPgnDecompressor()
+    {
+        gzclose(m_file);
+    }
+
+    size_t read(char *buffer, size_t size)
+    {
+        int bytes_read = gzread(m_file, buffer, size);
+        int error;
+        const char *message = gzerror(m_file, &error);
+        // a truncated file ends with Z_BUF_ERROR instead of failing the read
+        if (bytes_read < 0 || (bytes_read == 0 && error != Z_OK))
+        {
+            throw std::runtime_error(message);
+        }
+        return bytes_read;
+    }
+};
+#endif
+
+#ifdef MATEMAN_HAS_BZIP2
+// Parallel compressors (pbzip2, lbzip2) write several bzip2 streams one after the other.
+class Bzip2PgnDecompressor : public PgnDecompressor
+{
+    FILE *m_file;
+    BZFILE *m_stream = NULL;
+
+    bool open_next_stream(void *unused, int unused_size)
+    {
+        int c = fgetc(m_file);
+        if (unused_size == 0 && c == EOF)
+        {
+            return false;
+        }
+        if (c != EOF)
+        {
+            ungetc(c, m_file);
+        }
+
+        int error;
+        m_stream = BZ2_bzReadOpen(&error, m_file, 0, 0, unused, unused_size);
+        if (error != BZ_OK)
+        {
+            BZ2_bzReadClose(&error, m_stream);
+            m_stream = NULL;
+            throw std::runtime_error("cannot read bzip2 stream");
+        }
+        return true;
+    }
+
+public:
+    Bzip2PgnDecompressor(FILE *file) : m_file(file)
+    {
+        try
+        {
+            open_next_stream(NULL, 0);
+        }
+        catch (const std::exception &e)
+        {
+            fclose(m_file);
+            throw;
+        }
+    }
+
+    ~Bzip2PgnDecompressor()
+    {
+        int error;
+        if (m_stream != NULL)
+        {
+            BZ2_bzReadClose(&error, m_stream);
+        }
+        fclose(m_file);
+    }
+
+    size_t read(char *buffer, size_t size)
+    {
+        while (m_stream != NULL)
+        {
+            int error;
+            int bytes_read = BZ2_bzRead(&error, m_stream, buffer, size);
+            if (error == BZ_OK)
+            {
+                return bytes_read;
+            }
+            if (error != BZ_STREAM_END)
+            {
+                throw std::runtime_error("corrupt bzip2 data (error " + std::to_string(error) + ")");
+            }
+
+            // the bytes read past the end of this stream belong to the next one, BZ2_bzReadOpen copies them
+            void *unused;
+            int unused_size;
+            BZ2_bzReadGetUnused(&error, m_stream, &unused, &unused_size);
+            std::vector<char> next_stream_start((char *)unused, (char *)unused + unused_size);
+            BZ2_bzReadClose(&error, m_stream);
+            m_stream = NULL;
+            open_next_stream(next_stream_start.data(), unused_size);
+
+            if (bytes_read > 0)
+            {
+                return bytes_read;
+            }
+        }
+        return 0;
+    }
+};
+#endif
+
+#ifdef MATEMAN_HAS_ZSTD
+// ZSTD_decompressStream continues with the next frame by itself, so concatenated frames are read too.
+class ZstdPgnDecompressor : public PgnDecompressor
+{
+    FILE *m_file;
+    ZSTD_DCtx *m_context;
+    std::vector<char> m_input;
+    ZSTD_inBuffer m_input_buffer;
+
+public:
+    ZstdPgnDecompressor(FILE *file) : m_file(file), m_input(ZSTD_DStreamInSize())
+    {
+        m_context = ZSTD_createDCtx();
+        m_input_buffer = {m_input.data(), 0, 0};
+    }
+
+    ~ZstdPgnDecompressor()
+    {
+        ZSTD_freeDCtx(m_context);
+        fclose(m_file);
+    }
+
+    size_t read(char *buffer, size_t size)
+    {
+        ZSTD_outBuffer output = {buffer, size, 0};
+        while (output.pos == 0)
+        {
+            if (m_input_buffer.pos == m_input_buffer.size)
+            {
+                size_t bytes_read = fread(m_input.data(), 1, m_input.size(), m_file);
+                if (bytes_read == 0)
+                {
+                    return 0;
+                }
+                m_input_buffer = {m_input.data(), bytes_read, 0};
+            }
+
+            size_t result = ZSTD_decompressStream(m_context, &output, &m_input_buffer);
+            if (ZSTD_isError(result))
+            {
+                throw std::runtime_error(ZSTD_getErrorName(result));
+            }
+        }
+        return output.pos;
+    }
+};
+#endif
+
+// offset of the last game that starts in the data, 0 if there is none
+static size_t last_pgn_game_boundary(std::string_view data)
+{
+    size_t last = 0;
+    for (size_t boundary = find_pgn_game_boundary(data, 0); boundary < data.size();
+         boundary = find_pgn_game_boundary(data, boundary + 1))
+    {
+        last = boundary;
+    }
+    return last;
+}
+
+bool is_compressed_pgn(fs::path file_path)
+{
+    std::string extension = file_path.extension().string();
+    return extension == ".gz" || extension == ".bz2" || extension == ".zst";
+}
+
+std::unique_ptr<PgnDecompressor> open_pgn_decompressor(fs::path file_path)
+{
+    std::string extension = file_path.extension().string();
+#ifdef MATEMAN_HAS_ZLIB
+    if (extension == ".gz")
+    {
+        gzFile file = gzopen(file_path.c_str(), "rb");
+        return file == NULL ? NULL : std::make_unique<GzipPgnDecompressor>(file);
+    }
+#endif
+#ifdef MATEMAN_HAS_BZIP2
+    if (extension == ".bz2")
+    {
+        FILE *file = fopen(file_path.c_str(), "rb");
+        return file == NULL ? NULL : std::make_unique<Bzip2PgnDecompressor>(file);
+    }
+#endif
+#ifdef MATEMAN_HAS_ZSTD
+    if (extension == ".zst")
+    {
+        FILE *file = fopen(file_path.c_str(), "rb");
+        return file == NULL ? NULL : std::make_unique<ZstdPgnDecompressor>(file);
+    }
+#endif
+    std::cerr << ColorCode::red << "This build cannot decompress " << extension << " files: "
+              << file_path << ColorCode::end << std::endl;
+    return NULL;
+}
+
+CompressedPgnReader::CompressedPgnReader(fs::path file_path, size_t chunk_size, size_t max_queued_chunks)
+    : m_file_path(file_path), m_chunk_size(std::max<size_t>(chunk_size, 1)),
+      m_max_queued_chunks(std::max<size_t>(max_queued_chunks, 1))
+{
+    try
+    {
+        m_decompressor = open_pgn_decompressor(file_path);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << ColorCode::red << "Cannot read " << file_path << ": " << e.what() << ColorCode::end << std::endl;
+    }
+
+    if (m_decompressor)
+    {
+        m_thread = std::thread(&CompressedPgnReader::decode, this);
+    }
+    else
+    {
+        m_finished = true;
+    }
+}
+
+CompressedPgnReader::~CompressedPgnReader()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stopped = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+// Waits for room in the queue. Returns false if the reader is being destroyed.
+bool CompressedPgnReader::push_chunk(std::string chunk)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]
+              { return m_chunks.size() < m_max_queued_chunks || m_stopped; });
+    if (m_stopped)
+    {
+        return false;
+    }
+    m_decompressed_size += chunk.size();
+    m_chunks.push(std::move(chunk));
+    m_cv.notify_all();
+    return true;
+}
+
+void CompressedPgnReader::decode()
+{
+    std::string pending;
+    pending.reserve(m_chunk_size + DECOMPRESSION_BLOCK_SIZE);
+    std::vector<char> block(DECOMPRESSION_BLOCK_SIZE);
+
+    try
+    {
+        while (true)
+        {
+            auto clock_start = std::chrono::steady_clock::now();
+            size_t bytes_read = m_decompressor->read(block.data(), block.size());
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_decompression_time += std::chrono::steady_clock::now() - clock_start;
+            }
+            if (bytes_read == 0)
+            {
+                break;
+            }
+            size_t previous_size = pending.size();
+            pending.append(block.data(), bytes_read);
+            if (pending.size() < m_chunk_size)
+            {
+                continue;
+            }
+
+            // cut after the last full game once the chunk is big enough, "[Event" might straddle two blocks
+            size_t search_from = std::max(m_chunk_size, previous_size < 8 ? 0 : previous_size - 8);
+            size_t boundary = find_pgn_game_boundary(pending, search_from);
+            if (boundary < pending.size())
+            {
+                if (!push_chunk(pending.substr(0, boundary)))
+                {
+                    return;
+                }
+                pending.erase(0, boundary);
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        // the games decoded so far are still processed, except for the one that was cut off
+        std::cerr << ColorCode::red << "Cannot decompress " << m_file_path << ": " << e.what()
+                  << ColorCode::end << std::endl;
+        pending.erase(last_pgn_game_boundary(pending));
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_failed = true;
+    }
+
+    if (pending.size())
+    {
+        push_chunk(std::move(pending));
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_finished = true;
+    m_cv.notify_all();
+}
+
+bool CompressedPgnReader::next_chunk(std::string *chunk)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]
+              { return !m_chunks.empty() || m_finished; });
+    if (m_chunks.empty())
+    {
+        return false;
+    }
+    *chunk = std::move(m_chunks.front());
+    m_chunks.pop();
+    m_cv.notify_all();
+    return true;
+}
+
+uintmax_t CompressedPgnReader::decompressed_size()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_decompressed_size;
+}
+
+bool CompressedPgnReader::failed()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_failed;
+}
+
+std::chrono::nanoseconds CompressedPgnReader::decompression_time()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_decompression_time;
+}
@@ -0,0 +1,199 @@
+#include "process_pgn/game_archive.hpp"
+#include "process_pgn/mapped_file.hpp"
+#include "tablebase/compressed_shard.hpp"
+#include "tablebase/zobrist.hpp"
+#include <algorithm>
+
+static void write_string(std::vector<uint8_t> *buffer, const std::string &s)
+{
+    write_varint(buffer, s.size());
+    buffer->insert(buffer->end(), s.begin(), s.end());
+}
+
+void write_archived_game(std::vector<uint8_t> *buffer, const PgnGame &game)
+{
+    buffer->push_back(parse_game_result(game.m_result));
+    write_varint(buffer, std::max(game.m_whiteElo, 0));
+    write_varint(buffer, std::max(game.m_blackElo, 0));
+    write_string(buffer, game.m_event);
+    write_string(buffer, game.m_date);
+    write_string(buffer, game.m_time_control);
+    write_string(buffer, game.m_white_player_name);
+    write_string(buffer, game.m_black_player_name);
+
+    write_varint(buffer, game.m_move_list.size());
+    for (auto it = game.m_move_list.begin(); it != game.m_move_list.end(); it++)
+    {
+        uint16_t packed_move_key = pack_move_key_16(*it);
+        buffer->push_back(packed_move_key & 0xff);
+        buffer->push_back(packed_move_key >> 8);
+    }
+}
+
+GameArchiveWriter::GameArchiveWriter(fs::path file_path, bool append)
+{
+    bool write_header = !append || !fs::exists(file_path) || fs::file_size(file_path) == 0;
+    m_stream.open(file_path, std::ios::out | std::ios::binary | (append ? std::ios::app : std::ios::trunc));
+
+    if (!m_stream.is_open())
+    {
+        std::cerr
+            << ColorCode::red << "Cannot open filestream to path: " << ColorCode::end << std::endl
+            << file_path << std::endl;
+        return;
+    }
+    if (write_header)
+    {
+        m_stream.write(GAME_ARCHIVE_MAGIC, sizeof(GAME_ARCHIVE_MAGIC));
+        m_stream.put(GAME_ARCHIVE_VERSION);
+    }
+}
+
+void GameArchiveWriter::append(const std::vector<uint8_t> &buffer, int games)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_stream.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
+    m_stream.flush();
+    m_games += games;
+}
+
+// Bounds checked reads, a truncated archive ends the replay instead of reading past the mapping.
+class ArchiveCursor
+{
+    const uint8_t *m_data;
+    size_t m_size;
+    size_t m_index = 0;
+
+public:
+    ArchiveCursor(std::string_view data)
+        : m_data(reinterpret_cast<const uint8_t *>(data.data())), m_size(data.size()) {}
+
+    bool at_end() const
+    {
+        return m_index >= m_size;
+    }
+
+    bool read_byte(uint8_t *value)
+    {
+        if (m_index >= m_size)
+        {
+            return false;
+        }
+        *value = m_data[m_index++];
+        return true;
+    }
+
+    bool read_varint(uint64_t *value)
+    {
+        *value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            uint8_t byte;
+            if (!read_byte(&byte))
+            {
+                return false;
+            }
+            *value |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool read_string(std::string *value)
+    {
+        uint64_t size;
+        if (!read_varint(&size) || size > m_size - m_index)
+        {
+            return false;
+        }
+        value->assign(reinterpret_cast<const char *>(m_data + m_index), size);
+        m_index += size;
+        return true;
+    }
+
+    // the packed move keys of a game, in place
+    bool read_moves(uint64_t plies, const uint8_t **moves)
+    {
+        if (plies > (m_size - m_index) / sizeof(uint16_t))
+        {
+            return false;
+        }
+        *moves = m_data + m_index;
+        m_index += plies * sizeof(uint16_t);
+        return true;
+    }
+};
+
+ArchiveReplayStats replay_game_archive(fs::path file_path, Tablebase *tablebase, int max_plies,
+                                       const PgnGameFilter *filter)
+{
+    ArchiveReplayStats stats;
+    MappedFile mapped_file(file_path);
+    std::string_view data = mapped_file.view();
+    if (!mapped_file.is_open() || data.size() < sizeof(GAME_ARCHIVE_MAGIC) + 1 ||
+        !std::equal(GAME_ARCHIVE_MAGIC, GAME_ARCHIVE_MAGIC + sizeof(GAME_ARCHIVE_MAGIC), data.begin()) ||
+        data[sizeof(GAME_ARCHIVE_MAGIC)] != GAME_ARCHIVE_VERSION)
+    {
+        std::cerr << ColorCode::red << "Not a game archive: " << file_path << ColorCode::end << std::endl;
+        return stats;
+    }
+    data.remove_prefix(sizeof(GAME_ARCHIVE_MAGIC) + 1);
+
+    Position start;
+    populate_starting_position(&start);
+
+    // reused for every game, only the header fields are read by the filter
+    PgnGame game;
+    ArchiveCursor cursor(data);
+    while (!cursor.at_end())
+    {
+        uint8_t result;
+        uint64_t white_elo, black_elo, plies;
+        const uint8_t *moves;
+        if (!cursor.read_byte(&result) || !cursor.read_varint(&white_elo) || !cursor.read_varint(&black_elo) ||
+            !cursor.read_string(&game.m_event) || !cursor.read_string(&game.m_date) ||
+            !cursor.read_string(&game.m_time_control) || !cursor.read_string(&game.m_white_player_name) ||
+            !cursor.read_string(&game.m_black_player_name) || !cursor.read_varint(&plies) ||
+            !cursor.read_moves(plies, &moves))
+        {
+            std::cerr << ColorCode::red << "Game archive is truncated: " << file_path << ColorCode::end << std::endl;
+            break;
+        }
+
+        if (result > BLACK_WIN)
+        {
+            result = UNKNOWN_RESULT;
+        }
+        game.m_whiteElo = white_elo;
+        game.m_blackElo = black_elo;
+        static const char *result_strings[] = {"*", "1-0", "1/2-1/2", "0-1"};
+        game.m_result = result_strings[result];
+
+        if (filter && !filter->accepts(game))
+        {
+            stats.m_filtered_games++;
+            continue;
+        }
+
+        Position position = start;
+        for (uint64_t ply = 0; ply < plies; ply++)
+        {
+            int white_ply = position.m_whites_turn ? position.m_plies : position.m_plies - 1;
+            if (white_ply >= max_plies)
+            {
+                break;
+            }
+
+            MoveKey move_key = unpack_move_key_16(moves[2 * ply] | (moves[2 * ply + 1] << 8));
+            z_hash_t insert_hash = zobrist_hash(&position);
+            position.advance_position(move_key);
+            tablebase->update(insert_hash, zobrist_hash(&position), move_key, "", (GameResult)result);
+            stats.m_plies++;
+        }
+        stats.m_games++;
+    }
+    return stats;
+}
@@ -0,0 +1,98 @@
+#include "process_pgn/game_deduplicator.hpp"
+#include "util.hpp"
+#include <fstream>
+#include <vector>
+
+const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+static void fnv1a(uint64_t *hash, const void *data, size_t size)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        *hash ^= bytes[i];
+        *hash *= FNV_PRIME;
+    }
+}
+
+// the terminating null keeps adjacent fields from running into each other
+static void fnv1a(uint64_t *hash, const std::string &s)
+{
+    fnv1a(hash, s.c_str(), s.size() + 1);
+}
+
+uint64_t game_identity_hash(const PgnGame &game, const std::string &result)
+{
+    const char *essential_tags[] = {"White", "Black", "Date", "Round"};
+
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (const char *tag : essential_tags)
+    {
+        std::string value;
+        for (auto it = game.m_metadata.begin(); it != game.m_metadata.end(); it++)
+        {
+            if (it->key == tag)
+            {
+                value = it->value;
+                break;
+            }
+        }
+        fnv1a(&hash, value);
+    }
+    fnv1a(&hash, result);
+    fnv1a(&hash, game.m_move_list.data(), game.m_move_list.size() * sizeof(game.m_move_list[0]));
+    return hash;
+}
+
+bool GameDeduplicator::insert(uint64_t game_hash)
+{
+    int shard = game_hash % GAME_DEDUPLICATOR_SHARD_COUNT;
+    std::unique_lock<std::mutex> lock(m_mutexes[shard]);
+    return m_shards[shard].insert(game_hash).second;
+}
+
+size_t GameDeduplicator::size()
+{
+    size_t size = 0;
+    for (int shard = 0; shard < GAME_DEDUPLICATOR_SHARD_COUNT; shard++)
+    {
+        std::unique_lock<std::mutex> lock(m_mutexes[shard]);
+        size += m_shards[shard].size();
+    }
+    return size;
+}
+
+void GameDeduplicator::read_from_file(fs::path file_path)
+{
+    std::ifstream infile(file_path, std::ios::binary);
+    if (!infile.is_open())
+    {
+        return;
+    }
+
+    uint64_t game_hash;
+    while (infile.read(reinterpret_cast<char *>(&game_hash), sizeof(game_hash)))
+    {
+        insert(game_hash);
+    }
+}
+
+void GameDeduplicator::serialize(fs::path file_path)
+{
+    std::ofstream stream(file_path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!stream.is_open())
+    {
+        std::cerr
+            << ColorCode::red << "Cannot open filestream to path: " << ColorCode::end << std::endl
+            << file_path << std::endl;
+        return;
+    }
+
+    for (int shard = 0; shard < GAME_DEDUPLICATOR_SHARD_COUNT; shard++)
+    {
+        std::unique_lock<std::mutex> lock(m_mutexes[shard]);
+        std::vector<uint64_t> hashes(m_shards[shard].begin(), m_shards[shard].end());
+        stream.write(reinterpret_cast<const char *>(hashes.data()), hashes.size() * sizeof(uint64_t));
+    }
+}
@@ -0,0 +1,135 @@
+#include "process_pgn/game_filter.hpp"
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+
+/*
+    Estimated duration in seconds of a TimeControl tag, or -1 if it is unknown.
+    Only the first period counts for multi period controls like "40/7200:3600".
+        "300"          sudden death
+        "180+2"        base + increment, estimated over 40 moves
+        "40/7200"      moves per period
+        "*60"          sandclock
+*/
+int parse_time_control(std::string time_control)
+{
+    std::string period = time_control.substr(0, time_control.find(':'));
+    if (period.size() && period[0] == '*')
+    {
+        period.erase(0, 1);
+    }
+    size_t moves_end = period.find('/');
+    if (moves_end != std::string::npos)
+    {
+        period.erase(0, moves_end + 1);
+    }
+
+    size_t increment_start = period.find('+');
+    std::string base = period.substr(0, increment_start);
+    std::string increment = increment_start == std::string::npos ? "0" : period.substr(increment_start + 1);
+
+    auto is_number = [](const std::string &s)
+    {
+        return s.size() && s.size() < 9 && std::all_of(s.begin(), s.end(), ::isdigit);
+    };
+    if (!is_number(base) || !is_number(increment))
+    {
+        return -1;
+    }
+    return std::stoi(base) + 40 * std::stoi(increment);
+}
+
+static std::string resolve_unknown_date_parts(std::string date, char replacement)
+{
+    if (date.empty())
+    {
+        date = "????.??.??";
+    }
+    std::replace(date.begin(), date.end(), '?', replacement);
+    return date;
+}
+
+void PgnGameFilter::set_event_pattern(std::string pattern)
+{
+    // compiled once here, matching with a const regex is safe from every parser thread
+    m_event_pattern = pattern;
+    m_event_regex = std::regex(pattern, std::regex::ECMAScript | std::regex::optimize);
+}
+
+bool PgnGameFilter::set_option(std::string key, std::string value)
+{
+    if (key == "min_elo")
+    {
+        m_min_elo = std::stoi(value);
+    }
+    else if (key == "min_time_control")
+    {
+        m_min_time_control = std::stoi(value);
+    }
+    else if (key == "from")
+    {
+        m_min_date = value;
+    }
+    else if (key == "to")
+    {
+        m_max_date = value;
+    }
+    else if (key == "result")
+    {
+        std::vector<std::string> results;
+        boost::split(results, value, boost::is_any_of(","));
+        m_results.insert(results.begin(), results.end());
+    }
+    else if (key == "event")
+    {
+        set_event_pattern(value);
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+bool PgnGameFilter::is_active() const
+{
+    return m_min_elo > 0 || m_min_time_control > 0 || m_min_date.size() || m_max_date.size() ||
+           m_results.size() || m_event_pattern.size();
+}
+
+bool PgnGameFilter::accepts(const PgnGame &game) const
+{
+    if (game.m_whiteElo < m_min_elo || game.m_blackElo < m_min_elo)
+    {
+        return false;
+    }
+
+    if (m_min_time_control > 0)
+    {
+        int time_control = parse_time_control(game.m_time_control);
+        if (time_control >= 0 && time_control < m_min_time_control)
+        {
+            return false;
+        }
+    }
+
+    // dates are zero padded, so they compare as strings
+    if (m_min_date.size() && resolve_unknown_date_parts(game.m_date, '9') < m_min_date)
+    {
+        return false;
+    }
+    if (m_max_date.size() && resolve_unknown_date_parts(game.m_date, '0') > m_max_date)
+    {
+        return false;
+    }
+
+    if (m_results.size() && !m_results.count(game.m_result.size() ? game.m_result : "*"))
+    {
+        return false;
+    }
+
+    if (m_event_pattern.size() && !std::regex_search(game.m_event, m_event_regex))
+    {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+#include "process_pgn/ingest_metrics.hpp"
+#include <iomanip>
+#include <sstream>
+
+void PgnIngestMetrics::merge(const PgnIngestMetrics &other)
+{
+    m_bytes += other.m_bytes;
+    m_compressed_bytes += other.m_compressed_bytes;
+    m_games += other.m_games;
+    m_rejected_games += other.m_rejected_games;
+    m_filtered_games += other.m_filtered_games;
+    m_duplicate_games += other.m_duplicate_games;
+    m_plies += other.m_plies;
+    m_read_time += other.m_read_time;
+    m_parse_time += other.m_parse_time;
+    m_hash_time += other.m_hash_time;
+    m_insert_time += other.m_insert_time;
+    m_allocations_counted = m_allocations_counted || other.m_allocations_counted;
+    m_allocations += other.m_allocations;
+    m_allocated_bytes += other.m_allocated_bytes;
+}
+
+static double seconds(std::chrono::nanoseconds duration)
+{
+    return std::chrono::duration<double>(duration).count();
+}
+
+std::string PgnIngestMetrics::to_json(std::chrono::nanoseconds wall_time, unsigned threads) const
+{
+    double wall_seconds = seconds(wall_time);
+    auto per_second = [wall_seconds](double count)
+    {
+        return wall_seconds > 0 ? count / wall_seconds : 0;
+    };
+
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(3)
+         << "{\"threads\": " << threads
+         << ", \"wall_seconds\": " << wall_seconds
+         << ", \"bytes\": " << m_bytes
+         << ", \"compressed_bytes\": " << m_compressed_bytes
+         << ", \"games\": " << m_games
+         << ", \"rejected_games\": " << m_rejected_games
+         << ", \"filtered_games\": " << m_filtered_games
+         << ", \"duplicate_games\": " << m_duplicate_games
+         << ", \"plies\": " << m_plies
+         << ", \"games_per_second\": " << per_second(m_games)
+         << ", \"plies_per_second\": " << per_second(m_plies)
+         << ", \"mb_per_second\": " << per_second(m_bytes / 1e6)
+         << ", \"stage_seconds\": {\"read\": " << seconds(m_read_time)
+         << ", \"parse\": " << seconds(m_parse_time)
+         << ", \"hash\": " << seconds(m_hash_time)
+         << ", \"insert\": " << seconds(m_insert_time) << "}";
+    if (m_allocations_counted)
+    {
+        double games = m_games > 0 ? m_games : 1;
+        json << ", \"allocations\": {\"count\": " << m_allocations
+             << ", \"bytes\": " << m_allocated_bytes
+             << ", \"per_game\": " << m_allocations / games
+             << ", \"bytes_per_game\": " << m_allocated_bytes / games << "}";
+    }
+    json << "}";
+    return json.str();
+}
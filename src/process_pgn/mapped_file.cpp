@@ -0,0 +1,104 @@
+#include "process_pgn/mapped_file.hpp"
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(fs::path file_path)
+{
+    m_fd = open(file_path.c_str(), O_RDONLY);
+    if (m_fd < 0)
+    {
+        return;
+    }
+
+    struct stat file_stat;
+    if (fstat(m_fd, &file_stat) != 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+        return;
+    }
+
+    // mapping an empty file fails, but there is nothing to read anyway
+    m_size = file_stat.st_size;
+    if (m_size == 0)
+    {
+        return;
+    }
+
+    void *data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (data == MAP_FAILED)
+    {
+        close(m_fd);
+        m_fd = -1;
+        m_size = 0;
+        return;
+    }
+    madvise(data, m_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const char *>(data);
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data != NULL)
+    {
+        munmap(const_cast<char *>(m_data), m_size);
+    }
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+    }
+}
+
+/*
+    Returns the offset of the first game that starts at or after `from`, i.e. an "[Event"
+    tag at the start of a line that follows a blank line. Returns data.size() if there is none.
+*/
+size_t find_pgn_game_boundary(std::string_view data, size_t from)
+{
+    for (size_t position = data.find("[Event", from); position != std::string_view::npos;
+         position = data.find("[Event", position + 1))
+    {
+        if (position == 0)
+        {
+            return position;
+        }
+        if (data[position - 1] != '\n')
+        {
+            continue;
+        }
+
+        // the line before has to be empty (allowing for \r\n line endings)
+        size_t previous = position - 1;
+        if (previous > 0 && data[previous - 1] == '\r')
+        {
+            previous--;
+        }
+        if (previous > 0 && data[previous - 1] == '\n')
+        {
+            return position;
+        }
+    }
+    return data.size();
+}
+
+/*
+    Splits pgn data into chunks of roughly target_chunk_size bytes that only contain
+    whole games, so that the chunks can be parsed independently of each other.
+*/
+std::vector<std::string_view> split_pgn_into_chunks(std::string_view data, size_t target_chunk_size)
+{
+    std::vector<std::string_view> chunks;
+    size_t start = 0;
+    while (start < data.size())
+    {
+        // a chunk always makes progress, even if it ends up holding a single game
+        size_t split = start + std::max<size_t>(target_chunk_size, 1);
+        size_t end = split >= data.size() ? data.size() : find_pgn_game_boundary(data, split);
+        chunks.push_back(data.substr(start, end - start));
+        start = end;
+    }
+    return chunks;
+}
@@ -1,56 +1,71 @@
 #include "process_pgn/pgn_game.hpp"
 #include "process_pgn/read_pgn_data.hpp"
+#include "process_pgn/san_move.hpp"
 #include "tablebase/tablebase.hpp"
 #include "representation/notation.hpp"
 
-bool PgnGame::read_metadata_line(std::string &line)
+bool PgnGame::read_metadata_line(std::string_view line)
 {
-    std::smatch matches;
-    if (std::regex_match(line, matches, std::regex(metadata_line_regex)))
+    std::string_view key, value;
+    if (parse_metadata_line(line, &key, &value))
     {
         metadata_entry entry;
-        entry.key = std::string(matches[1]);
-        entry.value = std::string(matches[2]);
+        entry.key = std::string(key);
+        entry.value = std::string(value);
         m_metadata.push_back(entry);
         return true;
     }
     return false;
 }
 
-void PgnGame::process_player_move(std::string player_move, bool whites_turn, Tablebase *tablebase)
+// Throws std::invalid_argument if the move isn't valid SAN, or isn't legal in the game's position.
+void PgnGame::process_player_move(std::string_view player_move)
 {
-    uint32_t move_key;
-    boost::algorithm::trim(player_move);
+    // before processing the pgn move, get the zobrist hash of the current position
+    // this will be used as the insert hash for the tablebase.
+    auto clock_start = std::chrono::steady_clock::now();
+    z_hash_t zhash1 = zobrist_hash(&m_position);
+    auto clock_hashed = std::chrono::steady_clock::now();
 
-    if (player_move.size() == 0)
+    MoveKey move_key = play_move(player_move);
+
+    // after the move has been made, calculate the hash again. this is the destination hash for the
+    // tablebase update
+    auto clock_played = std::chrono::steady_clock::now();
+    z_hash_t zhash2 = zobrist_hash(&m_position);
+    if (m_metrics)
     {
-        return;
+        m_metrics->m_hash_time += (clock_hashed - clock_start) + (std::chrono::steady_clock::now() - clock_played);
     }
 
-    assert(m_position.m_whites_turn == whites_turn);
+    // the tablebase is updated once the result of the game is known
+    m_pending_updates.push_back(PendingTablebaseUpdate{zhash1, zhash2, move_key, std::string(player_move)});
+}
 
-    // before processing the pgn move, get the zobrist hash of the current position
-    // this will be used as the insert hash for the tablebase.
-    z_hash_t zhash1 = zobrist_hash(&m_position);
+// Decodes the move and plays it in the game's position, without touching the tablebase.
+MoveKey PgnGame::play_move(std::string_view player_move)
+{
+    uint32_t move_key;
+    bool whites_turn = m_position.m_whites_turn;
+
+    SanMove san_move;
+    if (!parse_san_move(player_move, &san_move))
+    {
+        throw std::invalid_argument("expected a move in standard algebraic notation: " + std::string(player_move));
+    }
 
-    std::smatch matches;
-    if (std::regex_match(player_move, matches,
-                         std::regex(non_castling_move_regex)))
+    if (san_move.m_castle)
+    {
+        move_key = m_position.castling_move(san_move.m_long_castle, whites_turn);
+    }
+    else
     {
-        char piece_char = getc(1, matches);
-        char src_file = getc(2, matches);
-        char src_rank = getc(3, matches);
-        char capture = getc(4, matches);
-        char dest_file = getc(5, matches);
-        char dest_rank = getc(6, matches);
-        std::string promotion = matches[7];
         char promotion_piece = 0;
-        char check_or_mate = getc(8, matches);
 
         // Get the promotion piece
-        if (promotion.size())
+        if (san_move.m_promotion)
         {
-            promotion_piece = char_to_piece(promotion.at(1));
+            promotion_piece = char_to_piece(san_move.m_promotion);
             // piece should always be uppercase because pieces are uppercase in PGN.
             assert(promotion_piece < PIECE_MASK);
 
@@ -61,61 +76,72 @@ void PgnGame::process_player_move(std::string player_move, bool whites_turn, Tab
         }
 
         move_key = m_position.non_castling_move(
-            piece_char, src_file, src_rank,
-            capture, dest_file, dest_rank,
-            promotion_piece, check_or_mate);
-    }
-    else if (std::regex_match(player_move, matches,
-                              std::regex(castling_move_regex)))
-    {
-        move_key = m_position.castling_move(matches, whites_turn);
-    }
-    else
-    {
-        // expected regex to match a move.
-        assert(false);
+            san_move.m_piece, san_move.m_src_file, san_move.m_src_rank,
+            san_move.m_capture, san_move.m_dest_file, san_move.m_dest_rank,
+            promotion_piece, san_move.m_check_or_mate);
     }
     // push the parsed move key to the move list
     m_move_list.push_back(move_key);
-
-    // after the move has been made, calculate the hash again. this is the destination hash for the
-    // tablebase update
-    z_hash_t zhash2 = zobrist_hash(&m_position);
-
-    // tablebase update here
-    tablebase->update(zhash1, zhash2, move_key, std::string(player_move));
+    return move_key;
 }
 
-bool PgnGame::read_game_move_line(std::string &line, Tablebase *tablebase, int max_plies)
+/*
+    Plays a move read from the movetext. Moves after ply max_plies are skipped such that the
+    tablebases aren't too large. Like full move pairs used to be, black's reply to the last
+    processed white move is still included.
+*/
+void PgnGame::read_move(std::string_view player_move, int max_plies)
 {
+    read_move(player_move, max_plies, false);
+}
 
-    bool is_game_line = false;
-    std::smatch matches;
-    while (std::regex_search(line, matches, game_line_regex))
+/*
+    With decode_remaining_moves, the moves after max_plies are still decoded into m_move_list.
+    Those don't go into the tablebase, so one that doesn't decode doesn't reject the game,
+    which would make the tablebase depend on whether the game is decoded further. The move
+    list ends before it instead.
+*/
+void PgnGame::read_move(std::string_view player_move, int max_plies, bool decode_remaining_moves)
+{
+    int white_ply = m_position.m_whites_turn ? m_position.m_plies : m_position.m_plies - 1;
+    if (white_ply < max_plies)
     {
-        is_game_line = true;
-
-        // stop processing moves after ply max_plies such that the tablebases arent too large.
-        if (m_position.m_plies < max_plies)
+        process_player_move(player_move);
+    }
+    else if (decode_remaining_moves && !m_move_list_cut_off)
+    {
+        try
         {
-            process_player_move(matches[1], true, tablebase);
-            process_player_move(matches[2], false, tablebase);
+            play_move(player_move);
         }
-
-        if (matches[3].length() > 0)
+        catch (const std::exception &e)
         {
-            process_result(matches[3]);
+            m_move_list_cut_off = true;
         }
-        line = matches.suffix().str();
     }
-
-    return is_game_line;
 }
 
-void PgnGame::process_result(std::string resultstr)
+void PgnGame::process_result(std::string resultstr, Tablebase *tablebase)
 {
     m_result = std::move(resultstr);
     m_finishedReading = true;
+    commit_pending_updates(tablebase);
+}
+
+void PgnGame::commit_pending_updates(Tablebase *tablebase)
+{
+    auto clock_start = std::chrono::steady_clock::now();
+    GameResult result = parse_game_result(m_result);
+    for (auto it = m_pending_updates.begin(); it != m_pending_updates.end(); it++)
+    {
+        tablebase->update(it->m_insert_hash, it->m_dest_hash, it->m_move_key, it->m_pgn_move, result);
+    }
+    if (m_metrics)
+    {
+        m_metrics->m_insert_time += std::chrono::steady_clock::now() - clock_start;
+        m_metrics->m_plies += m_pending_updates.size();
+    }
+    m_pending_updates.clear();
 }
 
 void PgnGame::printGameSummary()
@@ -179,6 +205,19 @@ void PgnGame::populateMetadata()
         {
             m_black_player_name = std::string(it->value);
         }
+        else if ((it->key).compare("Date") == 0)
+        {
+            m_date = it->value;
+        }
+        else if ((it->key).compare("TimeControl") == 0)
+        {
+            m_time_control = it->value;
+        }
+        else if ((it->key).compare("Result") == 0)
+        {
+            // replaced by the result in the movetext once the game is read
+            m_result = it->value;
+        }
     }
     m_eloOverThreshold =
         m_whiteElo >= ELO_THRESHOLD && m_blackElo >= ELO_THRESHOLD;
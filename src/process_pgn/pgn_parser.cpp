@@ -0,0 +1,312 @@
+#include "process_pgn/pgn_parser.hpp"
+#include "util.hpp"
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// characters that end a movetext token without being part of it
+static bool is_token_delimiter(char c)
+{
+    return is_space(c) || c == '{' || c == '}' || c == '(' || c == ')' || c == ';' || c == '$';
+}
+
+static size_t end_of_line(std::string_view data, size_t i)
+{
+    size_t end = data.find('\n', i);
+    return end == std::string_view::npos ? data.size() : end;
+}
+
+// index right after the variation that starts at i, skipping nested variations and comments
+static size_t end_of_variation(std::string_view data, size_t i)
+{
+    int depth = 0;
+    while (i < data.size())
+    {
+        char c = data[i];
+        if (c == '{')
+        {
+            size_t end = data.find('}', i);
+            i = end == std::string_view::npos ? data.size() : end + 1;
+            continue;
+        }
+        if (c == ';')
+        {
+            i = end_of_line(data, i);
+            continue;
+        }
+        i++;
+        if (c == '(')
+        {
+            depth++;
+        }
+        else if (c == ')' && --depth == 0)
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+static bool is_result(std::string_view token)
+{
+    return token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*";
+}
+
+PgnParser::PgnParser(Tablebase *tablebase, int max_plies, std::string file_path)
+    : PgnParser(tablebase, max_plies, file_path, NULL)
+{
+}
+
+PgnParser::PgnParser(Tablebase *tablebase, int max_plies, std::string file_path, const PgnGameFilter *filter)
+    : m_tablebase(tablebase), m_max_plies(max_plies), m_file_path(file_path), m_filter(filter)
+{
+    m_state = TAGS;
+    start_game();
+}
+
+void PgnParser::start_game()
+{
+    m_game = std::make_unique<PgnGame>();
+    m_game->m_metrics = &m_metrics;
+    populate_starting_position(&(m_game->m_position));
+    m_state = TAGS;
+}
+
+void PgnParser::finish_game(std::string result)
+{
+    if (is_duplicate_game(result))
+    {
+        start_game();
+        return;
+    }
+    m_game->process_result(result, m_tablebase);
+    archive_game();
+    m_stats.m_games++;
+    start_game();
+}
+
+// A game still counts if the next one (or the data) starts before its result, with an unknown score.
+void PgnParser::end_game_without_result()
+{
+    if (is_duplicate_game(m_game->m_result))
+    {
+        start_game();
+        return;
+    }
+    m_game->commit_pending_updates(m_tablebase);
+    archive_game();
+    m_stats.m_games++;
+    start_game();
+}
+
+bool PgnParser::is_duplicate_game(const std::string &result)
+{
+    if (m_deduplicator && !m_deduplicator->insert(game_identity_hash(*m_game, result)))
+    {
+        m_stats.m_duplicate_games++;
+        return true;
+    }
+    return false;
+}
+
+void PgnParser::archive_game()
+{
+    if (m_archive)
+    {
+        write_archived_game(&m_archive_buffer, *m_game);
+        m_archive_buffer_games++;
+    }
+}
+
+// None of the game's moves have been added to the tablebase yet, so it can be dropped.
+void PgnParser::reject_game(const std::exception &e)
+{
+    std::cerr << ColorCode::red << "Skipping game in " << m_file_path << ": " << e.what()
+              << ColorCode::end << std::endl;
+    m_stats.m_rejected_games++;
+    start_game();
+    m_state = SKIPPING_GAME;
+}
+
+// Called once the tag section of a game is over, before its first movetext token.
+void PgnParser::read_tags()
+{
+    m_game->populateMetadata();
+    m_state = MOVETEXT;
+
+    if (m_filter && !m_filter->accepts(*m_game))
+    {
+        m_stats.m_filtered_games++;
+        start_game();
+        m_state = SKIPPING_GAME;
+    }
+}
+
+void PgnParser::read_movetext_token(std::string_view token)
+{
+    if (is_result(token))
+    {
+        finish_game(std::string(token));
+        return;
+    }
+
+    // move numbers: "12." before a white move, "12..." before a black move,
+    // possibly without a space before the move
+    size_t i = 0;
+    while (i < token.size() && is_digit(token[i]))
+    {
+        i++;
+    }
+    while (i < token.size() && token[i] == '.')
+    {
+        i++;
+    }
+    token.remove_prefix(i);
+
+    // move suffix annotations, e.g. e4!? or Nxf7??
+    while (!token.empty() && (token.back() == '!' || token.back() == '?'))
+    {
+        token.remove_suffix(1);
+    }
+
+    if (!token.empty())
+    {
+        m_game->read_move(token, m_max_plies, m_archive != NULL || m_deduplicator != NULL);
+    }
+}
+
+PgnParseStats PgnParser::parse(std::string_view data)
+{
+    auto clock_start = std::chrono::steady_clock::now();
+    PgnParseStats stats_before = m_stats;
+    std::chrono::nanoseconds hash_and_insert_time_before = m_metrics.m_hash_time + m_metrics.m_insert_time;
+
+    size_t i = 0;
+    // only whitespace since the last line break
+    bool line_start = true;
+    while (i < data.size())
+    {
+        char c = data[i];
+
+        if (is_space(c))
+        {
+            line_start |= c == '\n';
+            i++;
+            continue;
+        }
+        bool token_at_line_start = line_start;
+        line_start = false;
+
+        if (c == '%' && token_at_line_start)
+        {
+            i = end_of_line(data, i);
+            continue;
+        }
+
+        // a tag pair at the start of a line begins the next game, even if the previous
+        // one ended without a result
+        if (c == '[' && token_at_line_start)
+        {
+            if (m_state == MOVETEXT)
+            {
+                end_game_without_result();
+            }
+            m_state = TAGS;
+
+            size_t line_end = end_of_line(data, i);
+            m_game->read_metadata_line(data.substr(i, line_end - i));
+            i = line_end;
+            continue;
+        }
+
+        if (m_state == SKIPPING_GAME)
+        {
+            i = end_of_line(data, i);
+            continue;
+        }
+
+        try
+        {
+            if (m_state == TAGS)
+            {
+                read_tags();
+                if (m_state == SKIPPING_GAME)
+                {
+                    i = end_of_line(data, i);
+                    continue;
+                }
+            }
+
+            if (c == '{')
+            {
+                size_t end = data.find('}', i);
+                i = end == std::string_view::npos ? data.size() : end + 1;
+            }
+            else if (c == ';')
+            {
+                i = end_of_line(data, i);
+            }
+            else if (c == '(')
+            {
+                i = end_of_variation(data, i);
+            }
+            else if (c == '$')
+            {
+                i++;
+                while (i < data.size() && is_digit(data[i]))
+                {
+                    i++;
+                }
+            }
+            else if (c == ')' || c == '}')
+            {
+                // unbalanced, nothing to read
+                i++;
+            }
+            else
+            {
+                size_t end = i;
+                while (end < data.size() && !is_token_delimiter(data[end]))
+                {
+                    end++;
+                }
+                std::string_view token = data.substr(i, end - i);
+                i = end;
+                read_movetext_token(token);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            reject_game(e);
+            i = end_of_line(data, i);
+        }
+    }
+
+    if (m_state == MOVETEXT)
+    {
+        end_game_without_result();
+    }
+    if (m_archive && m_archive_buffer_games)
+    {
+        m_archive->append(m_archive_buffer, m_archive_buffer_games);
+        m_archive_buffer.clear();
+        m_archive_buffer_games = 0;
+    }
+
+    // parsing is whatever time wasn't spent hashing or inserting
+    std::chrono::nanoseconds hash_and_insert_time = m_metrics.m_hash_time + m_metrics.m_insert_time - hash_and_insert_time_before;
+    m_metrics.m_parse_time += std::chrono::steady_clock::now() - clock_start - hash_and_insert_time;
+    m_metrics.m_bytes += data.size();
+    m_metrics.m_games += m_stats.m_games - stats_before.m_games;
+    m_metrics.m_rejected_games += m_stats.m_rejected_games - stats_before.m_rejected_games;
+    m_metrics.m_filtered_games += m_stats.m_filtered_games - stats_before.m_filtered_games;
+    m_metrics.m_duplicate_games += m_stats.m_duplicate_games - stats_before.m_duplicate_games;
+    return m_stats;
+}
@@ -2,6 +2,7 @@
 #include "process_pgn/pgn_game.hpp"
 #include "threadpool/threadpool.hpp"
 #include <chrono>
+#include <iomanip>
 #include <utility>
 #include <filesystem>
 
@@ -17,9 +18,58 @@ const std::string test_files[8] = {
 };
 
 std::shared_ptr<Tablebase> create_tablebases_from_pgn_data(std::string tablebase_name)
+{
+  return create_tablebases_from_pgn_data(tablebase_name, false);
+}
+
+std::shared_ptr<Tablebase> create_tablebases_from_pgn_data(std::string tablebase_name, bool compressed)
+{
+  return create_tablebases_from_pgn_data(tablebase_name, compressed, PgnGameFilter(), "", false);
+}
+
+static void print_game_counts(PgnProcessor &pgnProcessor)
+{
+  if (pgnProcessor.get_filtered_games() || pgnProcessor.get_rejected_games() || pgnProcessor.get_duplicate_games())
+  {
+    std::cout << "Skipped " << pgnProcessor.get_filtered_games() << " filtered, "
+              << pgnProcessor.get_duplicate_games() << " duplicate and "
+              << pgnProcessor.get_rejected_games() << " unreadable games." << std::endl;
+  }
+  if (pgnProcessor.get_archived_games())
+  {
+    std::cout << "Archived " << pgnProcessor.get_archived_games() << " games." << std::endl;
+  }
+}
+
+static void set_game_archive(PgnProcessor &pgnProcessor, std::string archive_name, bool append)
+{
+  if (archive_name.size())
+  {
+    fs::create_directories(game_archive_dir);
+    pgnProcessor.set_archive(game_archive_dir / (archive_name + game_archive_extension), append);
+  }
+}
+
+/*
+  With an archive name, the games read are also written to a game archive, from which tablebases
+  with other max plies or filters can be created quickly (see create_tablebases_from_game_archive).
+  When deduplicating, games that appear more than once in the pgn files are only counted once.
+*/
+std::shared_ptr<Tablebase> create_tablebases_from_pgn_data(
+    std::string tablebase_name, bool compressed, const PgnGameFilter &filter, std::string archive_name,
+    bool deduplicate)
 {
   PgnProcessor pgnProcessor(tablebase_data_dir / tablebase_name, pgn_database_path);
+  pgnProcessor.set_compressed(compressed);
+  pgnProcessor.set_filter(filter);
+  pgnProcessor.set_deduplicate(deduplicate);
+  set_game_archive(pgnProcessor, archive_name, false);
   pgnProcessor.process_pgn_files();
+  print_game_counts(pgnProcessor);
+  print_pgn_worker_utilization(pgnProcessor.get_worker_stats(), pgnProcessor.get_processing_time(),
+                               pgnProcessor.get_threads());
+  std::cout << pgnProcessor.get_metrics().to_json(pgnProcessor.get_processing_time(), pgnProcessor.get_threads())
+            << std::endl;
   return pgnProcessor.serialize_all();
 
   // ----------------------------
@@ -91,9 +141,107 @@ std::shared_ptr<Tablebase> create_tablebases_from_pgn_data(std::string tablebase
       << ColorCode::green << "Success!" << ColorCode::end << std::endl;
 }
 
+std::shared_ptr<Tablebase> update_tablebases_from_pgn_data(std::string tablebase_name)
+{
+  return update_tablebases_from_pgn_data(tablebase_name, PgnGameFilter(), "", false);
+}
+
+/*
+  The games of the new pgn files are appended to the archive, if one is given. A tablebase that
+  was created with deduplication keeps dropping duplicates, also of the games read back then.
+*/
+std::shared_ptr<Tablebase> update_tablebases_from_pgn_data(
+    std::string tablebase_name, const PgnGameFilter &filter, std::string archive_name, bool deduplicate)
+{
+  PgnProcessor pgnProcessor(tablebase_data_dir / tablebase_name, pgn_database_path);
+  pgnProcessor.set_filter(filter);
+  pgnProcessor.set_deduplicate(deduplicate);
+  set_game_archive(pgnProcessor, archive_name, true);
+  PgnUpdateSummary summary = pgnProcessor.process_new_pgn_files();
+
+  std::cout << ColorCode::green << "Processed " << summary.new_files << " new and "
+            << summary.appended_files << " appended pgn files. " << ColorCode::end
+            << "Skipped " << summary.unchanged_files << " unchanged and "
+            << summary.rewritten_files << " rewritten files." << std::endl;
+  print_game_counts(pgnProcessor);
+  print_pgn_worker_utilization(pgnProcessor.get_worker_stats(), pgnProcessor.get_processing_time(),
+                               pgnProcessor.get_threads());
+  std::cout << pgnProcessor.get_metrics().to_json(pgnProcessor.get_processing_time(), pgnProcessor.get_threads())
+            << std::endl;
+
+  return pgnProcessor.serialize_all();
+}
+
+std::shared_ptr<Tablebase> create_tablebases_from_game_archive(
+    std::string tablebase_name, std::string archive_name, bool compressed, int max_plies, const PgnGameFilter &filter)
+{
+  PgnProcessor pgnProcessor(tablebase_data_dir / tablebase_name, pgn_database_path);
+  pgnProcessor.set_compressed(compressed);
+  pgnProcessor.set_max_plies(max_plies);
+  pgnProcessor.set_filter(filter);
+
+  auto clock_start = std::chrono::high_resolution_clock::now();
+  ArchiveReplayStats stats = pgnProcessor.process_game_archive(game_archive_dir / (archive_name + game_archive_extension));
+  auto clock_end = std::chrono::high_resolution_clock::now();
+
+  std::cout << ColorCode::green << "Replayed " << stats.m_games << " games (" << stats.m_plies << " plies) in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(clock_end - clock_start).count()
+            << " ms. " << ColorCode::end << std::endl;
+  print_game_counts(pgnProcessor);
+  return pgnProcessor.serialize_all();
+}
+
+size_t balanced_pgn_chunk_size(uintmax_t total_size, size_t max_chunk_size, unsigned threads)
+{
+  uintmax_t balanced_size = total_size / (std::max(1u, threads) * PGN_TASKS_PER_THREAD);
+  return std::min<uintmax_t>(max_chunk_size, std::max<uintmax_t>(balanced_size, PGN_MIN_CHUNK_SIZE));
+}
+
+/*
+  Utilization is the share of the processing wall time a thread spent parsing. Threads
+  of the pool that never got a task aren't listed, but count towards the average.
+*/
+void print_pgn_worker_utilization(const std::vector<PgnWorkerStats> &worker_stats,
+                                  std::chrono::nanoseconds processing_time, unsigned threads)
+{
+  if (worker_stats.empty() || processing_time.count() <= 0)
+  {
+    return;
+  }
+
+  double total_busy_seconds = 0;
+  std::cout << ColorCode::yellow
+            << std::left << std::setw(20) << "Thread ID"
+            << std::left << std::setw(10) << "Chunks"
+            << std::left << std::setw(10) << "Games"
+            << std::left << std::setw(12) << "MB"
+            << std::left << std::setw(12) << "Busy"
+            << std::left << std::setw(12) << "Utilization"
+            << ColorCode::end << std::endl;
+  for (const PgnWorkerStats &stats : worker_stats)
+  {
+    double busy_seconds = std::chrono::duration<double>(stats.m_busy_time).count();
+    total_busy_seconds += busy_seconds;
+    std::cout << std::left << std::setw(20) << stats.m_thread_id
+              << std::left << std::setw(10) << stats.m_chunks
+              << std::left << std::setw(10) << stats.m_games
+              << std::left << std::setw(12) << std::fixed << std::setprecision(1) << stats.m_bytes / 1e6
+              << std::left << std::setw(12) << std::setprecision(2) << busy_seconds
+              << std::left << std::setw(12)
+              << std::to_string((int)(100 * busy_seconds / std::chrono::duration<double>(processing_time).count())) + "%"
+              << std::endl;
+  }
+
+  double wall_seconds = std::chrono::duration<double>(processing_time).count();
+  std::cout << worker_stats.size() << " of " << threads << " threads ran tasks, "
+            << std::setprecision(2) << wall_seconds << "s wall time, "
+            << std::setprecision(0) << 100 * total_busy_seconds / (wall_seconds * threads)
+            << "% average utilization" << std::defaultfloat << std::setprecision(6) << std::endl;
+}
+
 void print_pgn_processing_performance_summary(
-    std::__1::chrono::steady_clock::time_point clock_start,
-    std::__1::chrono::steady_clock::time_point clock_end,
+    std::chrono::steady_clock::time_point clock_start,
+    std::chrono::steady_clock::time_point clock_end,
     std::thread::id thread_id,
     int games_list_size,
     int tablebase_size,
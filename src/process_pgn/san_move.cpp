@@ -0,0 +1,122 @@
+#include "process_pgn/san_move.hpp"
+#include <cctype>
+
+static bool is_file(char c)
+{
+    return c >= 'a' && c <= 'h';
+}
+
+static bool is_rank(char c)
+{
+    return c >= '1' && c <= '8';
+}
+
+static bool is_piece_char(char c)
+{
+    return c == 'R' || c == 'N' || c == 'B' || c == 'K' || c == 'Q';
+}
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/*
+    Decodes a single SAN move in one pass, without allocating. Accepts the same moves as
+    the regular expressions that were used before:
+        ([RNBKQ])?([a-h])?([1-8])?(x)?([a-h])([1-8])(=[RNBKQ])?([\+\#])?
+        ((O-O-O)|(O-O))([\+\#])?
+    Returns false if the move doesn't fit either form.
+*/
+bool parse_san_move(std::string_view san, SanMove *move)
+{
+    *move = SanMove();
+
+    if (!san.empty() && (san.back() == '+' || san.back() == '#'))
+    {
+        move->m_check_or_mate = san.back();
+        san.remove_suffix(1);
+    }
+
+    if (san == "O-O" || san == "O-O-O")
+    {
+        move->m_castle = true;
+        move->m_long_castle = san.size() == 5;
+        return true;
+    }
+
+    if (san.size() >= 2 && san[san.size() - 2] == '=')
+    {
+        if (!is_piece_char(san.back()))
+        {
+            return false;
+        }
+        move->m_promotion = san.back();
+        san.remove_suffix(2);
+    }
+
+    if (san.size() < 2 || !is_file(san[san.size() - 2]) || !is_rank(san.back()))
+    {
+        return false;
+    }
+    move->m_dest_file = san[san.size() - 2];
+    move->m_dest_rank = san.back();
+    san.remove_suffix(2);
+
+    // whatever is left is [piece][src file][src rank][x], each part optional
+    size_t i = 0;
+    if (i < san.size() && is_piece_char(san[i]))
+    {
+        move->m_piece = san[i++];
+    }
+    if (i < san.size() && is_file(san[i]))
+    {
+        move->m_src_file = san[i++];
+    }
+    if (i < san.size() && is_rank(san[i]))
+    {
+        move->m_src_rank = san[i++];
+    }
+    if (i < san.size() && san[i] == 'x')
+    {
+        move->m_capture = san[i++];
+    }
+    return i == san.size();
+}
+
+/*
+    Splits a pgn tag pair such as [White "Carlsen, Magnus"] into its key and value, which
+    point into the line. Same as matching ^\s*\[(\w+)\s"(.*?)"\]\s*$
+*/
+bool parse_metadata_line(std::string_view line, std::string_view *key, std::string_view *value)
+{
+    while (!line.empty() && is_space(line.front()))
+    {
+        line.remove_prefix(1);
+    }
+    while (!line.empty() && is_space(line.back()))
+    {
+        line.remove_suffix(1);
+    }
+
+    if (line.size() < 2 || line.front() != '[' || line.substr(line.size() - 2) != "\"]")
+    {
+        return false;
+    }
+    line.remove_prefix(1);
+    line.remove_suffix(2);
+
+    size_t key_end = 0;
+    while (key_end < line.size() && (isalnum((unsigned char)line[key_end]) || line[key_end] == '_'))
+    {
+        key_end++;
+    }
+    if (key_end == 0 || key_end + 2 > line.size() || !is_space(line[key_end]) || line[key_end + 1] != '"')
+    {
+        return false;
+    }
+
+    *key = line.substr(0, key_end);
+    *value = line.substr(key_end + 2);
+    return true;
+}
@@ -427,7 +427,6 @@ bool Position::is_king_in_check(bool white_king)
   }
 
   // look for knights attacking king
-  std::vector<uint8_t> knights;
   target = KNIGHT_C(attacker_color);
   for (auto it = knight_move_offsets.begin(); it != knight_move_offsets.end(); it++)
   {
@@ -442,15 +441,17 @@ bool Position::is_king_in_check(bool white_king)
     }
   }
 
-  if (!check_diagonals(this, king_square, !white_king).empty())
-  {
-    return true;
-  }
-
-  //look for bishops/queens attacking king on diagonals
-  if (!check_files_ranks(this, king_square, !white_king).empty())
+  // look for bishops/queens on diagonals and rooks/queens on files and ranks,
+  // line by line rather than through check_diagonals, which collects the attackers in a vector
+  for (int i = 0; i < 4; i++)
   {
-    return true;
+    if (is_valid_square(check_line(this, king_square, bishop_offsets[i],
+                                   white_king ? &black_attacks_diagonally : &white_attacks_diagonally)) ||
+        is_valid_square(check_line(this, king_square, rook_offsets[i],
+                                   white_king ? &black_attacks_files_ranks : &white_attacks_files_ranks)))
+    {
+      return true;
+    }
   }
 
   // look for kings next to each other. it doesnt matter whose turn it is when this happens, its always illegal.
@@ -524,25 +525,26 @@ PositionAdjustment Position::advance_position(square_t src_square, square_t dst_
                     : 0));
   }
 
-  // remove castling rights if the rook moves or gets captured
+  // remove castling rights if the rook moves or gets captured. a rook capturing
+  // the opposing rook on its home square removes both sides' rights.
   if (src_square == W_KING_ROOK_SQUARE || dst_square == W_KING_ROOK_SQUARE)
   {
     m_white_kingside_castle = false;
   }
-  else if (src_square == W_QUEEN_ROOK_SQUARE || dst_square == W_QUEEN_ROOK_SQUARE)
+  if (src_square == W_QUEEN_ROOK_SQUARE || dst_square == W_QUEEN_ROOK_SQUARE)
   {
     m_white_queenside_castle = false;
   }
-  else if (src_square == B_KING_ROOK_SQUARE || dst_square == B_KING_ROOK_SQUARE)
+  if (src_square == B_KING_ROOK_SQUARE || dst_square == B_KING_ROOK_SQUARE)
   {
     m_black_kingside_castle = false;
   }
-  else if (src_square == B_QUEEN_ROOK_SQUARE || dst_square == B_QUEEN_ROOK_SQUARE)
+  if (src_square == B_QUEEN_ROOK_SQUARE || dst_square == B_QUEEN_ROOK_SQUARE)
   {
     m_black_queenside_castle = false;
   }
 
-  else if (moving_piece == KING_C(C) && src_square == KING_SQUARE_C(C))
+  if (moving_piece == KING_C(C) && src_square == KING_SQUARE_C(C))
   {
     if (m_whites_turn)
     {
@@ -0,0 +1,194 @@
+#include "tablebase/tablebase.hpp"
+#include <algorithm>
+#include <queue>
+#include <unordered_set>
+#include <vector>
+
+/*
+    Aggregates the statistics of every position reachable from the root. A position's games
+    and score are the sum over all the move edges that lead into it, so transpositions add up
+    instead of being counted separately per move order.
+
+    Positions are visited in topological order (Kahn's algorithm), so that a position is only
+    expanded once all of its parents are done, which the reach probability relies on. Repeated
+    positions can form cycles; when no position is left without pending parents, the earliest
+    discovered unfinished position is expanded anyway, and edges into already expanded
+    positions are ignored.
+*/
+void Tablebase::analyze()
+{
+    m_position_stats.clear();
+
+    auto find_moves = [this](z_hash_t hash) -> std::shared_ptr<MovesPlayed>
+    {
+        uint16_t shard = hash % TABLEBASE_SHARD_COUNT;
+        auto node = shards[shard].find(hash);
+        return node == shards[shard].end() ? NULL : node->second;
+    };
+
+    std::shared_ptr<MovesPlayed> root_moves = find_moves(m_root_hash);
+    if (!root_moves)
+    {
+        return;
+    }
+
+    // discover the reachable graph and count the parents of every position
+    std::unordered_map<z_hash_t, uint32_t> pending_parents;
+    std::vector<z_hash_t> discovered;
+    std::queue<z_hash_t> to_visit;
+    pending_parents[m_root_hash] = 0;
+    discovered.push_back(m_root_hash);
+    to_visit.push(m_root_hash);
+
+    while (!to_visit.empty())
+    {
+        z_hash_t hash = to_visit.front();
+        to_visit.pop();
+
+        std::shared_ptr<MovesPlayed> move_map = find_moves(hash);
+        if (!move_map)
+        {
+            continue;
+        }
+        for (auto it = move_map->begin(); it != move_map->end(); it++)
+        {
+            auto inserted = pending_parents.insert(std::make_pair(it->second.m_dest_hash, 0));
+            inserted.first->second++;
+            if (inserted.second)
+            {
+                discovered.push_back(it->second.m_dest_hash);
+                to_visit.push(it->second.m_dest_hash);
+            }
+        }
+    }
+
+    m_position_stats.reserve(discovered.size());
+    PositionStats &root_stats = m_position_stats[m_root_hash];
+    for (auto it = root_moves->begin(); it != root_moves->end(); it++)
+    {
+        root_stats.m_games += it->second.m_times_played;
+        root_stats.m_times_scored += it->second.m_times_scored;
+        root_stats.m_white_half_points += it->second.m_white_half_points;
+    }
+    root_stats.m_reach_probability = 1;
+
+    std::unordered_set<z_hash_t> expanded;
+    expanded.reserve(discovered.size());
+    std::queue<z_hash_t> ready;
+    ready.push(m_root_hash);
+    size_t next_discovered = 0;
+
+    while (expanded.size() < discovered.size())
+    {
+        if (ready.empty())
+        {
+            // only positions on a cycle are left
+            while (expanded.count(discovered[next_discovered]))
+            {
+                next_discovered++;
+            }
+            ready.push(discovered[next_discovered]);
+        }
+
+        z_hash_t hash = ready.front();
+        ready.pop();
+        if (!expanded.insert(hash).second)
+        {
+            continue;
+        }
+
+        std::shared_ptr<MovesPlayed> move_map = find_moves(hash);
+        if (!move_map)
+        {
+            continue;
+        }
+
+        PositionStats stats = m_position_stats[hash];
+        uint32_t times_played = 0;
+        for (auto it = move_map->begin(); it != move_map->end(); it++)
+        {
+            times_played += it->second.m_times_played;
+        }
+
+        for (auto it = move_map->begin(); it != move_map->end(); it++)
+        {
+            z_hash_t dest_hash = it->second.m_dest_hash;
+            if (expanded.count(dest_hash))
+            {
+                continue;
+            }
+
+            PositionStats &dest_stats = m_position_stats[dest_hash];
+            if (!dest_stats.m_games || dest_stats.m_min_ply > stats.m_min_ply + 1)
+            {
+                dest_stats.m_min_ply = stats.m_min_ply + 1;
+            }
+            dest_stats.m_games += it->second.m_times_played;
+            dest_stats.m_times_scored += it->second.m_times_scored;
+            dest_stats.m_white_half_points += it->second.m_white_half_points;
+            dest_stats.m_reach_probability +=
+                stats.m_reach_probability * it->second.m_times_played / times_played;
+
+            if (--pending_parents[dest_hash] == 0)
+            {
+                ready.push(dest_hash);
+            }
+        }
+    }
+}
+
+// NULL if the position isn't reachable from the root, or analyze hasn't been run.
+const PositionStats *Tablebase::get_position_stats(z_hash_t position_hash)
+{
+    auto it = m_position_stats.find(position_hash);
+    return it == m_position_stats.end() ? NULL : &it->second;
+}
+
+/*
+    Picks the move leading to the position with the best expected score for the side to move.
+    Scores come from the aggregated statistics of the destination, so a move is also credited
+    with the games that reached the same position through another move order. Moves played in
+    less than min_share of the games from this position are not considered, so that a sideline
+    with a handful of lucky games is not preferred over the main line. Falls back to sampling
+    by times played if the tablebase hasn't been analyzed.
+*/
+MoveKey Tablebase::pick_move_by_score(z_hash_t position_hash, bool whites_turn, double min_share)
+{
+    uint16_t shard = position_hash % TABLEBASE_SHARD_COUNT;
+    auto node = shards[shard].find(position_hash);
+    if (node == shards[shard].end() || !node->second || node->second->empty())
+    {
+        return VOID_MOVE;
+    }
+    if (!is_analyzed())
+    {
+        return pick_move_from_sample(position_hash);
+    }
+
+    uint32_t times_played = 0;
+    for (auto it = node->second->begin(); it != node->second->end(); it++)
+    {
+        times_played += it->second.m_times_played;
+    }
+
+    MoveKey best_move = VOID_MOVE;
+    double best_score = -1;
+    uint32_t best_times_played = 0;
+    for (auto it = node->second->begin(); it != node->second->end(); it++)
+    {
+        if (it->second.m_times_played < min_share * times_played)
+        {
+            continue;
+        }
+
+        const PositionStats *dest_stats = get_position_stats(it->second.m_dest_hash);
+        double score = dest_stats ? dest_stats->expected_score(whites_turn) : 0.5;
+        if (score > best_score || (score == best_score && it->second.m_times_played > best_times_played))
+        {
+            best_move = it->first;
+            best_score = score;
+            best_times_played = it->second.m_times_played;
+        }
+    }
+    return best_move;
+}
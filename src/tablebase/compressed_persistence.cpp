@@ -0,0 +1,390 @@
+#include "tablebase/tablebase.hpp"
+#include "tablebase/compressed_shard.hpp"
+#include "move_generation.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+#ifdef MATEMAN_HAS_ZLIB
+#include <zlib.h>
+const uint8_t DEFAULT_CODEC = CODEC_ZLIB;
+#else
+const uint8_t DEFAULT_CODEC = CODEC_NONE;
+#endif
+
+static bool read_whole_file(std::string file_path, std::vector<uint8_t> *data)
+{
+    std::ifstream infile(file_path, std::ios::binary | std::ios::ate);
+    if (!infile.is_open())
+    {
+        return false;
+    }
+    std::streampos size = infile.tellg();
+    data->resize(size);
+    infile.seekg(0, std::ios::beg);
+    infile.read(reinterpret_cast<char *>(data->data()), size);
+    return true;
+}
+
+static std::vector<uint8_t> compress_block(const std::vector<uint8_t> &raw, uint8_t codec)
+{
+#ifdef MATEMAN_HAS_ZLIB
+    if (codec == CODEC_ZLIB)
+    {
+        uLongf stored_size = compressBound(raw.size());
+        std::vector<uint8_t> stored(stored_size);
+        int result = compress2(stored.data(), &stored_size, raw.data(), raw.size(), Z_BEST_COMPRESSION);
+        if (result != Z_OK)
+        {
+            throw std::runtime_error("Cannot compress tablebase block (zlib error " + std::to_string(result) + ")");
+        }
+        stored.resize(stored_size);
+        return stored;
+    }
+#endif
+    if (codec != CODEC_NONE)
+    {
+        throw std::runtime_error("Unknown tablebase compression codec " + std::to_string(codec));
+    }
+    return raw;
+}
+
+static std::vector<uint8_t> decompress_block(
+    const uint8_t *stored, const CompressedBlockIndexEntry &entry, uint8_t codec)
+{
+    std::vector<uint8_t> raw(entry.m_raw_size);
+#ifdef MATEMAN_HAS_ZLIB
+    if (codec == CODEC_ZLIB)
+    {
+        uLongf raw_size = entry.m_raw_size;
+        int result = uncompress(raw.data(), &raw_size, stored, entry.m_stored_size);
+        if (result != Z_OK || raw_size != entry.m_raw_size)
+        {
+            throw std::runtime_error("corrupt block (zlib error " + std::to_string(result) + ")");
+        }
+        return raw;
+    }
+#endif
+    if (codec != CODEC_NONE)
+    {
+        throw std::runtime_error("compression codec " + std::to_string(codec) + " is not supported by this build");
+    }
+    if (entry.m_stored_size != entry.m_raw_size)
+    {
+        throw std::runtime_error("corrupt block (stored and raw sizes differ)");
+    }
+    std::copy(stored, stored + entry.m_raw_size, raw.begin());
+    return raw;
+}
+
+/*
+    Decodes the positions of one block. The callback is invoked with every position hash
+    and its moves (with unknown destination hashes and pgn moves). Returns early if the
+    callback returns false.
+*/
+template <typename F>
+static void decode_block(const std::vector<uint8_t> &raw, z_hash_t first_hash, F callback)
+{
+    size_t index = 0;
+    z_hash_t hash = first_hash;
+    while (index < raw.size())
+    {
+        hash += read_varint(raw.data(), raw.size(), &index);
+        uint64_t move_map_size = read_varint(raw.data(), raw.size(), &index);
+
+        std::shared_ptr<MovesPlayed> move_map = std::make_shared<MovesPlayed>();
+        for (uint64_t m = 0; m < move_map_size; m++)
+        {
+            if (raw.size() - index < sizeof(uint16_t))
+            {
+                throw std::runtime_error("truncated move");
+            }
+            uint16_t packed_move_key = raw[index] | (raw[index + 1] << 8);
+            index += sizeof(uint16_t);
+            uint32_t times_played = read_varint(raw.data(), raw.size(), &index);
+            uint32_t times_scored = read_varint(raw.data(), raw.size(), &index);
+            uint32_t white_half_points = read_varint(raw.data(), raw.size(), &index);
+
+            move_map->insert(std::pair(unpack_move_key_16(packed_move_key),
+                                       MoveEdge(0, "", times_played, times_scored, white_half_points)));
+        }
+        if (!callback(hash, move_map))
+        {
+            return;
+        }
+    }
+}
+
+void Tablebase::serialize_compressed_tablebase(std::string file_path, int shard)
+{
+    std::fstream stream(file_path, std::ios::out | std::ios::binary);
+
+    if (!stream.is_open())
+    {
+        std::cerr
+            << ColorCode::red << "Cannot open filestream to path: " << ColorCode::end << std::endl
+            << file_path << std::endl;
+        return;
+    }
+
+    std::vector<z_hash_t> hashes;
+    hashes.reserve(shards[shard].size());
+    for (auto node = shards[shard].begin(); node != shards[shard].end(); node++)
+    {
+        hashes.push_back(node->first);
+    }
+    std::sort(hashes.begin(), hashes.end());
+
+    std::vector<CompressedBlockIndexEntry> block_index;
+    std::vector<uint8_t> blocks;
+
+    for (size_t block_start = 0; block_start < hashes.size(); block_start += COMPRESSED_SHARD_BLOCK_POSITIONS)
+    {
+        size_t block_end = std::min(hashes.size(), block_start + COMPRESSED_SHARD_BLOCK_POSITIONS);
+        std::vector<uint8_t> raw;
+        z_hash_t previous_hash = hashes[block_start];
+
+        for (size_t i = block_start; i < block_end; i++)
+        {
+            auto move_map = shards[shard].at(hashes[i]);
+            write_varint(&raw, hashes[i] - previous_hash);
+            write_varint(&raw, move_map->size());
+            previous_hash = hashes[i];
+
+            // sort the moves so that the output doesn't depend on the unordered_map's iteration order
+            std::vector<MoveKey> move_keys;
+            for (auto it = move_map->begin(); it != move_map->end(); it++)
+            {
+                move_keys.push_back(it->first);
+            }
+            std::sort(move_keys.begin(), move_keys.end());
+
+            for (auto it = move_keys.begin(); it != move_keys.end(); it++)
+            {
+                const MoveEdge &move_edge = move_map->at(*it);
+                uint16_t packed_move_key = pack_move_key_16(*it);
+                raw.push_back(packed_move_key & 0xff);
+                raw.push_back(packed_move_key >> 8);
+                write_varint(&raw, move_edge.m_times_played);
+                write_varint(&raw, move_edge.m_times_scored);
+                write_varint(&raw, move_edge.m_white_half_points);
+            }
+        }
+
+        std::vector<uint8_t> stored = compress_block(raw, DEFAULT_CODEC);
+
+        CompressedBlockIndexEntry entry;
+        entry.m_first_hash = hashes[block_start];
+        entry.m_offset = blocks.size();
+        entry.m_stored_size = stored.size();
+        entry.m_raw_size = raw.size();
+        block_index.push_back(entry);
+
+        blocks.insert(blocks.end(), stored.begin(), stored.end());
+    }
+
+    CompressedShardHeader header;
+    std::copy(COMPRESSED_SHARD_MAGIC, COMPRESSED_SHARD_MAGIC + 4, header.m_magic);
+    header.m_version = COMPRESSED_SHARD_VERSION;
+    header.m_codec = DEFAULT_CODEC;
+    header.m_root_hash = m_root_hash;
+    header.m_position_count = hashes.size();
+    header.m_block_count = block_index.size();
+
+    stream.write(reinterpret_cast<char *>(&header), sizeof(header));
+    stream.write(reinterpret_cast<char *>(block_index.data()), block_index.size() * sizeof(CompressedBlockIndexEntry));
+    stream.write(reinterpret_cast<char *>(blocks.data()), blocks.size());
+    stream.close();
+}
+
+// Throws std::runtime_error if the header isn't that of a shard this build can read.
+static void check_compressed_shard_header(const CompressedShardHeader &header)
+{
+    if (!std::equal(COMPRESSED_SHARD_MAGIC, COMPRESSED_SHARD_MAGIC + 4, header.m_magic))
+    {
+        throw std::runtime_error("not a compressed tablebase shard");
+    }
+    if (header.m_version != COMPRESSED_SHARD_VERSION)
+    {
+        throw std::runtime_error("format version " + std::to_string(header.m_version) +
+                                 ", this build reads version " + std::to_string(COMPRESSED_SHARD_VERSION));
+    }
+}
+
+// Throws std::runtime_error if the block isn't within the blocks_size bytes after the index.
+static void check_block_bounds(const CompressedBlockIndexEntry &entry, uint64_t blocks_size)
+{
+    if (entry.m_offset > blocks_size || entry.m_stored_size > blocks_size - entry.m_offset)
+    {
+        throw std::runtime_error("block is past the end of the file");
+    }
+}
+
+void Tablebase::read_from_compressed_file(std::string file_path, int shard)
+{
+    std::vector<uint8_t> data;
+    if (!read_whole_file(file_path, &data))
+    {
+        throw std::runtime_error("Could not open file: " + file_path);
+    }
+
+    try
+    {
+        if (data.size() < sizeof(CompressedShardHeader))
+        {
+            throw std::runtime_error("file is truncated");
+        }
+        CompressedShardHeader header;
+        std::memcpy(&header, data.data(), sizeof(header));
+        check_compressed_shard_header(header);
+
+        uint64_t index_size = (uint64_t)header.m_block_count * sizeof(CompressedBlockIndexEntry);
+        if (data.size() - sizeof(CompressedShardHeader) < index_size)
+        {
+            throw std::runtime_error("block index is truncated");
+        }
+        std::vector<CompressedBlockIndexEntry> block_index(header.m_block_count);
+        std::memcpy(block_index.data(), data.data() + sizeof(CompressedShardHeader), index_size);
+        const uint8_t *blocks = data.data() + sizeof(CompressedShardHeader) + index_size;
+        uint64_t blocks_size = data.size() - sizeof(CompressedShardHeader) - index_size;
+
+        shards[shard].reserve(header.m_position_count);
+        for (uint32_t b = 0; b < header.m_block_count; b++)
+        {
+            check_block_bounds(block_index[b], blocks_size);
+            std::vector<uint8_t> raw = decompress_block(blocks + block_index[b].m_offset, block_index[b], header.m_codec);
+            decode_block(raw, block_index[b].m_first_hash,
+                         [this, shard](z_hash_t hash, std::shared_ptr<MovesPlayed> move_map)
+                         {
+                             if (hash % TABLEBASE_SHARD_COUNT != (z_hash_t)shard)
+                             {
+                                 throw std::runtime_error("position of another shard");
+                             }
+                             shards[shard][hash] = move_map;
+                             return true;
+                         });
+        }
+    }
+    catch (const std::runtime_error &e)
+    {
+        throw std::runtime_error("Cannot read compressed tablebase shard " + file_path + ": " + e.what());
+    }
+}
+
+/*
+    Looks up a single position in a compressed shard file, decoding only the block that
+    could contain it. The returned moves have their times played, but no destination hash
+    or pgn move. Returns NULL if the position isn't in the file, or the file can't be opened.
+    Throws std::runtime_error if the file isn't a valid shard.
+*/
+std::shared_ptr<MovesPlayed> Tablebase::probe_compressed_file(std::string file_path, z_hash_t position_hash)
+{
+    std::ifstream infile(file_path, std::ios::binary);
+    if (!infile.is_open())
+    {
+        return NULL;
+    }
+
+    infile.seekg(0, std::ios::end);
+    uint64_t file_size = infile.tellg();
+    infile.seekg(0, std::ios::beg);
+
+    std::shared_ptr<MovesPlayed> result = NULL;
+    try
+    {
+        CompressedShardHeader header;
+        if (!infile.read(reinterpret_cast<char *>(&header), sizeof(header)))
+        {
+            throw std::runtime_error("file is truncated");
+        }
+        check_compressed_shard_header(header);
+
+        uint64_t index_size = (uint64_t)header.m_block_count * sizeof(CompressedBlockIndexEntry);
+        if (file_size - sizeof(CompressedShardHeader) < index_size)
+        {
+            throw std::runtime_error("block index is truncated");
+        }
+        std::vector<CompressedBlockIndexEntry> block_index(header.m_block_count);
+        infile.read(reinterpret_cast<char *>(block_index.data()), index_size);
+        std::streampos blocks_start = infile.tellg();
+        uint64_t blocks_size = file_size - sizeof(CompressedShardHeader) - index_size;
+
+        // the last block whose first hash is not greater than the position hash
+        auto block = std::upper_bound(
+            block_index.begin(), block_index.end(), position_hash,
+            [](z_hash_t hash, const CompressedBlockIndexEntry &entry)
+            { return hash < entry.m_first_hash; });
+        if (block == block_index.begin())
+        {
+            return NULL;
+        }
+        block--;
+        check_block_bounds(*block, blocks_size);
+
+        std::vector<uint8_t> stored(block->m_stored_size);
+        infile.seekg(blocks_start + (std::streamoff)block->m_offset);
+        infile.read(reinterpret_cast<char *>(stored.data()), block->m_stored_size);
+        std::vector<uint8_t> raw = decompress_block(stored.data(), *block, header.m_codec);
+
+        decode_block(raw, block->m_first_hash,
+                     [&result, position_hash](z_hash_t hash, std::shared_ptr<MovesPlayed> move_map)
+                     {
+                         if (hash == position_hash)
+                         {
+                             result = move_map;
+                         }
+                         // positions are sorted, so we can stop once we're past the one we want
+                         return hash < position_hash;
+                     });
+    }
+    catch (const std::runtime_error &e)
+    {
+        throw std::runtime_error("Cannot read compressed tablebase shard " + file_path + ": " + e.what());
+    }
+    return result;
+}
+
+/*
+    Walks the tablebase from the root position, replaying every move to recompute the
+    destination hash and pgn move of each MoveEdge. Positions are only visited once,
+    even if they are reached through transpositions.
+*/
+void Tablebase::restore_move_edges()
+{
+    std::queue<std::shared_ptr<Position>> to_visit;
+    std::unordered_set<z_hash_t> visited;
+
+    to_visit.push(starting_position());
+    visited.insert(m_root_hash);
+
+    while (!to_visit.empty())
+    {
+        std::shared_ptr<Position> position = to_visit.front();
+        to_visit.pop();
+
+        z_hash_t hash = zobrist_hash(position.get());
+        uint16_t shard = hash % TABLEBASE_SHARD_COUNT;
+        auto node = shards[shard].find(hash);
+        if (node == shards[shard].end())
+        {
+            continue;
+        }
+
+        for (auto it = node->second->begin(); it != node->second->end(); it++)
+        {
+            std::string pgn_move = movekey_to_san(position, it->first);
+            strncpy(it->second.m_pgn_move, pgn_move.c_str(), sizeof(MoveEdge::m_pgn_move));
+
+            std::shared_ptr<Position> next_position = std::make_shared<Position>(*position);
+            next_position->advance_position(it->first);
+            it->second.m_dest_hash = zobrist_hash(next_position.get());
+
+            if (visited.insert(it->second.m_dest_hash).second)
+            {
+                to_visit.push(next_position);
+            }
+        }
+    }
+}
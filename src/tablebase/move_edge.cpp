@@ -1,4 +1,24 @@
 #include "tablebase/move_edge.hpp"
+#include <algorithm>
+
+// Result tag of a pgn game ("1-0", "0-1", "1/2-1/2", "*"), whitespace is ignored.
+GameResult parse_game_result(std::string result)
+{
+    result.erase(std::remove_if(result.begin(), result.end(), ::isspace), result.end());
+    if (result == "1-0")
+    {
+        return WHITE_WIN;
+    }
+    if (result == "0-1")
+    {
+        return BLACK_WIN;
+    }
+    if (result == "1/2-1/2")
+    {
+        return DRAW;
+    }
+    return UNKNOWN_RESULT;
+}
 
 bool compare_key_move_pair(std::pair<MoveKey, MoveEdge> p1, std::pair<MoveKey, MoveEdge> p2)
 {
@@ -22,6 +42,7 @@ std::ostream &operator<<(std::ostream &os, MoveEdge &move_edge)
         << "dest_hash: " << move_edge.m_dest_hash << std::endl
         << "pgn_move: " << move_edge.m_pgn_move << std::endl
         << "times_played: " << move_edge.m_times_played << std::endl
+        << "white_score: " << move_edge.m_white_half_points / 2.0 << "/" << move_edge.m_times_scored << std::endl
         << std::endl;
     return os;
 }
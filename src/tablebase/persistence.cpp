@@ -1,4 +1,9 @@
 #include "tablebase/tablebase.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <stdexcept>
 
 template <typename T>
 static void write(std::fstream *stream, T *data, size_t size)
@@ -6,90 +11,201 @@ static void write(std::fstream *stream, T *data, size_t size)
     stream->write(reinterpret_cast<char *>(data), size);
 }
 
+// Copies the next value out of a shard file, throws if the file ends before it.
+template <typename T>
+static T read_value(const std::vector<char> &data, size_t *index, const std::string &file_path)
+{
+    if (data.size() - *index < sizeof(T))
+    {
+        throw std::runtime_error("Tablebase shard is truncated: " + file_path);
+    }
+    T value;
+    std::memcpy(&value, data.data() + *index, sizeof(T));
+    *index += sizeof(T);
+    return value;
+}
+
 void Tablebase::read_from_file(std::string file_path, int shard)
 {
-    std::streampos size;
-    char *data;
-    int index = 0;
+    std::vector<char> data;
+    size_t index = 0;
     std::ifstream infile(file_path, std::ios::binary | std::ios::ate);
 
-    if (infile.is_open())
+    if (!infile.is_open())
     {
-        size = infile.tellg();
-
-        data = new char[size];
-        infile.seekg(0, std::ios::beg);
-        infile.read(data, size);
-        infile.close();
+        throw std::runtime_error("Could not open file: " + file_path);
     }
-    else
+    data.resize(infile.tellg());
+    infile.seekg(0, std::ios::beg);
+    infile.read(data.data(), data.size());
+    infile.close();
+
+    // version 1 shards have no header, they start with the root hash
+    uint8_t version = 1;
+    if (data.size() < sizeof(z_hash_t) || read_value<z_hash_t>(data, &index, file_path) != m_root_hash)
     {
-        std::cerr << ColorCode::red << "Could not open file: " << file_path << ColorCode::end << std::endl;
-        assert(false);
+        index = 0;
+        char magic[sizeof(TABLEBASE_SHARD_MAGIC)];
+        if (data.size() < sizeof(magic) + 1)
+        {
+            throw std::runtime_error("Not a tablebase shard: " + file_path);
+        }
+        std::memcpy(magic, data.data(), sizeof(magic));
+        index += sizeof(magic);
+        if (!std::equal(TABLEBASE_SHARD_MAGIC, TABLEBASE_SHARD_MAGIC + sizeof(magic), magic))
+        {
+            throw std::runtime_error("Not a tablebase shard: " + file_path);
+        }
+        version = read_value<uint8_t>(data, &index, file_path);
+        if (version != TABLEBASE_SHARD_VERSION)
+        {
+            throw std::runtime_error("Tablebase shard " + file_path + " has format version " + std::to_string(version) +
+                                     ", this build reads up to version " + std::to_string(TABLEBASE_SHARD_VERSION));
+        }
+        // the root hash, the hash of the starting position
+        read_value<z_hash_t>(data, &index, file_path);
     }
 
-    // m_root_hash = *((z_hash_t *)(data + index));
-    index += sizeof(z_hash_t);
+    uint32_t tablebase_size = read_value<uint32_t>(data, &index, file_path);
+    shards[shard].reserve(tablebase_size);
 
-    uint32_t tablebase_size = *((uint32_t *)(data + index));
-    index += sizeof(uint32_t);
-
-    for (int n = 0; n < tablebase_size; n++)
+    for (uint32_t n = 0; n < tablebase_size; n++)
     {
-        z_hash_t key_hash = *((z_hash_t *)(data + index));
-        index += sizeof(z_hash_t);
-
-        uint32_t move_map_size = *((uint32_t *)(data + index));
-        index += sizeof(uint32_t);
+        z_hash_t key_hash = read_value<z_hash_t>(data, &index, file_path);
+        uint32_t move_map_size = read_value<uint32_t>(data, &index, file_path);
+        if (key_hash % TABLEBASE_SHARD_COUNT != (z_hash_t)shard)
+        {
+            throw std::runtime_error("Tablebase shard has a position of another shard: " + file_path);
+        }
 
         std::shared_ptr<std::unordered_map<MoveKey, MoveEdge>> move_map =
             std::make_shared<std::unordered_map<MoveKey, MoveEdge>>();
 
-        for (int m = 0; m < move_map_size; m++)
+        for (uint32_t m = 0; m < move_map_size; m++)
         {
-
-            MoveKey move_key = *((uint32_t *)(data + index));
-            assert((move_key >> 24) == 0);
-            index += sizeof(MoveKey);
-
-            z_hash_t dest_hash = *((z_hash_t *)(data + index));
-            index += sizeof(MoveEdge::m_dest_hash);
-
-            char pgn_move[8];
-            strncpy(pgn_move, data + index, sizeof(MoveEdge::m_pgn_move));
+            MoveKey move_key = read_value<MoveKey>(data, &index, file_path);
+            if ((move_key >> 24) != 0)
+            {
+                throw std::runtime_error("Tablebase shard is corrupt: " + file_path);
+            }
+
+            z_hash_t dest_hash = read_value<z_hash_t>(data, &index, file_path);
+
+            // terminated even if all of the stored characters are used
+            char pgn_move[sizeof(MoveEdge::m_pgn_move) + 1] = {0};
+            if (data.size() - index < sizeof(MoveEdge::m_pgn_move))
+            {
+                throw std::runtime_error("Tablebase shard is truncated: " + file_path);
+            }
+            std::memcpy(pgn_move, data.data() + index, sizeof(MoveEdge::m_pgn_move));
             index += sizeof(MoveEdge::m_pgn_move);
 
-            uint32_t times_played = *((uint32_t *)(data + index));
-            index += sizeof(MoveEdge::m_times_played);
+            uint32_t times_played = read_value<uint32_t>(data, &index, file_path);
+            uint32_t times_scored = 0;
+            uint32_t white_half_points = 0;
+            if (version >= 2)
+            {
+                times_scored = read_value<uint32_t>(data, &index, file_path);
+                white_half_points = read_value<uint32_t>(data, &index, file_path);
+            }
 
-            MoveEdge moveEdge(dest_hash, pgn_move, times_played);
+            MoveEdge moveEdge(dest_hash, pgn_move, times_played, times_scored, white_half_points);
 
             move_map->insert(std::pair(move_key, moveEdge));
         }
 
-        assert(shard == key_hash % TABLEBASE_SHARD_COUNT);
-
         shards[shard][key_hash] = move_map;
     }
 }
 
+// The shard of a file named NNN.tb or NNN.tbc, or -1 if the name isn't the one of a shard.
+static int shard_of_file(const fs::path &file_path)
+{
+    std::string stem = file_path.stem().string();
+    if (stem.size() != 3 || !std::all_of(stem.begin(), stem.end(), [](char c)
+                                         { return c >= '0' && c <= '9'; }))
+    {
+        return -1;
+    }
+    int shard = std::stoi(stem);
+    return shard < Tablebase::get_shard_count() ? shard : -1;
+}
+
 void Tablebase::read_from_directory(fs::path source_directory_path)
 {
-    int count = 0;
+    std::vector<fs::path> shard_file_paths;
+    std::vector<uint16_t> file_shards;
+    std::vector<fs::path> paths_by_shard(TABLEBASE_SHARD_COUNT);
+    int compressed_count = 0;
     for (const auto &entry : std::filesystem::directory_iterator(source_directory_path))
     {
-        std::string filepath = entry.path().generic_string();
-        size_t path_end = filepath.rfind('/');
-        size_t extension_start = filepath.rfind(".tb");
-        std::string filename = filepath.substr(path_end + 1, extension_start - path_end - 1);
-        uint16_t shard = std::stoi(filename);
-        read_from_file(filepath, shard);
-        count++;
+        // the directory can also hold bookkeeping files (such as the list of completed pgn files)
+        int shard = shard_of_file(entry.path());
+        if ((entry.path().extension() != ".tb" && entry.path().extension() != ".tbc") || shard < 0)
+        {
+            continue;
+        }
+        if (!paths_by_shard[shard].empty())
+        {
+            throw std::runtime_error("Tablebase shard " + std::to_string(shard) + " is in two files: " +
+                                     paths_by_shard[shard].string() + " and " + entry.path().string());
+        }
+        paths_by_shard[shard] = entry.path();
+        shard_file_paths.push_back(entry.path());
+        file_shards.push_back(shard);
+        compressed_count += entry.path().extension() == ".tbc";
+    }
+
+    // Every file holds a different shard, so they can be read concurrently without locking.
+    WaitGroup shard_reads(shared_thread_pool());
+    std::vector<std::future<void>> read_results;
+    m_load_timings = std::vector<ShardLoadTiming>(shard_file_paths.size());
+
+    for (size_t i = 0; i < shard_file_paths.size(); i++)
+    {
+        uint16_t shard = file_shards[i];
+        bool compressed = shard_file_paths[i].extension() == ".tbc";
+        ShardLoadTiming *timing = &m_load_timings[i];
+        std::string filepath = shard_file_paths[i].generic_string();
+
+        read_results.push_back(shard_reads.submit(
+            [this, shard, compressed, timing, filepath]()
+            {
+                auto clock_start = std::chrono::high_resolution_clock::now();
+                if (compressed)
+                {
+                    read_from_compressed_file(filepath, shard);
+                }
+                else
+                {
+                    read_from_file(filepath, shard);
+                }
+                auto clock_end = std::chrono::high_resolution_clock::now();
+
+                timing->m_shard = shard;
+                timing->m_positions = shards[shard].size();
+                timing->m_file_size = fs::file_size(filepath);
+                timing->m_duration = std::chrono::duration_cast<std::chrono::microseconds>(clock_end - clock_start);
+            }));
+    }
+    shard_reads.wait();
+
+    // rethrows the first error of a shard that couldn't be read
+    for (auto it = read_results.begin(); it != read_results.end(); it++)
+    {
+        it->get();
+    }
+
+    std::sort(m_load_timings.begin(), m_load_timings.end(),
+              [](const ShardLoadTiming &a, const ShardLoadTiming &b)
+              { return a.m_shard < b.m_shard; });
+
+    // compressed shards don't store destination hashes and pgn moves, they are recomputed
+    // by walking the tablebase once every shard has been read.
+    if (compressed_count)
+    {
+        restore_move_edges();
     }
-    // TODO make logger global and static, right now it just belongs to the CLI
-    // std::cout << ColorCode::green << "Successfully read "
-    //           << ColorCode::yellow << count << ColorCode::green << " tablebases"
-    //           << ColorCode::end << std::endl;
 }
 
 void Tablebase::serialize_tablebase(std::string file_path, int shard)
@@ -105,6 +221,13 @@ void Tablebase::serialize_tablebase(std::string file_path, int shard)
         return;
     }
 
+    // 5 bytes -> magic and format version
+    char magic[sizeof(TABLEBASE_SHARD_MAGIC)];
+    std::copy(TABLEBASE_SHARD_MAGIC, TABLEBASE_SHARD_MAGIC + sizeof(magic), magic);
+    write(&stream, magic, sizeof(magic));
+    uint8_t version = TABLEBASE_SHARD_VERSION;
+    write(&stream, &version, sizeof(uint8_t));
+
     // 8 bytes (464bits) -> z_hash_t: hash of starting position
     write(&stream, &m_root_hash, sizeof(z_hash_t));
 
@@ -125,7 +248,7 @@ void Tablebase::serialize_tablebase(std::string file_path, int shard)
         uint32_t move_map_size = move_map->size();
         write(&stream, &move_map_size, sizeof(uint32_t));
 
-        // MoveEdge serialization (4, 8, 8, 4)
+        // MoveEdge serialization (4, 8, 8, 4, 4, 4)
         for (auto it = move_map->begin(); it != move_map->end(); it++)
         {
             MoveKey t_move_key = it->first;
@@ -133,33 +256,41 @@ void Tablebase::serialize_tablebase(std::string file_path, int shard)
             write(&stream, &(it->second.m_dest_hash), sizeof(MoveEdge::m_dest_hash));
             write(&stream, &(it->second.m_pgn_move), sizeof(MoveEdge::m_pgn_move));
             write(&stream, &(it->second.m_times_played), sizeof(MoveEdge::m_times_played));
+            write(&stream, &(it->second.m_times_scored), sizeof(MoveEdge::m_times_scored));
+            write(&stream, &(it->second.m_white_half_points), sizeof(MoveEdge::m_white_half_points));
         }
     }
     stream.close();
 }
 
 void Tablebase::serialize_all(fs::path destination_directory_path)
+{
+    serialize_all(destination_directory_path, false);
+}
+
+void Tablebase::serialize_all(fs::path destination_directory_path, bool compressed)
 {
     fs::create_directories(destination_directory_path);
 
-    ThreadPool thread_pool = ThreadPool();
-    // Keep an array of functions outside of the loop such that we can use it's address
-    // as an argument for the task. If the function is a local variable inside the loop,
-    // by the time a thread executes a task the function might be mangled already (since
-    // it lives on the stack)
-    std::function<void(std::string &)> functions[Tablebase::get_shard_count()];
+    WaitGroup shard_writes(shared_thread_pool());
 
     for (uint8_t shard = 0; shard < Tablebase::get_shard_count(); shard++)
     {
-        std::stringstream file_suffix;
-        file_suffix << std::setw(3) << std::setfill('0') << std::to_string(shard) << ".tb";
+        std::stringstream file_stem;
+        file_stem << std::setw(3) << std::setfill('0') << std::to_string(shard);
 
-        functions[shard] =
-            std::bind(&Tablebase::serialize_tablebase, this, std::placeholders::_1, shard);
+        // a shard must only exist in one format, otherwise it would be read twice
+        fs::remove(destination_directory_path / (file_stem.str() + (compressed ? ".tb" : ".tbc")));
 
-        std::string path = destination_directory_path / file_suffix.str();
-        Task task = Task(&functions[shard], path);
-        thread_pool.add_task(task);
+        std::string path = destination_directory_path / (file_stem.str() + (compressed ? ".tbc" : ".tb"));
+        if (compressed)
+        {
+            shard_writes.submit(&Tablebase::serialize_compressed_tablebase, this, path, shard);
+        }
+        else
+        {
+            shard_writes.submit(&Tablebase::serialize_tablebase, this, path, shard);
+        }
     }
-    thread_pool.join_pool();
+    shard_writes.wait();
 }
@@ -1,4 +1,7 @@
 #include "tablebase/tablebase.hpp"
+#include <limits>
+#include <queue>
+#include <unordered_set>
 
 // | 00 | start_square | end_square | promotion_piece
 
@@ -23,11 +26,17 @@ bool Tablebase::position_exists(z_hash_t position_hash)
 }
 
 void Tablebase::update(z_hash_t insert_hash, z_hash_t dest_hash, MoveKey move_key, std::string pgn_move)
+{
+    update(insert_hash, dest_hash, move_key, pgn_move, UNKNOWN_RESULT);
+}
+
+void Tablebase::update(z_hash_t insert_hash, z_hash_t dest_hash, MoveKey move_key, std::string pgn_move, GameResult result)
 {
     uint16_t shard = insert_hash % TABLEBASE_SHARD_COUNT;
     std::unique_lock<std::mutex> lock(mutexes[shard]);
 
     MoveEdge moveEdge(dest_hash, pgn_move);
+    moveEdge.record_result(result);
 
     // find the node corresponding to the zobrist hash for the position we are inserting at.
     auto node = shards[shard].find(insert_hash);
@@ -63,6 +72,8 @@ void Tablebase::increment_times_played_or_insert_move(
         {
             assert(it->second.m_dest_hash == moveEdge.m_dest_hash);
             it->second.m_times_played++;
+            it->second.m_times_scored += moveEdge.m_times_scored;
+            it->second.m_white_half_points += moveEdge.m_white_half_points;
             break;
         }
     }
@@ -123,7 +134,16 @@ void Tablebase::list_all_moves_for_position(z_hash_t position_hash)
     {
         for (auto it = node->second->begin(); it != node->second->end(); it++)
         {
-            std::cout << it->second.m_pgn_move << std::endl;
+            std::cout << std::left << std::setw(8) << it->second.m_pgn_move;
+
+            // once analyzed, also show how the games reaching the resulting position went
+            const PositionStats *stats = get_position_stats(it->second.m_dest_hash);
+            if (stats)
+            {
+                std::cout << std::left << std::setw(12) << ("games: " + std::to_string(stats->m_games))
+                          << "white score: " << std::fixed << std::setprecision(3) << stats->expected_score(true);
+            }
+            std::cout << std::endl;
         }
     }
 }
@@ -185,4 +205,96 @@ int Tablebase::total_size()
         s += shards[shard].size();
     }
     return s;
-}
\ No newline at end of file
+}
+
+int Tablebase::total_edges()
+{
+    int s = 0;
+    for (int shard = 0; shard < TABLEBASE_SHARD_COUNT; shard++)
+    {
+        for (auto node = shards[shard].begin(); node != shards[shard].end(); node++)
+        {
+            s += node->second ? node->second->size() : 0;
+        }
+    }
+    return s;
+}
+
+/*
+    Drops every move that was played less than min_times_played times, and then every
+    position that can no longer be reached from the root within max_ply plies (or has
+    no moves left). A max_ply of 0 or less doesn't limit the depth.
+*/
+PruneSummary Tablebase::prune(uint32_t min_times_played, int max_ply)
+{
+    PruneSummary summary;
+    summary.positions_before = total_size();
+    summary.edges_before = total_edges();
+
+    if (max_ply <= 0)
+    {
+        max_ply = std::numeric_limits<int>::max();
+    }
+
+    for (int shard = 0; shard < TABLEBASE_SHARD_COUNT; shard++)
+    {
+        for (auto node = shards[shard].begin(); node != shards[shard].end(); node++)
+        {
+            if (!node->second)
+            {
+                continue;
+            }
+            for (auto it = node->second->begin(); it != node->second->end();)
+            {
+                it = it->second.m_times_played < min_times_played ? node->second->erase(it) : std::next(it);
+            }
+        }
+    }
+
+    // breadth first, so that a position reached through transpositions gets its shortest distance to the root
+    std::unordered_set<z_hash_t> reachable;
+    std::queue<std::pair<z_hash_t, int>> to_visit;
+    // operator[] would insert an empty entry, so look positions up with find
+    auto root = shards[m_root_hash % TABLEBASE_SHARD_COUNT].find(m_root_hash);
+    if (root != shards[m_root_hash % TABLEBASE_SHARD_COUNT].end() && root->second)
+    {
+        reachable.insert(m_root_hash);
+        to_visit.push(std::make_pair(m_root_hash, 0));
+    }
+
+    while (!to_visit.empty())
+    {
+        auto [hash, ply] = to_visit.front();
+        to_visit.pop();
+
+        auto move_map = shards[hash % TABLEBASE_SHARD_COUNT].at(hash);
+        for (auto it = move_map->begin(); it != move_map->end(); it++)
+        {
+            z_hash_t dest_hash = it->second.m_dest_hash;
+            uint16_t dest_shard = dest_hash % TABLEBASE_SHARD_COUNT;
+            if (ply + 1 < max_ply &&
+                shards[dest_shard].find(dest_hash) != shards[dest_shard].end() &&
+                shards[dest_shard].at(dest_hash) &&
+                reachable.insert(dest_hash).second)
+            {
+                to_visit.push(std::make_pair(dest_hash, ply + 1));
+            }
+        }
+    }
+
+    for (int shard = 0; shard < TABLEBASE_SHARD_COUNT; shard++)
+    {
+        for (auto node = shards[shard].begin(); node != shards[shard].end();)
+        {
+            bool keep = node->second && !node->second->empty() && reachable.find(node->first) != reachable.end();
+            node = keep ? std::next(node) : shards[shard].erase(node);
+        }
+    }
+
+    // the statistics no longer match the pruned graph
+    m_position_stats.clear();
+
+    summary.positions_after = total_size();
+    summary.edges_after = total_edges();
+    return summary;
+}
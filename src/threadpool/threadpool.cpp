@@ -1,4 +1,5 @@
 #include "threadpool/threadpool.hpp"
+#include "options.hpp"
 #include "util.hpp"
 #include <iostream>
 #include <vector>
@@ -7,9 +8,10 @@
 #include <condition_variable>
 #include <random>
 #include <ctime>
-
-// TODO take inspiration from the threadpool impl vanya sent you, for hints on how to
-// accept more varied functions into the threads
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 ThreadPool::ThreadPool()
 {
@@ -17,9 +19,14 @@ ThreadPool::ThreadPool()
     initialize_threads();
 }
 
-ThreadPool::ThreadPool(int num_threads)
+ThreadPool::ThreadPool(int num_threads) : ThreadPool(num_threads, false)
 {
-    if (num_threads >= 0 && num_threads <= 1024)
+}
+
+// A thread count out of range falls back to one thread per hardware thread.
+ThreadPool::ThreadPool(int num_threads, bool pin_threads) : m_pin_threads(pin_threads)
+{
+    if (num_threads >= 0 && num_threads <= MAX_THREADS)
     {
         m_num_threads = num_threads;
     }
@@ -30,82 +37,253 @@ ThreadPool::ThreadPool(int num_threads)
     initialize_threads();
 }
 
+ThreadPool::~ThreadPool()
+{
+    join_pool(false);
+}
+
+// the pool and the deque index of the pool thread that is running, NULL outside of pool threads
+static thread_local ThreadPool *t_thread_pool = NULL;
+static thread_local int t_thread_index = -1;
+
+// The deques are created by their threads, see spin. Returns once all of them exist.
 void ThreadPool::initialize_threads()
 {
+    m_deques.resize(m_num_threads);
     for (int i = 0; i < m_num_threads; i++)
-        pool.push_back(std::thread(&ThreadPool::spin, this));
+        pool.push_back(std::thread(&ThreadPool::spin, this, i));
+
+    std::unique_lock<std::mutex> lock(start_mutex);
+    start_cv.wait(lock, [this]
+                  { return m_started_threads == m_num_threads; });
 }
 
-// predicate which returns ​false if the waiting should be continued.
-bool ThreadPool::should_thread_wait()
+void ThreadPool::spin(int thread_index)
 {
-    return task_queue.empty() && should_wait_for_more_tasks;
+    t_thread_pool = this;
+    t_thread_index = thread_index;
+    std::thread::id id = std::this_thread::get_id();
+
+    if (m_pin_threads && !pin_current_thread(thread_index) && THREAD_POOL_DEBUG)
+    {
+        std::unique_lock<std::mutex> lock(stdout_mutex);
+        std::cout << "Could not pin thread_" << id << std::endl;
+    }
+    {
+        std::unique_lock<std::mutex> lock(start_mutex);
+        m_deques[thread_index] = std::make_unique<WorkStealingDeque<Task>>();
+        m_started_threads++;
+        start_cv.notify_all();
+        start_cv.wait(lock, [this]
+                      { return m_started_threads == m_num_threads; });
+    }
+
+    while (!m_abandon_unfinished_tasks)
+    {
+        Task *task = find_task(thread_index);
+        if (task != NULL)
+        {
+            run_task(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        if (m_stopping && m_queued_tasks == 0)
+        {
+            break;
+        }
+        // after announcing that we sleep, a task added in the meantime is either seen here,
+        // or whoever added it sees us sleeping and wakes us (both sides use seq_cst atomics)
+        m_sleeping_threads++;
+        cv.wait(lock, [this]
+                { return m_queued_tasks > 0 || m_stopping; });
+        m_sleeping_threads--;
+    }
+
+    if (THREAD_POOL_DEBUG)
+    {
+        std::unique_lock<std::mutex> lock(stdout_mutex);
+        std::cout << "Thread_" << id << "is exiting... " << std::endl;
+        std::cout << "Queued tasks: " << m_queued_tasks << std::endl;
+    }
 }
 
-void ThreadPool::spin()
+// Own deque first, then the shared queue, then the other threads' deques, starting at a random one.
+Task *ThreadPool::find_task(int thread_index)
 {
-    std::thread::id id = std::this_thread::get_id();
-    while (true)
+    Task *task = m_deques[thread_index]->pop();
+
+    if (task == NULL && m_task_queue_size > 0)
     {
-        Task task;
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        if (!task_queue.empty())
         {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-            cv.wait(lock, [this]
-                    { return !should_thread_wait(); });
+            task = task_queue.front();
+            task_queue.pop();
+            m_task_queue_size--;
+        }
+    }
 
-            if (!should_wait_for_more_tasks && task_queue.empty())
+    if (task == NULL && m_num_threads > 1)
+    {
+        static thread_local std::minstd_rand victim_random(thread_index + 1);
+        int first_victim = victim_random() % m_num_threads;
+        for (int i = 0; i < m_num_threads && task == NULL; i++)
+        {
+            int victim = (first_victim + i) % m_num_threads;
+            if (victim != thread_index)
             {
-                if (THREAD_POOL_DEBUG)
-                {
-                    std::unique_lock<std::mutex> lock(stdout_mutex);
-                    std::cout << "Thread_" << id << "is exiting... " << std::endl;
-                    std::cout << "Task Queue size: " << task_queue.size() << std::endl;
-                }
-                return;
+                task = m_deques[victim]->steal();
             }
-            task = task_queue.front();
-            task_queue.pop();
         }
-        task.execute();
+    }
 
-        if (THREAD_POOL_DEBUG)
+    if (task != NULL)
+    {
+        m_queued_tasks--;
+    }
+    return task;
+}
+
+void ThreadPool::run_task(Task *task)
+{
+    task->execute();
+    delete task;
+
+    if (--m_unfinished_tasks == 0)
+    {
+        std::unique_lock<std::mutex> lock(idle_mutex);
+        idle_cv.notify_all();
+    }
+}
+
+// Only a pool thread may push to its own deque, everyone else goes through the shared queue.
+void ThreadPool::push_task(Task *task)
+{
+    if (t_thread_pool == this)
+    {
+        m_deques[t_thread_index]->push(task);
+    }
+    else
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        task_queue.push(task);
+        m_task_queue_size++;
+    }
+}
+
+// The tasks have to be counted in m_queued_tasks before they are pushed.
+void ThreadPool::wake_threads(int64_t tasks)
+{
+    if (m_sleeping_threads > 0)
+    {
+        // taking the lock makes sure a thread that is about to sleep is already waiting
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        lock.unlock();
+        if (tasks == 1)
         {
-            std::unique_lock<std::mutex> lock(stdout_mutex);
-            std::cout << "Thread_" << id << std::endl;
+            cv.notify_one();
+        }
+        else
+        {
+            cv.notify_all();
         }
     }
 }
 
 void ThreadPool::add_task(Task task)
 {
+    m_unfinished_tasks++;
+    m_queued_tasks++;
+    push_task(new Task(std::move(task)));
+    wake_threads(1);
+}
+
+void ThreadPool::add_tasks(std::vector<Task> tasks)
+{
+    if (tasks.empty())
+    {
+        return;
+    }
+
+    m_unfinished_tasks += tasks.size();
+    m_queued_tasks += tasks.size();
+    if (t_thread_pool == this)
+    {
+        for (auto it = tasks.begin(); it != tasks.end(); it++)
+        {
+            m_deques[t_thread_index]->push(new Task(std::move(*it)));
+        }
+    }
+    else
     {
         std::unique_lock<std::mutex> lock(queue_mutex);
-        task_queue.push(task);
+        for (auto it = tasks.begin(); it != tasks.end(); it++)
+        {
+            task_queue.push(new Task(std::move(*it)));
+        }
+        m_task_queue_size += tasks.size();
+    }
+    wake_threads(tasks.size());
+}
+
+void ThreadPool::wait_idle()
+{
+    std::unique_lock<std::mutex> lock(idle_mutex);
+    idle_cv.wait(lock, [this]
+                 { return m_unfinished_tasks == 0; });
+}
+
+// Once the threads are joined nobody else touches the deques. Destroying a submitted task breaks its future.
+void ThreadPool::discard_queued_tasks()
+{
+    int64_t discarded = 0;
+    for (auto it = m_deques.begin(); it != m_deques.end(); it++)
+    {
+        for (Task *task = (*it)->pop(); task != NULL; task = (*it)->pop())
+        {
+            delete task;
+            discarded++;
+        }
+    }
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        while (!task_queue.empty())
+        {
+            delete task_queue.front();
+            task_queue.pop();
+            discarded++;
+        }
+        m_task_queue_size = 0;
+    }
+
+    m_queued_tasks -= discarded;
+    if (discarded && (m_unfinished_tasks -= discarded) == 0)
+    {
+        std::unique_lock<std::mutex> lock(idle_mutex);
+        idle_cv.notify_all();
     }
-    cv.notify_one();
 }
 
 /*
- Waits for already started tasks to complete, and joins the threads.
- // TODO proper destructor for the threadpool, proper shut down of threads
+ Waits for already started tasks to complete, and joins the threads. Unless they are abandoned,
+ the queued tasks are run first. Abandoned tasks that were submitted break their futures.
 */
 void ThreadPool::join_pool(bool abandon_unfinished_tasks)
 {
-    if (abandon_unfinished_tasks)
     {
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-            while (!task_queue.empty())
-            {
-                task_queue.pop();
-            }
-        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        m_abandon_unfinished_tasks = abandon_unfinished_tasks;
+        m_stopping = true;
     }
-    should_wait_for_more_tasks = false;
     cv.notify_all();
 
     for (auto it = pool.begin(); it != pool.end(); it++)
     {
+        if (!it->joinable())
+        {
+            continue;
+        }
         if (THREAD_POOL_DEBUG)
         {
             std::unique_lock<std::mutex> lock(stdout_mutex);
@@ -113,6 +291,7 @@ void ThreadPool::join_pool(bool abandon_unfinished_tasks)
         }
         it->join();
     }
+    discard_queued_tasks();
 }
 
 void ThreadPool::join_pool()
@@ -120,6 +299,123 @@ void ThreadPool::join_pool()
     join_pool(false);
 }
 
+bool ThreadPool::is_pool_thread()
+{
+    return t_thread_pool == this;
+}
+
+bool ThreadPool::run_pending_task()
+{
+    if (!is_pool_thread())
+    {
+        return false;
+    }
+    Task *task = find_task(t_thread_index);
+    if (task == NULL)
+    {
+        return false;
+    }
+    run_task(task);
+    return true;
+}
+
+// Decrements under the lock, so that a waiter that sees the group done can destroy it.
+void WaitGroup::done()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (--m_pending == 0)
+    {
+        m_cv.notify_all();
+    }
+}
+
+void WaitGroup::wait()
+{
+    // a pool thread mustn't block, the tasks it waits for may be in its own deque
+    while (m_pending > 0 && m_pool.is_pool_thread())
+    {
+        if (!m_pool.run_pending_task())
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]
+              { return m_pending == 0; });
+}
+
+bool pin_current_thread(int cpu_index)
+{
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0)
+    {
+        return false;
+    }
+
+    // the cpu_index-th allowed CPU, so that pinning respects taskset and cgroup limits
+    int skip = cpu_index % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &allowed) || skip-- > 0)
+        {
+            continue;
+        }
+        cpu_set_t pinned;
+        CPU_ZERO(&pinned);
+        CPU_SET(cpu, &pinned);
+        return pthread_setaffinity_np(pthread_self(), sizeof(pinned), &pinned) == 0;
+    }
+    return false;
+#else
+    return false;
+#endif
+}
+
+static std::mutex shared_thread_pool_mutex;
+static std::unique_ptr<ThreadPool> shared_pool;
+// as set by the options, 0 threads is one per hardware thread
+static int shared_pool_threads = 0;
+static bool shared_pool_pin_threads = false;
+
+// Must hold shared_thread_pool_mutex. An existing pool is replaced if it doesn't match the options.
+static void configure_shared_thread_pool()
+{
+    int threads = shared_pool_threads ? shared_pool_threads : std::max(1u, std::thread::hardware_concurrency());
+    if (shared_pool && shared_pool->size() == threads && shared_pool->pins_threads() == shared_pool_pin_threads)
+    {
+        return;
+    }
+    shared_pool = NULL;
+    shared_pool = std::make_unique<ThreadPool>(threads, shared_pool_pin_threads);
+}
+
+ThreadPool &shared_thread_pool()
+{
+    std::unique_lock<std::mutex> lock(shared_thread_pool_mutex);
+    if (!shared_pool)
+    {
+        configure_shared_thread_pool();
+    }
+    return *shared_pool;
+}
+
+void set_shared_thread_pool_size(int num_threads)
+{
+    std::unique_lock<std::mutex> lock(shared_thread_pool_mutex);
+    shared_pool_threads = num_threads;
+    configure_shared_thread_pool();
+}
+
+void set_shared_thread_pool_affinity(bool pin_threads)
+{
+    std::unique_lock<std::mutex> lock(shared_thread_pool_mutex);
+    shared_pool_pin_threads = pin_threads;
+    configure_shared_thread_pool();
+}
+
 void test_task_fn(std::string arg)
 {
     int x = 0;
@@ -131,15 +427,14 @@ void test_task_fn(std::string arg)
 
 void test()
 {
-    const Task task(&test_task_fn, "asd");
-    ThreadPool thread_pool = ThreadPool(100);
+    ThreadPool thread_pool(100);
 
     for (int i = 0; i < 300; i++)
     {
-        thread_pool.add_task(task);
+        thread_pool.add_task(Task(&test_task_fn, "asd"));
         if (i == 100)
         {
-            thread_pool.join_pool(false);
+            thread_pool.wait_idle();
         }
     }
 
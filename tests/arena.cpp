@@ -0,0 +1,123 @@
+#include "catch.hpp"
+#include "alloc_stats.hpp"
+#include "arena.hpp"
+#include "engine/evaluation.hpp"
+#include "engine/search.hpp"
+#include "move_generation.hpp"
+#include "perft.hpp"
+#include "representation/fen.hpp"
+#include <new>
+
+// The number of heap allocations fn makes on the calling thread.
+template <typename F>
+uint64_t count_heap_allocations(F fn)
+{
+    AllocationCounts before = thread_allocation_counts();
+    fn();
+    return (thread_allocation_counts() - before).m_allocations;
+}
+
+// new and delete pairs may be optimized away unless the pointer escapes
+static void *volatile escaped;
+
+TEST_CASE("the allocation hook counts the allocations of the test binary", "arena")
+{
+    REQUIRE(allocation_counting_enabled());
+
+    AllocationCounts before = thread_allocation_counts();
+    AllocationCounts all_before = allocation_counts();
+    int *value = new int(1);
+    escaped = value;
+    AllocationCounts counted = thread_allocation_counts() - before;
+    delete value;
+    REQUIRE(counted.m_allocations == 1);
+    REQUIRE(counted.m_bytes == sizeof(int));
+    REQUIRE((allocation_counts() - all_before).m_allocations >= 1);
+
+    // the array and nothrow forms go through the counted operator new too
+    before = thread_allocation_counts();
+    char *array = new char[100];
+    int *nothrow_value = new (std::nothrow) int(2);
+    escaped = array;
+    escaped = nothrow_value;
+    counted = thread_allocation_counts() - before;
+    delete[] array;
+    delete nothrow_value;
+    REQUIRE(counted.m_allocations == 2);
+    REQUIRE(counted.m_bytes == 100 + sizeof(int));
+}
+
+TEST_CASE("a search arena reuses its memory after a scope ends", "arena")
+{
+    SearchArena arena;
+    void *first;
+    {
+        SearchArena::Scope scope(arena);
+        first = arena.allocate(100, 8);
+        void *second = arena.allocate(1, 1);
+        void *third = arena.allocate(8, 8);
+        REQUIRE((uint8_t *)second == (uint8_t *)first + 100);
+        REQUIRE((uintptr_t)third % 8 == 0);
+    }
+    REQUIRE(arena.allocate(100, 8) == first);
+
+    // larger than a chunk, gets a chunk of its own
+    arena.reset();
+    arena.allocate(SearchArena::CHUNK_SIZE * 2, 8);
+    size_t chunks = arena.chunks();
+    arena.reset();
+    arena.allocate(SearchArena::CHUNK_SIZE * 2, 8);
+    REQUIRE(arena.chunks() == chunks);
+}
+
+TEST_CASE("move generation into a move list doesn't allocate from the heap", "arena")
+{
+    auto position = fen_to_position("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+    SearchArena &arena = thread_search_arena();
+    // the first use may give the thread's arena its first chunk
+    {
+        SearchArena::Scope scope(arena);
+        make_move_list(arena);
+    }
+
+    size_t move_count = 0;
+    uint64_t allocations = count_heap_allocations([&]()
+                                                  {
+                                                      SearchArena::Scope scope(arena);
+                                                      MoveList moves = make_move_list(arena);
+                                                      get_all_moves(position, &moves);
+                                                      move_count = moves.size();
+                                                  });
+    REQUIRE(move_count == 48);
+    REQUIRE(move_count == get_all_moves(position).size());
+    REQUIRE(allocations == 0);
+
+    // checkmate, evaluate generates the moves to find out
+    position = fen_to_position("rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq - 1 3");
+    int score = 0;
+    allocations = count_heap_allocations([&]()
+                                         { score = evaluate(position); });
+    REQUIRE(score == std::numeric_limits<int>::min());
+    REQUIRE(allocations == 0);
+}
+
+TEST_CASE("searching doesn't allocate from the heap once the arena has grown", "arena")
+{
+    auto position = fen_to_position("r7/8/k7/3N4/8/PK5P/8/8 w - - 0 1");
+
+    // the first search may grow the thread's arena
+    MoveKey expected = minmax_search(position, 4);
+    MoveKey movekey = 0;
+    uint64_t allocations = count_heap_allocations([&]()
+                                                  { movekey = minmax_search(position, 4); });
+    REQUIRE(movekey == expected);
+    REQUIRE(allocations == 0);
+
+    position = fen_to_position("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+    perft(position, 3, NULL);
+    uint64_t nodes = 0;
+    allocations = count_heap_allocations([&]()
+                                         { nodes = perft(position, 3, NULL); });
+    REQUIRE(nodes == 8902);
+    REQUIRE(allocations == 0);
+}
@@ -26,4 +26,18 @@ TEST_CASE("material evaluation after captures", "[basic_materia;]")
 
     REQUIRE(material_eval.white_material == 30);
     REQUIRE(material_eval.black_material == 38);
-}
\ No newline at end of file
+}
+
+TEST_CASE("material evaluation of a const position", "[basic_materia;]")
+{
+    auto position = starting_position();
+    position->advance_position(E2_SQ, E4_SQ);
+    position->advance_position(D7_SQ, D5_SQ);
+    position->advance_position(E4_SQ, D5_SQ);
+    const Position &board = *position;
+    auto material_eval = count_material(board);
+
+    REQUIRE(material_eval.white_material == 39);
+    REQUIRE(material_eval.black_material == 38);
+    REQUIRE(evaluate(*position) == evaluate(position));
+}
@@ -1,6 +1,7 @@
 #include "catch.hpp"
 #include "representation/fen.hpp"
 #include "representation/move.hpp"
+#include "tablebase/compressed_shard.hpp"
 
 TEST_CASE("movekey -> move -> movekey yields original value 01")
 {
@@ -42,4 +43,17 @@ TEST_CASE("move -> movekey -> move yields original value 02")
     auto expected_move = Move(movekey);
 
     REQUIRE(move == expected_move);
-}
\ No newline at end of file
+}
+TEST_CASE("16 bit movekey packing yields original value", "[pack_move_key_16]")
+{
+    MoveKey movekeys[4] = {
+        lan_to_movekey("e2e4"),
+        lan_to_movekey("h7h8=N"),
+        pack_move_key(B2_SQ, A1_SQ, B_QUEEN),
+        pack_move_key(A8_SQ, H1_SQ)};
+
+    for (int i = 0; i < 4; i++)
+    {
+        REQUIRE(unpack_move_key_16(pack_move_key_16(movekeys[i])) == movekeys[i]);
+    }
+}
@@ -4,6 +4,7 @@
 #include "representation/fen.hpp"
 #include "engine/engine.hpp"
 #include "move_generation.hpp"
+#include "perft.hpp"
 #include <iostream>
 #include <set>
 
@@ -150,3 +151,94 @@ TEST_CASE("make illegal move, and both kings are in check", "[move_generation]")
     REQUIRE(position->is_king_in_check(true));
     REQUIRE(position->is_king_in_check(false));
 }
+
+TEST_CASE("king can't castle out of or through check", "[move_generation]")
+{
+    // the black bishop on b4 checks the king
+    auto position = fen_to_position("4k3/8/8/8/1b6/8/8/R3K2R w KQ - 0 1");
+    auto moves = get_all_moves(position);
+    REQUIRE(!contains(&moves, m(E1_SQ, G1_SQ)));
+    REQUIRE(!contains(&moves, m(E1_SQ, C1_SQ)));
+
+    // the black rooks cover f1 and d1, the squares the king passes
+    position = fen_to_position("3rkr2/8/8/8/8/8/8/R3K2R w KQ - 0 1");
+    moves = get_all_moves(position);
+    REQUIRE(!contains(&moves, m(E1_SQ, G1_SQ)));
+    REQUIRE(!contains(&moves, m(E1_SQ, C1_SQ)));
+
+    // b1 may be attacked, the king doesn't pass it
+    position = fen_to_position("1r2k3/8/8/8/8/8/8/R3K2R w KQ - 0 1");
+    moves = get_all_moves(position);
+    REQUIRE(contains(&moves, m(E1_SQ, G1_SQ)));
+    REQUIRE(contains(&moves, m(E1_SQ, C1_SQ)));
+}
+
+// Reference counts from https://www.chessprogramming.org/Perft_Results
+TEST_CASE("move generation by reference matches the shared_ptr overloads", "[move_generation]")
+{
+    auto position = fen_to_position("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+    Position &board = *position;
+    z_hash_t hash = zobrist_hash(&board);
+
+    REQUIRE(get_all_moves(board) == get_all_moves(position));
+    REQUIRE(generate_legal_moves(board, E1_SQ) == generate_legal_moves(position, E1_SQ));
+    REQUIRE(generate_pseudolegal_piece_moves(board, E2_SQ) == generate_pseudolegal_piece_moves(position, E2_SQ));
+    // legality is checked by playing the moves, which are all taken back
+    REQUIRE(zobrist_hash(&board) == hash);
+}
+
+TEST_CASE("perft counts match the reference positions", "[move_generation]")
+{
+    struct PerftCase
+    {
+        std::string m_fen;
+        int m_depth;
+        uint64_t m_nodes;
+    };
+    std::vector<PerftCase> cases = {
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 1, 20},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 2, 400},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 3, 8902},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 4, 197281},
+        {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 1, 48},
+        {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 2, 2039},
+        {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 3, 97862},
+        {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 4, 43238},
+        {"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 3, 9467},
+        {"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 3, 62379},
+    };
+
+    ThreadPool thread_pool(4);
+    for (auto it = cases.begin(); it != cases.end(); it++)
+    {
+        INFO(it->m_fen << " depth " << it->m_depth);
+        auto position = fen_to_position(it->m_fen);
+        REQUIRE(perft(position, it->m_depth, NULL) == it->m_nodes);
+
+        PerftResult result = parallel_perft(position, it->m_depth, thread_pool, NULL);
+        REQUIRE(result.m_nodes == it->m_nodes);
+        uint64_t divide_sum = 0;
+        for (auto move = result.m_divide.begin(); move != result.m_divide.end(); move++)
+        {
+            divide_sum += move->second;
+        }
+        REQUIRE(divide_sum == it->m_nodes);
+    }
+}
+
+TEST_CASE("perft with a table counts the same nodes", "[move_generation]")
+{
+    auto position = starting_position();
+    PerftTable table(16);
+    ThreadPool thread_pool(4);
+
+    PerftResult result = parallel_perft(position, 5, thread_pool, &table);
+    REQUIRE(result.m_nodes == 4865609);
+    // 1. e3 e6 2. d3 and 1. d3 e6 2. e3 reach the same position
+    REQUIRE(result.m_table_hits > 0);
+
+    // the second run finds every subtree in the table
+    result = parallel_perft(position, 5, thread_pool, &table);
+    REQUIRE(result.m_nodes == 4865609);
+    REQUIRE(perft(position, 5, &table) == 4865609);
+}
@@ -25,3 +25,26 @@ TEST_CASE("is_king_in_check returns correct answer", "is_king_in_check")
     REQUIRE(position->is_king_in_check(false));
     REQUIRE(!position->is_king_in_check(true));
 }
+
+TEST_CASE("pgn moves resolve to the only legal move of the piece", "non_castling_move")
+{
+    // both knights attack e2, but the one on c3 is pinned by the bishop on a5
+    auto position = fen_to_position("4k3/8/8/b7/8/2N5/8/4K1N1 w - - 0 1");
+    MoveKey move_key = position->non_castling_move('N', 0, 0, 0, 'e', '2', 0, 0);
+    REQUIRE(move_key == pack_move_key(G1_SQ, E2_SQ));
+    REQUIRE(position->m_mailbox[E2_SQ] == W_KNIGHT);
+
+    // disambiguating to the pinned knight is an error, not an assertion
+    position = fen_to_position("4k3/8/8/b7/8/2N5/8/4K1N1 w - - 0 1");
+    REQUIRE_THROWS_AS(position->non_castling_move('N', 'c', 0, 0, 'e', '2', 0, 0), std::invalid_argument);
+
+    // without the pin the move is ambiguous
+    position = fen_to_position("4k3/8/8/8/8/2N5/8/4K1N1 w - - 0 1");
+    REQUIRE_THROWS_AS(position->non_castling_move('N', 0, 0, 0, 'e', '2', 0, 0), std::invalid_argument);
+    REQUIRE(position->non_castling_move('N', 'c', 0, 0, 'e', '2', 0, 0) == pack_move_key(C3_SQ, E2_SQ));
+
+    // promotions have to match the promotion piece
+    position = fen_to_position("4k3/1P6/8/8/8/8/8/4K3 w - - 0 1");
+    REQUIRE(position->non_castling_move(0, 0, 0, 0, 'b', '8', W_KNIGHT, 0) == pack_move_key(B7_SQ, B8_SQ, W_KNIGHT));
+    REQUIRE(position->m_mailbox[B8_SQ] == W_KNIGHT);
+}
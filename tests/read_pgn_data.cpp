@@ -1,8 +1,12 @@
 #include "catch.hpp"
 #include "representation/position.hpp"
 #include "process_pgn/read_pgn_data.hpp"
+#include "process_pgn/san_move.hpp"
+#include "tablebase/compressed_shard.hpp"
 #include "representation/fen.hpp"
 #include <filesystem>
+#include <queue>
+#include <unordered_set>
 
 TEST_CASE("pgn processor creates appropriate tablebase", "pgnProcessor")
 {
@@ -152,5 +156,920 @@ TEST_CASE("pgn processor recognizes illegal move in pgn file", "pgnProcessor")
     const std::string tablebase_name = "test_tb";
 
     PgnProcessor pgnProcessor(tablebase_test_dir / tablebase_name, pgn_test_database_path);
-    REQUIRE_THROWS(pgnProcessor.process_pgn_file(pgn_test_database_path / "file_001.pgn"));
+    REQUIRE_NOTHROW(pgnProcessor.process_pgn_file(pgn_test_database_path / "file_001.pgn"));
+
+    // the game is dropped as a whole, instead of the moves up to the illegal one
+    REQUIRE(pgnProcessor.get_rejected_games() == 1);
+    REQUIRE(pgnProcessor.get_tablebase()->total_size() == 0);
+}
+
+TEST_CASE("updating a tablebase only processes new and appended pgn data", "pgnProcessor")
+{
+    const fs::path tablebase_test_dir = fs::path("/tmp") / program_start_timestamp;
+    const fs::path pgn_source_path = fs::path(TEST_ROOT_DIR) /
+                                     "database" / "pgn" / "test_01" / "file_001.pgn";
+    const fs::path pgn_test_database_path = tablebase_test_dir / "pgn_update";
+    const fs::path pgn_test_file_path = pgn_test_database_path / "file_001.pgn";
+    const std::string tablebase_name = "test_tb_update";
+
+    std::ifstream source(pgn_source_path);
+    std::stringstream contents;
+    contents << source.rdbuf();
+    std::string pgn = contents.str();
+    size_t second_game_start = pgn.find("[Event", 1);
+    REQUIRE(second_game_start != std::string::npos);
+
+    fs::remove_all(pgn_test_database_path);
+    fs::remove_all(tablebase_test_dir / tablebase_name);
+    fs::create_directories(pgn_test_database_path);
+    {
+        std::ofstream outfile(pgn_test_file_path);
+        outfile << pgn.substr(0, second_game_start);
+    }
+
+    PgnProcessor first_pass(tablebase_test_dir / tablebase_name, pgn_test_database_path);
+    first_pass.process_pgn_files();
+    first_pass.serialize_all();
+
+    // nothing changed, so nothing should be processed
+    PgnProcessor noop_pass(tablebase_test_dir / tablebase_name, pgn_test_database_path);
+    PgnUpdateSummary noop_summary = noop_pass.process_new_pgn_files();
+    REQUIRE(noop_summary.unchanged_files == 1);
+    REQUIRE(noop_summary.new_files == 0);
+    REQUIRE(noop_summary.appended_files == 0);
+    REQUIRE((*noop_pass.get_tablebase() == *first_pass.get_tablebase()));
+
+    {
+        std::ofstream outfile(pgn_test_file_path, std::ios::app);
+        outfile << pgn.substr(second_game_start);
+    }
+
+    PgnProcessor update_pass(tablebase_test_dir / tablebase_name, pgn_test_database_path);
+    PgnUpdateSummary update_summary = update_pass.process_new_pgn_files();
+    REQUIRE(update_summary.appended_files == 1);
+    update_pass.serialize_all();
+
+    PgnProcessor full_pass(tablebase_test_dir / "test_tb_update_full", pgn_test_database_path);
+    full_pass.process_pgn_files();
+
+    REQUIRE((*update_pass.get_tablebase() == *full_pass.get_tablebase()));
+    REQUIRE((Tablebase(tablebase_test_dir / tablebase_name) == *full_pass.get_tablebase()));
+}
+
+TEST_CASE("compressed tablebase read from disk is equivalent to created tablebase", "pgnProcessor")
+{
+    const fs::path tablebase_test_dir = fs::path("/tmp") / program_start_timestamp;
+    const fs::path pgn_test_database_path = fs::path(TEST_ROOT_DIR) /
+                                            "database" / "pgn" / "test_04";
+    const std::string tablebase_name = "test_tb_compressed";
+    const std::string uncompressed_tablebase_name = "test_tb_uncompressed";
+
+    PgnProcessor pgnProcessor(tablebase_test_dir / tablebase_name, pgn_test_database_path);
+    pgnProcessor.set_compressed(true);
+    pgnProcessor.process_pgn_files();
+    pgnProcessor.serialize_all();
+    pgnProcessor.get_tablebase()->serialize_all(tablebase_test_dir / uncompressed_tablebase_name);
+
+    Tablebase tablebase(tablebase_test_dir / tablebase_name);
+    REQUIRE((tablebase == (*pgnProcessor.get_tablebase().get())));
+
+    uintmax_t compressed_size = 0;
+    uintmax_t uncompressed_size = 0;
+    for (const auto &entry : fs::directory_iterator(tablebase_test_dir / tablebase_name))
+    {
+        REQUIRE(entry.path().extension() != ".tb");
+        if (entry.path().extension() == ".tbc")
+        {
+            compressed_size += fs::file_size(entry.path());
+        }
+    }
+    for (const auto &entry : fs::directory_iterator(tablebase_test_dir / uncompressed_tablebase_name))
+    {
+        uncompressed_size += fs::file_size(entry.path());
+    }
+    REQUIRE(compressed_size * 4 < uncompressed_size);
+}
+
+TEST_CASE("probing a compressed shard finds the moves of a single position", "pgnProcessor")
+{
+    const fs::path tablebase_test_dir = fs::path("/tmp") / program_start_timestamp;
+    const fs::path pgn_test_database_path = fs::path(TEST_ROOT_DIR) /
+                                            "database" / "pgn" / "test_01";
+    const std::string tablebase_name = "test_tb_probe";
+
+    PgnProcessor pgnProcessor(tablebase_test_dir / tablebase_name, pgn_test_database_path);
+    pgnProcessor.set_compressed(true);
+    pgnProcessor.process_pgn_files();
+    pgnProcessor.serialize_all();
+
+    auto position = starting_position();
+    position->advance_position(m(E2_SQ, E4_SQ));
+    position->advance_position(m(C7_SQ, C5_SQ));
+    position->advance_position(m(G1_SQ, F3_SQ));
+    z_hash_t hash = zobrist_hash(position.get());
+
+    std::stringstream file_name;
+    file_name << std::setw(3) << std::setfill('0') << (hash % Tablebase::get_shard_count()) << ".tbc";
+
+    auto expected = (*pgnProcessor.get_tablebase())[hash];
+    auto probed = Tablebase::probe_compressed_file(tablebase_test_dir / tablebase_name / file_name.str(), hash);
+    REQUIRE((probed != NULL));
+    REQUIRE(probed->size() == expected->size());
+    for (auto it = expected->begin(); it != expected->end(); it++)
+    {
+        REQUIRE(probed->at(it->first).m_times_played == it->second.m_times_played);
+    }
+
+    REQUIRE((Tablebase::probe_compressed_file(tablebase_test_dir / tablebase_name / file_name.str(), hash + 1) == NULL));
+}
+
+// the largest shard in the directory with the given extension
+static fs::path largest_shard(fs::path directory, std::string extension)
+{
+    fs::path largest;
+    for (const auto &entry : fs::directory_iterator(directory))
+    {
+        if (entry.path().extension() == extension &&
+            (largest.empty() || fs::file_size(entry.path()) > fs::file_size(largest)))
+        {
+            largest = entry.path();
+        }
+    }
+    return largest;
+}
+
+TEST_CASE("tablebase shards written before the format had a header are read without scores", "pgnProcessor")
+{
+    const fs::path tablebase_test_dir = fs::path("/tmp") / program_start_timestamp;
+    const fs::path shard_path = tablebase_test_dir / "test_tb_version_1" / "005.tb";
+    fs::create_directories(shard_path.parent_path());
+
+    z_hash_t root_hash = zobrist_hash(starting_position().get());
+    z_hash_t hash = 5 + 64 * 12345;
+    uint32_t positions = 1;
+    uint32_t moves = 1;
+    MoveKey move_key = m(E2_SQ, E4_SQ);
+    z_hash_t dest_hash = 77;
+    char pgn_move[8] = "e4";
+    uint32_t times_played = 3;
+    {
+        std::ofstream outfile(shard_path, std::ios::binary);
+        outfile.write(reinterpret_cast<char *>(&root_hash), sizeof(root_hash));
+        outfile.write(reinterpret_cast<char *>(&positions), sizeof(positions));
+        outfile.write(reinterpret_cast<char *>(&hash), sizeof(hash));
+        outfile.write(reinterpret_cast<char *>(&moves), sizeof(moves));
+        outfile.write(reinterpret_cast<char *>(&move_key), sizeof(move_key));
+        outfile.write(reinterpret_cast<char *>(&dest_hash), sizeof(dest_hash));
+        outfile.write(pgn_move, sizeof(pgn_move));
+        outfile.write(reinterpret_cast<char *>(&times_played), sizeof(times_played));
+    }
+
+    Tablebase tablebase(shard_path.parent_path());
+    const MoveEdge &edge = tablebase[hash]->at(move_key);
+    REQUIRE(edge.m_dest_hash == dest_hash);
+    REQUIRE(std::string(edge.m_pgn_move) == "e4");
+    REQUIRE(edge.m_times_played == 3);
+    REQUIRE(edge.m_times_scored == 0);
+    REQUIRE(edge.m_white_half_points == 0);
+
+    // written back in the current format, with a header
+    tablebase.serialize_all(tablebase_test_dir / "test_tb_version_2");
+    Tablebase rewritten(tablebase_test_dir / "test_tb_version_2");
+    REQUIRE(rewritten == tablebase);
+}
+
+TEST_CASE("tablebase shards of an unknown version or that are cut off are rejected", "pgnProcessor")
+{
+    const fs::path tablebase_test_dir = fs::path("/tmp") / program_start_timestamp;
+    const fs::path pgn_test_database_path = fs::path(TEST_ROOT_DIR) /
+                                            "database" / "pgn" / "test_01";
+    const fs::path bad_tablebase_path = tablebase_test_dir / "test_tb_bad_shards";
+
+    PgnProcessor pgnProcessor(tablebase_test_dir / "test_tb_bad_shards_source", pgn_test_database_path);
+    pgnProcessor.process_pgn_files();
+    pgnProcessor.get_tablebase()->serialize_all(bad_tablebase_path / "plain", false);
+    pgnProcessor.get_tablebase()->serialize_all(bad_tablebase_path / "compressed", true);
+
+    for (std::string extension : {".tb", ".tbc"})
+    {
+        fs::path directory = bad_tablebase_path / (extension == ".tb" ? "plain" : "compressed");
+        fs::path shard_path = largest_shard(directory, extension);
+        int shard = std::stoi(shard_path.stem().string());
+        auto read_shard = [&]()
+        {
+            Tablebase tablebase;
+            if (extension == ".tb")
+            {
+                tablebase.read_from_file(shard_path, shard);
+            }
+            else
+            {
+                tablebase.read_from_compressed_file(shard_path, shard);
+            }
+        };
+        REQUIRE_NOTHROW(read_shard());
+
+        std::string contents;
+        {
+            std::ifstream infile(shard_path, std::ios::binary);
+            std::stringstream buffer;
+            buffer << infile.rdbuf();
+            contents = buffer.str();
+        }
+        auto write_shard = [&](std::string data)
+        {
+            std::ofstream outfile(shard_path, std::ios::binary | std::ios::trunc);
+            outfile << data;
+        };
+
+        // a newer version, the version byte follows the 4 byte magic
+        std::string newer = contents;
+        newer[4] = 99;
+        write_shard(newer);
+        REQUIRE_THROWS_AS(read_shard(), std::runtime_error);
+        REQUIRE_THROWS_AS(Tablebase(directory), std::runtime_error);
+
+        std::string not_a_shard = contents;
+        not_a_shard[0] = 'X';
+        write_shard(not_a_shard);
+        REQUIRE_THROWS_AS(read_shard(), std::runtime_error);
+
+        for (size_t size : {(size_t)3, contents.size() / 2, contents.size() - 1})
+        {
+            write_shard(contents.substr(0, size));
+            REQUIRE_THROWS_AS(read_shard(), std::runtime_error);
+        }
+
+        if (extension == ".tbc")
+        {
+            write_shard(newer);
+            REQUIRE_THROWS_AS(Tablebase::probe_compressed_file(shard_path, 0), std::runtime_error);
+        }
+        write_shard(contents);
+    }
+}
+
+TEST_CASE("varints are not read past the end of the data", "pgnProcessor")
+{
+    const uint8_t data[] = {0xac, 0x02, 0x80, 0x80};
+    size_t index = 0;
+    REQUIRE(read_varint(data, 2, &index) == 300);
+    REQUIRE(index == 2);
+    REQUIRE_THROWS_AS(read_varint(data, sizeof(data), &index), std::runtime_error);
+
+    // more continuation bytes than a uint64_t has room for
+    std::vector<uint8_t> too_long(11, 0xff);
+    too_long.push_back(0x01);
+    index = 0;
+    REQUIRE_THROWS_AS(read_varint(too_long.data(), too_long.size(), &index), std::runtime_error);
+}
+
+TEST_CASE("reading a tablebase records how long each shard took to load", "pgnProcessor")
+{
+    const fs::path tablebase_test_dir = fs::path("/tmp") / program_start_timestamp;
+    const fs::path pgn_test_database_path = fs::path(TEST_ROOT_DIR) /
+                                            "database" / "pgn" / "test_01";
+    const std::string tablebase_name = "test_tb_timings";
+
+    PgnProcessor pgnProcessor(tablebase_test_dir / tablebase_name, pgn_test_database_path);
+    pgnProcessor.process_pgn_files();
+    pgnProcessor.serialize_all();
+
+    Tablebase tablebase(tablebase_test_dir / tablebase_name);
+    auto timings = tablebase.get_load_timings();
+
+    REQUIRE(timings.size() == Tablebase::get_shard_count());
+    size_t positions = 0;
+    for (size_t shard = 0; shard < timings.size(); shard++)
+    {
+        REQUIRE(timings.at(shard).m_shard == shard);
+        positions += timings.at(shard).m_positions;
+    }
+    REQUIRE(positions == tablebase.total_size());
+
+    // files that aren't named after a shard are left alone
+    for (std::string file_name : {"notes.tb", "064.tb", "100.tbc", "0001.tb"})
+    {
+        std::ofstream(tablebase_test_dir / tablebase_name / file_name);
+    }
+    Tablebase with_stray_files(tablebase_test_dir / tablebase_name);
+    REQUIRE(with_stray_files == tablebase);
+    REQUIRE(with_stray_files.get_load_timings().size() == Tablebase::get_shard_count());
+
+    // a shard in both formats
+    fs::copy_file(tablebase_test_dir / tablebase_name / "007.tb", tablebase_test_dir / tablebase_name / "007.tbc");
+    REQUIRE_THROWS_AS(Tablebase(tablebase_test_dir / tablebase_name), std::runtime_error);
+}
+
+TEST_CASE("pruning a tablebase drops rare moves and positions beyond the ply limit", "pgnProcessor")
+{
+    const fs::path tablebase_test_dir = fs::path("/tmp") / program_start_timestamp;
+    const fs::path pgn_test_database_path = fs::path(TEST_ROOT_DIR) /
+                                            "database" / "pgn" / "test_04";
+    const std::string tablebase_name = "test_tb_prune";
+
+    PgnProcessor pgnProcessor(tablebase_test_dir / tablebase_name, pgn_test_database_path);
+    pgnProcessor.process_pgn_files();
+    std::shared_ptr<Tablebase> tablebase = pgnProcessor.get_tablebase();
+
+    int positions = tablebase->total_size();
+    int edges = tablebase->total_edges();
+
+    // every position in a freshly built tablebase is reachable from the root
+    PruneSummary noop = tablebase->prune(1, 0);
+    REQUIRE(noop.positions_before == positions);
+    REQUIRE(noop.positions_after == positions);
+    REQUIRE(noop.edges_after == edges);
+
+    const uint32_t min_games = 2;
+    const int max_ply = 8;
+    PruneSummary summary = tablebase->prune(min_games, max_ply);
+    REQUIRE(summary.positions_after < summary.positions_before);
+    REQUIRE(summary.edges_after < summary.edges_before);
+    REQUIRE(summary.positions_after == tablebase->total_size());
+
+    // pruning again with the same limits changes nothing
+    PruneSummary again = tablebase->prune(min_games, max_ply);
+    REQUIRE(again.positions_after == summary.positions_after);
+    REQUIRE(again.edges_after == summary.edges_after);
+
+    std::unordered_set<z_hash_t> visited;
+    std::queue<std::pair<z_hash_t, int>> to_visit;
+    to_visit.push(std::make_pair(zobrist_hash(starting_position().get()), 0));
+    visited.insert(to_visit.front().first);
+    int reached = 0;
+    while (!to_visit.empty())
+    {
+        auto [hash, ply] = to_visit.front();
+        to_visit.pop();
+        std::shared_ptr<MovesPlayed> move_map = (*tablebase)[hash];
+        if (!move_map)
+        {
+            continue;
+        }
+        reached++;
+        REQUIRE(ply < max_ply);
+        for (auto it = move_map->begin(); it != move_map->end(); it++)
+        {
+            REQUIRE(it->second.m_times_played >= min_games);
+            if (visited.insert(it->second.m_dest_hash).second)
+            {
+                to_visit.push(std::make_pair(it->second.m_dest_hash, ply + 1));
+            }
+        }
+    }
+    REQUIRE(reached == summary.positions_after);
+}
+
+TEST_CASE("book analysis aggregates games and scores across transpositions", "pgnProcessor")
+{
+    const fs::path tablebase_test_dir = fs::path("/tmp") / program_start_timestamp;
+    const fs::path pgn_test_database_path = fs::path(TEST_ROOT_DIR) /
+                                            "database" / "pgn" / "test_06";
+    const std::string tablebase_name = "test_tb_analysis";
+
+    PgnProcessor pgnProcessor(tablebase_test_dir / tablebase_name, pgn_test_database_path);
+    pgnProcessor.process_pgn_files();
+    std::shared_ptr<Tablebase> tablebase = pgnProcessor.get_tablebase();
+    tablebase->analyze();
+
+    auto follow = [&tablebase](z_hash_t hash, std::string pgn_move)
+    {
+        std::shared_ptr<MovesPlayed> move_map = (*tablebase)[hash];
+        REQUIRE((move_map != NULL));
+        for (auto it = move_map->begin(); it != move_map->end(); it++)
+        {
+            if (pgn_move.compare(it->second.m_pgn_move) == 0)
+            {
+                return it->second.m_dest_hash;
+            }
+        }
+        FAIL("move " << pgn_move << " not found");
+        return (z_hash_t)0;
+    };
+
+    z_hash_t root_hash = zobrist_hash(starting_position().get());
+    const PositionStats *root_stats = tablebase->get_position_stats(root_hash);
+    REQUIRE((root_stats != NULL));
+    REQUIRE(root_stats->m_games == 3);
+    REQUIRE(root_stats->m_times_scored == 3);
+    REQUIRE(root_stats->m_white_half_points == 4);
+
+    // 1.e4 e5 2.Nf3 Nc6 and 1.Nf3 e5 2.e4 Nc6 reach the same position
+    z_hash_t after_nf3 = follow(follow(follow(root_hash, "e4"), "e5"), "Nf3");
+    z_hash_t transposed = follow(after_nf3, "Nc6");
+    REQUIRE(transposed == follow(follow(follow(follow(root_hash, "Nf3"), "e5"), "e4"), "Nc6"));
+
+    const PositionStats *transposed_stats = tablebase->get_position_stats(transposed);
+    REQUIRE((transposed_stats != NULL));
+    REQUIRE(transposed_stats->m_games == 2);
+    REQUIRE(transposed_stats->m_white_half_points == 2);
+    REQUIRE(transposed_stats->m_min_ply == 4);
+    REQUIRE(transposed_stats->m_reach_probability == Approx(2.0 / 3));
+
+    // Nc6 and Nf6 were each played once after 2.Nf3 and both lost, but Nc6 also
+    // won through the transposition.
+    MoveKey black_move = tablebase->pick_move_by_score(after_nf3, false, 0);
+    REQUIRE(std::string((*tablebase)[after_nf3]->at(black_move).m_pgn_move) == "Nc6");
+
+    MoveKey white_move = tablebase->pick_move_by_score(root_hash, true, 0);
+    REQUIRE(std::string((*tablebase)[root_hash]->at(white_move).m_pgn_move) == "e4");
+}
+
+TEST_CASE("san moves and metadata lines are tokenized without regular expressions", "pgnProcessor")
+{
+    SanMove move;
+
+    REQUIRE(parse_san_move("Nbd7", &move));
+    REQUIRE(move.m_piece == 'N');
+    REQUIRE(move.m_src_file == 'b');
+    REQUIRE(move.m_src_rank == 0);
+    REQUIRE(move.m_dest_file == 'd');
+    REQUIRE(move.m_dest_rank == '7');
+
+    REQUIRE(parse_san_move("exd8=Q#", &move));
+    REQUIRE(move.m_piece == 0);
+    REQUIRE(move.m_src_file == 'e');
+    REQUIRE(move.m_capture == 'x');
+    REQUIRE(move.m_dest_file == 'd');
+    REQUIRE(move.m_dest_rank == '8');
+    REQUIRE(move.m_promotion == 'Q');
+    REQUIRE(move.m_check_or_mate == '#');
+
+    REQUIRE(parse_san_move("Qh4xe1+", &move));
+    REQUIRE(move.m_src_file == 'h');
+    REQUIRE(move.m_src_rank == '4');
+    REQUIRE(move.m_capture == 'x');
+    REQUIRE(move.m_check_or_mate == '+');
+
+    REQUIRE(parse_san_move("O-O-O+", &move));
+    REQUIRE(move.m_castle);
+    REQUIRE(move.m_long_castle);
+    REQUIRE(parse_san_move("O-O", &move));
+    REQUIRE(move.m_castle);
+    REQUIRE(!move.m_long_castle);
+
+    REQUIRE(!parse_san_move("", &move));
+    REQUIRE(!parse_san_move("e9", &move));
+    REQUIRE(!parse_san_move("Nf3!", &move));
+    REQUIRE(!parse_san_move("e8=", &move));
+    REQUIRE(!parse_san_move("xNe4", &move));
+    REQUIRE(!parse_san_move("O-O-O-O", &move));
+
+    std::string_view key, value;
+    REQUIRE(parse_metadata_line(" [White \"Carlsen, Magnus\"]\r", &key, &value));
+    REQUIRE(key == "White");
+    REQUIRE(value == "Carlsen, Magnus");
+    REQUIRE(parse_metadata_line("[WhiteElo \"\"]", &key, &value));
+    REQUIRE(key == "WhiteElo");
+    REQUIRE(value.empty());
+    REQUIRE(!parse_metadata_line("1.e4 e5 2.Nf3 Nc6", &key, &value));
+    REQUIRE(!parse_metadata_line("[Event\"x\"]", &key, &value));
+}
+
+TEST_CASE("pgn files split into chunks at game boundaries produce the same tablebase", "pgnProcessor")
+{
+    const fs::path tablebase_test_dir = fs::path("/tmp") / program_start_timestamp;
+    const fs::path pgn_test_database_path = fs::path(TEST_ROOT_DIR) /
+                                            "database" / "pgn" / "test_04";
+
+    for (const auto &entry : fs::directory_iterator(pgn_test_database_path))
+    {
+        MappedFile mapped_file(entry.path());
+        REQUIRE(mapped_file.is_open());
+        std::string_view data = mapped_file.view();
+
+        std::vector<std::string_view> chunks = split_pgn_into_chunks(data, 4096);
+        REQUIRE(chunks.size() > 1);
+        size_t total_size = 0;
+        for (size_t i = 0; i < chunks.size(); i++)
+        {
+            // the chunks are consecutive, and all but the first start with a new game
+            REQUIRE(chunks.at(i).data() == data.data() + total_size);
+            if (i > 0)
+            {
+                REQUIRE(chunks.at(i).substr(0, 6) == "[Event");
+            }
+            total_size += chunks.at(i).size();
+        }
+        REQUIRE(total_size == data.size());
+    }
+
+    PgnProcessor whole_files(tablebase_test_dir / "test_tb_whole_files", pgn_test_database_path);
+    whole_files.process_pgn_files();
+
+    PgnProcessor small_chunks(tablebase_test_dir / "test_tb_small_chunks", pgn_test_database_path);
+    small_chunks.set_chunk_size(4096);
+    small_chunks.process_pgn_files();
+
+    REQUIRE(*whole_files.get_tablebase() == *small_chunks.get_tablebase());
+}
+
+TEST_CASE("comments, variations and annotations in pgn files are skipped", "pgnProcessor")
+{
+    const fs::path tablebase_test_dir = fs::path("/tmp") / program_start_timestamp;
+    const fs::path pgn_test_database_path_annotated = fs::path(TEST_ROOT_DIR) /
+                                                      "database" / "pgn" / "test_07a";
+    const fs::path pgn_test_database_path_plain = fs::path(TEST_ROOT_DIR) /
+                                                  "database" / "pgn" / "test_07b";
+
+    // same games, but test_07a has comments, variations, NAGs, black move numbers,
+    // and a game with an illegal move in between
+    PgnProcessor annotated(tablebase_test_dir / "test_tb_07a", pgn_test_database_path_annotated);
+    annotated.process_pgn_files();
+
+    PgnProcessor plain(tablebase_test_dir / "test_tb_07b", pgn_test_database_path_plain);
+    plain.process_pgn_files();
+
+    REQUIRE(annotated.get_rejected_games() == 1);
+    REQUIRE(plain.get_rejected_games() == 0);
+    REQUIRE(annotated.get_tablebase()->total_size() == plain.get_tablebase()->total_size());
+    REQUIRE(*annotated.get_tablebase() == *plain.get_tablebase());
+}
+
+TEST_CASE("games without a result are counted once, also when the parser reads more data", "pgnProcessor")
+{
+    Tablebase tablebase;
+    GameDeduplicator deduplicator;
+    PgnParser parser(&tablebase, 15, "no_result.pgn");
+    parser.set_deduplicator(&deduplicator);
+
+    // the first game ends at the next tag pair, the second one at the end of the data
+    PgnParseStats stats = parser.parse("[White \"a\"]\n[Black \"b\"]\n\n1. e4 e5 2. Nf3\n\n"
+                                       "[White \"c\"]\n[Black \"d\"]\n\n1. d4 d5\n");
+    REQUIRE(stats.m_games == 2);
+    REQUIRE(parser.get_metrics().m_games == 2);
+    REQUIRE(tablebase.total_size() == 4);
+
+    stats = parser.parse("[White \"e\"]\n[Black \"f\"]\n\n1. c4 1/2-1/2\n");
+    REQUIRE(stats.m_games == 3);
+    REQUIRE(stats.m_duplicate_games == 0);
+    REQUIRE(parser.get_metrics().m_games == 3);
+    REQUIRE(deduplicator.size() == 3);
+}
+
+TEST_CASE("games are filtered on their tags before their moves are read", "pgnProcessor")
+{
+    const fs::path tablebase_test_dir = fs::path("/tmp") / program_start_timestamp;
+    const fs::path pgn_test_database_path_mixed = fs::path(TEST_ROOT_DIR) /
+                                                  "database" / "pgn" / "test_08a";
+    const fs::path pgn_test_database_path_kept = fs::path(TEST_ROOT_DIR) /
+                                                 "database" / "pgn" / "test_08b";
+
+    REQUIRE(parse_time_control("300") == 300);
+    REQUIRE(parse_time_control("180+2") == 260);
+    REQUIRE(parse_time_control("40/7200:3600") == 7200);
+    REQUIRE(parse_time_control("*60") == 60);
+    REQUIRE(parse_time_control("-") == -1);
+    REQUIRE(parse_time_control("") == -1);
+
+    PgnGameFilter filter;
+    REQUIRE(!filter.is_active());
+    REQUIRE(filter.set_option("min_elo", "2200"));
+    REQUIRE(filter.set_option("min_time_control", "600"));
+    REQUIRE(filter.set_option("from", "2010.01.01"));
+    REQUIRE(filter.set_option("result", "1-0,0-1,1/2-1/2"));
+    REQUIRE(filter.set_option("event", "Open"));
+    REQUIRE(!filter.set_option("max_elo", "2800"));
+    REQUIRE(filter.is_active());
+
+    PgnGame game;
+    game.m_whiteElo = 2500;
+    game.m_blackElo = 2450;
+    game.m_date = "2018.??.??";
+    game.m_result = "1-0";
+    game.m_event = "Club Open";
+    REQUIRE(filter.accepts(game));
+    game.m_date = "2009.12.31";
+    REQUIRE(!filter.accepts(game));
+    game.m_date = "20??.??.??";
+    REQUIRE(filter.accepts(game));
+    game.m_time_control = "180+2";
+    REQUIRE(!filter.accepts(game));
+    game.m_time_control = "5400+30";
+    game.m_blackElo = 2100;
+    REQUIRE(!filter.accepts(game));
+
+    // test_08b has the games of test_08a that pass the filter. One of the filtered games
+    // has a move that isn't SAN, which is never read.
+    PgnProcessor mixed(tablebase_test_dir / "test_tb_08a", pgn_test_database_path_mixed);
+    mixed.set_filter(filter);
+    mixed.process_pgn_files();
+
+    PgnProcessor kept(tablebase_test_dir / "test_tb_08b", pgn_test_database_path_kept);
+    kept.process_pgn_files();
+
+    REQUIRE(mixed.get_filtered_games() == 5);
+    REQUIRE(mixed.get_rejected_games() == 0);
+    REQUIRE(kept.get_filtered_games() == 0);
+    REQUIRE(*mixed.get_tablebase() == *kept.get_tablebase());
+
+    PgnProcessor unfiltered(tablebase_test_dir / "test_tb_08a_unfiltered", pgn_test_database_path_mixed);
+    unfiltered.process_pgn_files();
+    REQUIRE(unfiltered.get_filtered_games() == 0);
+    REQUIRE(unfiltered.get_rejected_games() == 1);
+    REQUIRE(unfiltered.get_tablebase()->total_size() > kept.get_tablebase()->total_size());
+}
+
+TEST_CASE("compressed pgn files are decompressed while they are parsed", "pgnProcessor")
+{
+    const fs::path tablebase_test_dir = fs::path("/tmp") / program_start_timestamp;
+    const fs::path pgn_test_database_path = fs::path(TEST_ROOT_DIR) /
+                                            "database" / "pgn" / "test_09";
+    const fs::path plain_file_path = fs::path(TEST_ROOT_DIR) /
+                                     "database" / "pgn" / "test_04" / "Berliner.pgn";
+
+    // test_09 has Berliner.pgn once as two gzip members and once as two bzip2 streams
+    MappedFile plain_file(plain_file_path);
+    for (std::string extension : {".gz", ".bz2"})
+    {
+        std::unique_ptr<PgnDecompressor> decompressor =
+            open_pgn_decompressor(pgn_test_database_path / ("Berliner.pgn" + extension));
+        REQUIRE(decompressor);
+
+        std::string decompressed;
+        char buffer[1000];
+        for (size_t bytes_read; (bytes_read = decompressor->read(buffer, sizeof(buffer)));)
+        {
+            decompressed.append(buffer, bytes_read);
+        }
+        REQUIRE(decompressed == plain_file.view());
+    }
+
+    PgnProcessor compressed(tablebase_test_dir / "test_tb_09", pgn_test_database_path);
+    compressed.set_chunk_size(4096);
+    compressed.process_pgn_files();
+
+    PgnProcessor plain(tablebase_test_dir / "test_tb_09_plain", pgn_test_database_path);
+    plain.process_pgn_file(plain_file_path);
+    plain.process_pgn_file(plain_file_path);
+
+    REQUIRE(compressed.get_tablebase()->total_size() > 0);
+    REQUIRE(*compressed.get_tablebase() == *plain.get_tablebase());
+}
+
+TEST_CASE("a truncated compressed pgn file is read again by the next update", "pgnProcessor")
+{
+    const fs::path tablebase_test_dir = fs::path("/tmp") / program_start_timestamp;
+    const fs::path pgn_source_path = fs::path(TEST_ROOT_DIR) / "database" / "pgn" / "test_09";
+    const fs::path pgn_test_database_path = tablebase_test_dir / "pgn_truncated";
+    const std::string tablebase_name = "test_tb_truncated";
+
+    for (std::string extension : {".gz", ".bz2"})
+    {
+        fs::remove_all(pgn_test_database_path);
+        fs::remove_all(tablebase_test_dir / tablebase_name);
+        fs::create_directories(pgn_test_database_path);
+
+        // cut off in the second of the two streams
+        const fs::path pgn_file_path = pgn_test_database_path / ("Berliner.pgn" + extension);
+        fs::copy_file(pgn_source_path / ("Berliner.pgn" + extension), pgn_file_path);
+        fs::resize_file(pgn_file_path, fs::file_size(pgn_file_path) * 3 / 4);
+
+        CompressedPgnReader reader(pgn_file_path, 4096, 2);
+        std::string chunk;
+        while (reader.next_chunk(&chunk))
+        {
+        }
+        REQUIRE(reader.failed());
+
+        PgnProcessor first_pass(tablebase_test_dir / tablebase_name, pgn_test_database_path);
+        PgnUpdateSummary first_summary = first_pass.process_new_pgn_files();
+        first_pass.serialize_all();
+        REQUIRE(first_summary.new_files == 1);
+
+        PgnProcessor update_pass(tablebase_test_dir / tablebase_name, pgn_test_database_path);
+        PgnUpdateSummary update_summary = update_pass.process_new_pgn_files();
+        REQUIRE(update_summary.new_files == 1);
+        REQUIRE(update_summary.unchanged_files == 0);
+    }
+}
+
+TEST_CASE("tablebases replayed from a game archive match the ones parsed from pgn", "pgnProcessor")
+{
+    const fs::path tablebase_test_dir = fs::path("/tmp") / program_start_timestamp;
+    const fs::path pgn_test_database_path = fs::path(TEST_ROOT_DIR) /
+                                            "database" / "pgn" / "test_04";
+    const fs::path archive_path = tablebase_test_dir / ("test_04" + game_archive_extension);
+    fs::create_directories(tablebase_test_dir);
+
+    PgnProcessor archived(tablebase_test_dir / "test_tb_archived", pgn_test_database_path);
+    archived.set_archive(archive_path, false);
+    archived.process_pgn_files();
+    REQUIRE(archived.get_archived_games() > 0);
+
+    // decoding the moves past max plies for the archive doesn't change the tablebase
+    PgnProcessor parsed(tablebase_test_dir / "test_tb_parsed", pgn_test_database_path);
+    parsed.process_pgn_files();
+    REQUIRE(*parsed.get_tablebase() == *archived.get_tablebase());
+
+    PgnProcessor replayed(tablebase_test_dir / "test_tb_replayed", pgn_test_database_path);
+    ArchiveReplayStats stats = replayed.process_game_archive(archive_path);
+    REQUIRE(stats.m_games == archived.get_archived_games());
+    REQUIRE(*replayed.get_tablebase() == *archived.get_tablebase());
+
+    // the archive has whole games, so a deeper book can be made from it too
+    PgnGameFilter filter;
+    filter.set_option("min_elo", "2650");
+
+    PgnProcessor parsed_deeper(tablebase_test_dir / "test_tb_parsed_deeper", pgn_test_database_path);
+    parsed_deeper.set_max_plies(25);
+    parsed_deeper.set_filter(filter);
+    parsed_deeper.process_pgn_files();
+
+    PgnProcessor replayed_deeper(tablebase_test_dir / "test_tb_replayed_deeper", pgn_test_database_path);
+    replayed_deeper.set_max_plies(25);
+    replayed_deeper.set_filter(filter);
+    stats = replayed_deeper.process_game_archive(archive_path);
+
+    REQUIRE(stats.m_filtered_games == parsed_deeper.get_filtered_games());
+    REQUIRE(replayed_deeper.get_tablebase()->total_size() > 0);
+    REQUIRE(*replayed_deeper.get_tablebase() == *parsed_deeper.get_tablebase());
+}
+
+TEST_CASE("a bad move after max plies cuts off the archived game instead of rejecting it", "pgnProcessor")
+{
+    const fs::path tablebase_test_dir = fs::path("/tmp") / program_start_timestamp;
+    const fs::path pgn_test_database_path = tablebase_test_dir / "pgn_late_bad_move";
+    const fs::path archive_path = tablebase_test_dir / ("late_bad_move" + game_archive_extension);
+    fs::remove_all(pgn_test_database_path);
+    fs::remove(archive_path);
+    fs::create_directories(pgn_test_database_path);
+    {
+        // the queen can't reach h8, the 9th ply
+        std::ofstream outfile(pgn_test_database_path / "file_001.pgn");
+        outfile << "[Event \"Late bad move\"]\n[Result \"1-0\"]\n\n"
+                << "1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 4. Ba4 Nf6 5. Qh8 Be7 1-0\n";
+    }
+
+    PgnProcessor archived(tablebase_test_dir / "test_tb_late_bad_move_archived", pgn_test_database_path);
+    archived.set_max_plies(4);
+    archived.set_archive(archive_path, false);
+    archived.process_pgn_files();
+
+    PgnProcessor parsed(tablebase_test_dir / "test_tb_late_bad_move_parsed", pgn_test_database_path);
+    parsed.set_max_plies(4);
+    parsed.process_pgn_files();
+
+    REQUIRE(archived.get_rejected_games() == 0);
+    REQUIRE(parsed.get_rejected_games() == 0);
+    REQUIRE(archived.get_archived_games() == 1);
+    REQUIRE(parsed.get_tablebase()->total_size() > 0);
+    REQUIRE(*parsed.get_tablebase() == *archived.get_tablebase());
+
+    // the archived game ends before the bad move
+    PgnProcessor replayed(tablebase_test_dir / "test_tb_late_bad_move_replayed", pgn_test_database_path);
+    replayed.set_max_plies(25);
+    ArchiveReplayStats stats = replayed.process_game_archive(archive_path);
+    REQUIRE(stats.m_games == 1);
+    REQUIRE(stats.m_plies == 8);
+}
+
+TEST_CASE("pgn chunks are balanced over the threads and their work is accounted per thread", "pgnProcessor")
+{
+    const fs::path tablebase_test_dir = fs::path("/tmp") / program_start_timestamp;
+    const fs::path pgn_test_database_path = fs::path(TEST_ROOT_DIR) /
+                                            "database" / "pgn" / "test_04";
+
+    REQUIRE(balanced_pgn_chunk_size(1 << 30, PGN_CHUNK_SIZE, 8) == PGN_CHUNK_SIZE);
+    REQUIRE(balanced_pgn_chunk_size(32 << 20, PGN_CHUNK_SIZE, 8) == (1 << 20));
+    REQUIRE(balanced_pgn_chunk_size(1 << 20, PGN_CHUNK_SIZE, 8) == PGN_MIN_CHUNK_SIZE);
+    REQUIRE(balanced_pgn_chunk_size(1 << 20, 4096, 8) == 4096);
+
+    uintmax_t total_size = 0;
+    for (const auto &entry : fs::directory_iterator(pgn_test_database_path))
+    {
+        total_size += fs::file_size(entry.path());
+    }
+
+    PgnProcessor pgnProcessor(tablebase_test_dir / "test_tb_balanced", pgn_test_database_path);
+    pgnProcessor.set_threads(4);
+    pgnProcessor.process_pgn_files();
+
+    std::vector<PgnWorkerStats> worker_stats = pgnProcessor.get_worker_stats();
+    REQUIRE(worker_stats.size() > 0);
+    REQUIRE(worker_stats.size() <= 4);
+
+    uintmax_t bytes = 0;
+    int chunks = 0;
+    for (size_t i = 0; i < worker_stats.size(); i++)
+    {
+        bytes += worker_stats[i].m_bytes;
+        chunks += worker_stats[i].m_chunks;
+        REQUIRE(worker_stats[i].m_busy_time <= pgnProcessor.get_processing_time());
+        if (i > 0)
+        {
+            REQUIRE(worker_stats[i].m_busy_time <= worker_stats[i - 1].m_busy_time);
+        }
+    }
+    REQUIRE(bytes == total_size);
+    // about 13MB over 4 threads, so the largest files are split
+    REQUIRE(chunks > 13);
+}
+
+TEST_CASE("pgn ingestion metrics count bytes, games and plies and are written as json", "pgnProcessor")
+{
+    const fs::path tablebase_test_dir = fs::path("/tmp") / program_start_timestamp;
+    const fs::path pgn_test_database_path = fs::path(TEST_ROOT_DIR) /
+                                            "database" / "pgn" / "test_07a";
+
+    PgnProcessor pgnProcessor(tablebase_test_dir / "test_tb_metrics", pgn_test_database_path);
+    pgnProcessor.set_max_plies(4);
+    pgnProcessor.process_pgn_files();
+    pgnProcessor.serialize_all();
+
+    PgnIngestMetrics metrics = pgnProcessor.get_metrics();
+    REQUIRE(metrics.m_bytes == fs::file_size(pgn_test_database_path / "file_001.pgn"));
+    REQUIRE(metrics.m_compressed_bytes == 0);
+    REQUIRE(metrics.m_rejected_games == 1);
+    REQUIRE(metrics.m_games == 3);
+    // the first 4 plies of each of the games that were read
+    REQUIRE(metrics.m_plies == 12);
+    REQUIRE(metrics.m_parse_time.count() > 0);
+    REQUIRE(metrics.m_hash_time.count() > 0);
+    REQUIRE(metrics.m_insert_time.count() > 0);
+    // the test binary has the allocation hook, parsing games allocates at least their strings
+    REQUIRE(metrics.m_allocations_counted);
+    REQUIRE(metrics.m_allocations >= (uint64_t)metrics.m_games);
+    REQUIRE(metrics.m_allocated_bytes > 0);
+
+    std::ifstream json_file(tablebase_test_dir / "test_tb_metrics" / ingest_metrics_filename);
+    std::string json;
+    std::getline(json_file, json);
+    REQUIRE(json == metrics.to_json(pgnProcessor.get_processing_time(), pgnProcessor.get_threads()));
+    REQUIRE(json.find("\"games\": 3,") != std::string::npos);
+    REQUIRE(json.find("\"plies\": 12,") != std::string::npos);
+    REQUIRE(json.find("\"allocations\": {\"count\": " + std::to_string(metrics.m_allocations) + ",") != std::string::npos);
+}
+
+TEST_CASE("games that were already read are skipped when deduplicating", "pgnProcessor")
+{
+    const fs::path tablebase_test_dir = fs::path("/tmp") / program_start_timestamp;
+    const fs::path pgn_test_database_path_overlapping = fs::path(TEST_ROOT_DIR) /
+                                                        "database" / "pgn" / "test_10a";
+    const fs::path pgn_test_database_path_unique = fs::path(TEST_ROOT_DIR) /
+                                                   "database" / "pgn" / "test_10b";
+
+    // test_10a has one game twice, under different event names; test_10b has its games once
+    PgnProcessor unique(tablebase_test_dir / "test_tb_10b", pgn_test_database_path_unique);
+    unique.process_pgn_files();
+
+    PgnProcessor overlapping(tablebase_test_dir / "test_tb_10a", pgn_test_database_path_overlapping);
+    overlapping.process_pgn_files();
+    REQUIRE(overlapping.get_duplicate_games() == 0);
+    REQUIRE(!(*overlapping.get_tablebase() == *unique.get_tablebase()));
+
+    PgnProcessor deduplicated(tablebase_test_dir / "test_tb_10a_dedup", pgn_test_database_path_overlapping);
+    deduplicated.set_deduplicate(true);
+    deduplicated.process_pgn_files();
+    REQUIRE(deduplicated.get_duplicate_games() == 1);
+    REQUIRE(deduplicated.get_metrics().m_duplicate_games == 1);
+    REQUIRE(deduplicated.get_metrics().m_games == 5);
+    REQUIRE(*deduplicated.get_tablebase() == *unique.get_tablebase());
+
+    // the games of earlier runs are remembered, an update drops the duplicates of those too
+    const fs::path pgn_update_path = tablebase_test_dir / "pgn_dedup_update";
+    const std::string tablebase_name = "test_tb_dedup_update";
+    fs::remove_all(pgn_update_path);
+    fs::remove_all(tablebase_test_dir / tablebase_name);
+    fs::create_directories(pgn_update_path);
+    fs::copy_file(pgn_test_database_path_overlapping / "file_001.pgn", pgn_update_path / "file_001.pgn");
+
+    PgnProcessor first_pass(tablebase_test_dir / tablebase_name, pgn_update_path);
+    first_pass.set_deduplicate(true);
+    first_pass.process_pgn_files();
+    first_pass.serialize_all();
+    REQUIRE(fs::exists(tablebase_test_dir / tablebase_name / game_hashes_filename));
+
+    fs::copy_file(pgn_test_database_path_overlapping / "file_002.pgn", pgn_update_path / "file_002.pgn");
+    PgnProcessor update_pass(tablebase_test_dir / tablebase_name, pgn_update_path);
+    PgnUpdateSummary summary = update_pass.process_new_pgn_files();
+    REQUIRE(summary.new_files == 1);
+    REQUIRE(update_pass.get_duplicate_games() == 1);
+    REQUIRE(*update_pass.get_tablebase() == *unique.get_tablebase());
+}
+
+TEST_CASE("the identity of a deduplicated game covers all of its moves", "pgnProcessor")
+{
+    // same tags, result and first moves, they only differ after max plies
+    std::string games = "[White \"?\"]\n[Black \"?\"]\n\n1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 *\n\n"
+                        "[White \"?\"]\n[Black \"?\"]\n\n1. e4 e5 2. Nf3 Nc6 3. Bc4 Bc5 *\n";
+
+    Tablebase tablebase;
+    GameDeduplicator deduplicator;
+    PgnParser short_parser(&tablebase, 2, "short.pgn");
+    short_parser.set_deduplicator(&deduplicator);
+    PgnParseStats stats = short_parser.parse(games);
+    REQUIRE(stats.m_games == 2);
+    REQUIRE(stats.m_duplicate_games == 0);
+    REQUIRE(deduplicator.size() == 2);
+
+    // the hashes don't depend on max plies, so a deeper run still knows the games
+    Tablebase deeper_tablebase;
+    PgnParser deeper_parser(&deeper_tablebase, 15, "deeper.pgn");
+    deeper_parser.set_deduplicator(&deduplicator);
+    stats = deeper_parser.parse(games);
+    REQUIRE(stats.m_games == 0);
+    REQUIRE(stats.m_duplicate_games == 2);
+    REQUIRE(deduplicator.size() == 2);
 }
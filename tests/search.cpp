@@ -19,4 +19,82 @@ TEST_CASE("minmax search returns expected move 02", "[minmax_search]")
     auto expected_movekey = lan_to_movekey("a2d5");
 
     REQUIRE(movekey == expected_movekey);
-}
\ No newline at end of file
+}
+TEST_CASE("root parallel search picks the same move as minmax search", "[minmax_search]")
+{
+    std::vector<std::string> fens = {
+        "r7/8/k7/3N4/8/PK5P/8/8 w - - 0 1",
+        "k7/8/8/8/8/5r2/B7/K7 w - - 0 1",
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R b KQ - 1 8",
+    };
+    ThreadPool thread_pool(4);
+    for (auto it = fens.begin(); it != fens.end(); it++)
+    {
+        INFO(*it);
+        auto position = fen_to_position(*it);
+        REQUIRE(root_parallel_search(position, 3, thread_pool) == minmax_search(position, 3));
+    }
+}
+
+TEST_CASE("root parallel search doesn't depend on the number of threads", "[minmax_search]")
+{
+    auto position = fen_to_position("r7/8/k7/3N4/8/PK5P/8/8 w - - 0 1");
+    ThreadPool one_thread(1);
+    ThreadPool four_threads(4);
+
+    std::vector<Eval> expected = evaluate_root_moves(position, 4, one_thread);
+    for (int run = 0; run < 3; run++)
+    {
+        std::vector<Eval> evals = evaluate_root_moves(position, 4, four_threads);
+        REQUIRE(evals.size() == expected.size());
+        for (size_t i = 0; i < evals.size(); i++)
+        {
+            REQUIRE(evals[i].m_movekey == expected[i].m_movekey);
+            REQUIRE(evals[i].m_score == expected[i].m_score);
+        }
+    }
+    REQUIRE(root_parallel_search(position, 4, four_threads) == lan_to_movekey("d5c7"));
+}
+
+TEST_CASE("ybwc search finds the minmax score", "[minmax_search]")
+{
+    std::vector<std::string> fens = {
+        "r7/8/k7/3N4/8/PK5P/8/8 w - - 0 1",
+        "k7/8/8/8/8/5r2/B7/K7 w - - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R b KQ - 1 8",
+    };
+    ThreadPool one_thread(1);
+    ThreadPool four_threads(4);
+    for (auto it = fens.begin(); it != fens.end(); it++)
+    {
+        INFO(*it);
+        auto position = fen_to_position(*it);
+        std::vector<Eval> evals = evaluate_root_moves(position, 3, one_thread);
+        int best_score = evals.front().m_score;
+        for (auto eval = evals.begin(); eval != evals.end(); eval++)
+        {
+            best_score = position->m_whites_turn ? std::max(best_score, eval->m_score) : std::min(best_score, eval->m_score);
+        }
+
+        for (ThreadPool *thread_pool : {&one_thread, &four_threads})
+        {
+            SearchStats stats;
+            Eval eval = ybwc_search(position, 3, *thread_pool, &stats);
+            REQUIRE(eval.m_score == best_score);
+            REQUIRE(stats.m_nodes > 0);
+            REQUIRE(stats.m_threads == thread_pool->size());
+
+            // the move has the best score, even if another one has it too
+            auto best = std::find_if(evals.begin(), evals.end(), [&eval](Eval &root_eval)
+                                     { return root_eval.m_movekey == eval.m_movekey; });
+            REQUIRE(best != evals.end());
+            REQUIRE(best->m_score == best_score);
+        }
+    }
+
+    auto position = fen_to_position("r7/8/k7/3N4/8/PK5P/8/8 w - - 0 1");
+    REQUIRE(ybwc_search(position, 4, four_threads, NULL).m_movekey == lan_to_movekey("d5c7"));
+}
@@ -0,0 +1,327 @@
+#include "catch.hpp"
+#include "threadpool/threadpool.hpp"
+#include "options.hpp"
+#include <atomic>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+TEST_CASE("tasks submitted to the thread pool return their results through futures", "threadPool")
+{
+    ThreadPool thread_pool(4);
+
+    std::future<int> sum = thread_pool.submit([](int a, int b)
+                                              { return a + b; },
+                                              2, 3);
+    REQUIRE(sum.get() == 5);
+
+    // move-only callables and arguments are owned by the task
+    auto value = std::make_unique<int>(42);
+    std::future<int> owned = thread_pool.submit([value = std::move(value)]()
+                                                { return *value; });
+    REQUIRE(owned.get() == 42);
+    std::future<int> moved_argument = thread_pool.submit([](std::unique_ptr<int> p)
+                                                         { return *p + 1; },
+                                                         std::make_unique<int>(1));
+    REQUIRE(moved_argument.get() == 2);
+
+    std::future<void> failing = thread_pool.submit([]()
+                                                   { throw std::runtime_error("task failed"); });
+    REQUIRE_THROWS_AS(failing.get(), std::runtime_error);
+}
+
+TEST_CASE("a batch of tasks returns its futures in order", "threadPool")
+{
+    ThreadPool thread_pool(3);
+
+    std::vector<std::function<int()>> tasks;
+    for (int i = 0; i < 100; i++)
+    {
+        tasks.push_back([i]()
+                        { return i * i; });
+    }
+    std::vector<std::future<int>> futures = thread_pool.submit_batch(std::move(tasks));
+
+    REQUIRE(futures.size() == 100);
+    for (int i = 0; i < 100; i++)
+    {
+        REQUIRE(futures[i].get() == i * i);
+    }
+}
+
+TEST_CASE("the thread pool can be reused after waiting for it to be idle", "threadPool")
+{
+    std::atomic<int> counter = 0;
+    {
+        ThreadPool thread_pool(4);
+        for (int round = 1; round <= 3; round++)
+        {
+            for (int i = 0; i < 50; i++)
+            {
+                thread_pool.add_task(Task([&counter]()
+                                          { counter++; }));
+            }
+            thread_pool.wait_idle();
+            REQUIRE(counter == round * 50);
+        }
+
+        // the destructor runs the tasks that are still queued
+        for (int i = 0; i < 50; i++)
+        {
+            thread_pool.submit([&counter]()
+                               { counter++; });
+        }
+    }
+    REQUIRE(counter == 200);
+}
+
+TEST_CASE("the owner of a work stealing deque takes the newest item and thieves the oldest", "threadPool")
+{
+    WorkStealingDeque<int> deque(2);
+    std::vector<int> items(10);
+    REQUIRE(deque.pop() == NULL);
+    REQUIRE(deque.steal() == NULL);
+
+    // grows past its initial capacity
+    for (int i = 0; i < 10; i++)
+    {
+        items[i] = i;
+        deque.push(&items[i]);
+    }
+    REQUIRE(*deque.pop() == 9);
+    REQUIRE(*deque.steal() == 0);
+    REQUIRE(*deque.steal() == 1);
+    REQUIRE(*deque.pop() == 8);
+
+    for (int i = 2; i < 8; i++)
+    {
+        REQUIRE(*deque.steal() == i);
+    }
+    REQUIRE(deque.empty());
+    REQUIRE(deque.pop() == NULL);
+}
+
+TEST_CASE("every item of a work stealing deque is taken exactly once while thieves steal", "threadPool")
+{
+    const int item_count = 200000;
+    const int thief_count = 3;
+    WorkStealingDeque<int> deque;
+    std::vector<int> items(item_count);
+    std::vector<std::atomic<int>> taken(item_count);
+    std::atomic<bool> done = false;
+
+    std::vector<std::thread> thieves;
+    for (int t = 0; t < thief_count; t++)
+    {
+        thieves.push_back(std::thread([&]()
+                                      {
+            while (!done)
+            {
+                int *item = deque.steal();
+                if (item != NULL)
+                {
+                    taken[*item]++;
+                }
+            } }));
+    }
+
+    // the owner pushes and pops in bursts, so that it races the thieves over the last items
+    for (int i = 0; i < item_count; i++)
+    {
+        items[i] = i;
+        deque.push(&items[i]);
+        if (i % 3 == 0)
+        {
+            int *item = deque.pop();
+            if (item != NULL)
+            {
+                taken[*item]++;
+            }
+        }
+    }
+    for (int *item = deque.pop(); item != NULL; item = deque.pop())
+    {
+        taken[*item]++;
+    }
+    done = true;
+    for (auto it = thieves.begin(); it != thieves.end(); it++)
+    {
+        it->join();
+    }
+
+    int taken_once = 0;
+    for (int i = 0; i < item_count; i++)
+    {
+        taken_once += taken[i] == 1;
+    }
+    REQUIRE(taken_once == item_count);
+}
+
+TEST_CASE("tasks added by tasks running on the pool are run before the pool is idle", "threadPool")
+{
+    ThreadPool thread_pool(4);
+    std::atomic<int> leaves = 0;
+    std::mutex threads_mutex;
+    std::set<std::thread::id> threads;
+
+    // a binary tree of tasks, every inner task adds its two children to its own deque
+    std::function<void(int)> expand = [&](int depth)
+    {
+        if (depth == 0)
+        {
+            leaves++;
+            std::unique_lock<std::mutex> lock(threads_mutex);
+            threads.insert(std::this_thread::get_id());
+            return;
+        }
+        thread_pool.submit(expand, depth - 1);
+        thread_pool.submit(expand, depth - 1);
+    };
+
+    thread_pool.submit(expand, 12);
+    thread_pool.wait_idle();
+    REQUIRE(leaves == 1 << 12);
+    REQUIRE(threads.size() <= 4);
+
+    std::vector<std::function<void()>> batch;
+    for (int i = 0; i < 4; i++)
+    {
+        batch.push_back([&]()
+                        { expand(8); });
+    }
+    thread_pool.submit_batch(std::move(batch));
+    thread_pool.wait_idle();
+    REQUIRE(leaves == (1 << 12) + 4 * (1 << 8));
+}
+
+TEST_CASE("a wait group waits for its own tasks on a shared pool", "threadPool")
+{
+    ThreadPool thread_pool(2);
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    thread_pool.submit([released]()
+                       { released.wait(); });
+
+    std::atomic<int> counter = 0;
+    {
+        WaitGroup group(thread_pool);
+        for (int i = 0; i < 20; i++)
+        {
+            group.submit([&counter]()
+                         { counter++; });
+        }
+        group.wait();
+        REQUIRE(counter == 20);
+
+        std::vector<std::function<void()>> batch(10, [&counter]()
+                                                 { counter++; });
+        group.submit_batch(std::move(batch));
+    }
+    // the destructor waited for the batch, while the other task is still blocked
+    REQUIRE(counter == 30);
+    release.set_value();
+    thread_pool.wait_idle();
+}
+
+static int parallel_sum(ThreadPool &thread_pool, int from, int to)
+{
+    if (to - from <= 4)
+    {
+        int sum = 0;
+        for (int i = from; i < to; i++)
+        {
+            sum += i;
+        }
+        return sum;
+    }
+
+    // the waiting task runs queued tasks, so nested groups don't need a thread each
+    WaitGroup group(thread_pool);
+    int middle = (from + to) / 2;
+    std::future<int> left = group.submit(parallel_sum, std::ref(thread_pool), from, middle);
+    std::future<int> right = group.submit(parallel_sum, std::ref(thread_pool), middle, to);
+    group.wait();
+    return left.get() + right.get();
+}
+
+TEST_CASE("tasks can wait for wait groups of their own subtasks", "threadPool")
+{
+    ThreadPool thread_pool(2);
+    WaitGroup group(thread_pool);
+    std::future<int> sum = group.submit(parallel_sum, std::ref(thread_pool), 0, 1000);
+    group.wait();
+    REQUIRE(sum.get() == 999 * 1000 / 2);
+}
+
+TEST_CASE("the shared thread pool is sized by the Threads option", "threadPool")
+{
+    int default_threads = shared_thread_pool().size();
+    REQUIRE(default_threads >= 1);
+
+    REQUIRE(set_option("Threads", "3"));
+    REQUIRE(shared_thread_pool().size() == 3);
+    REQUIRE(!set_option("Threads", "0"));
+    REQUIRE(!set_option("Threads", "100000"));
+    REQUIRE(!set_option("Ponder", "true"));
+    REQUIRE(shared_thread_pool().size() == 3);
+
+    WaitGroup group(shared_thread_pool());
+    std::future<int> result = group.submit([]()
+                                           { return 7; });
+    group.wait();
+    REQUIRE(result.get() == 7);
+
+    REQUIRE(set_option("Threads", std::to_string(default_threads)));
+    REQUIRE(shared_thread_pool().size() == default_threads);
+}
+
+TEST_CASE("a pool can pin each of its threads to one CPU", "threadPool")
+{
+    ThreadPool thread_pool(4, true);
+    REQUIRE(thread_pool.pins_threads());
+
+    // the number of CPUs the thread running the task may use
+    std::function<int()> cpu_count = []()
+    {
+#ifdef __linux__
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        pthread_getaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        return CPU_COUNT(&cpus);
+#else
+        return 1;
+#endif
+    };
+
+    WaitGroup group(thread_pool);
+    std::vector<std::future<int>> cpu_counts = group.submit_batch(std::vector<std::function<int()>>(16, cpu_count));
+    group.wait();
+    for (auto it = cpu_counts.begin(); it != cpu_counts.end(); it++)
+    {
+        REQUIRE(it->get() == 1);
+    }
+}
+
+TEST_CASE("the ThreadAffinity option pins the shared pool's threads", "threadPool")
+{
+    int threads = shared_thread_pool().size();
+    REQUIRE(!shared_thread_pool().pins_threads());
+
+    REQUIRE(set_option("ThreadAffinity", "true"));
+    REQUIRE(shared_thread_pool().pins_threads());
+    REQUIRE(shared_thread_pool().size() == threads);
+    REQUIRE(!set_option("ThreadAffinity", "yes"));
+
+    WaitGroup group(shared_thread_pool());
+    std::future<int> result = group.submit([]()
+                                           { return 7; });
+    group.wait();
+    REQUIRE(result.get() == 7);
+
+    REQUIRE(set_option("ThreadAffinity", "false"));
+    REQUIRE(!shared_thread_pool().pins_threads());
+}